@@ -5,8 +5,944 @@
 #include <semaphore>
 #include <chrono>
 #include <vector>
+#include <array>
 #include <mutex>
 #include <atomic>
+#include <condition_variable>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+#include <complex>
+#include <cmath>
+#include <memory>
+#include <unordered_map>
+#include <string_view>
+#include <charconv>
+#include <fstream>
+#include <iterator>
+#include <type_traits>
+#include <immintrin.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+
+// ===================== Квантовая схема =====================
+// Компактное представление схемы: массив вентилей фиксированного размера.
+// Плотные матрицы (для вентилей Matrix) хранятся в общем массиве схемы по строкам.
+// В матрице вентиля бит j локального индекса соответствует кубиту qubits[j].
+
+enum class GateType : uint8_t { H, X, Y, Z, S, T, RX, RY, RZ, CNOT, CZ, SWAP, Matrix };
+
+const int max_gate_qubits = 6; // Максимальное число кубитов одного вентиля (с учетом слияния)
+
+struct Gate {
+    GateType type;
+    uint8_t arity;                   // Число кубитов вентиля
+    uint16_t qubits[max_gate_qubits];// Для CNOT: [0] - управляющий, [1] - целевой
+    double param = 0;                // Угол поворота (RX, RY, RZ)
+    uint32_t matrix = 0;             // Смещение матрицы в Circuit::matrices (для Matrix)
+};
+
+struct Circuit {
+    int qubits = 0;
+    std::vector<Gate> gates;
+    std::vector<std::complex<double>> matrices;
+
+    void add(GateType type, int q0, int q1 = -1, double param = 0) {
+        Gate gate{};
+        gate.type = type;
+        gate.arity = q1 < 0 ? 1 : 2;
+        gate.qubits[0] = static_cast<uint16_t>(q0);
+        if (q1 >= 0) gate.qubits[1] = static_cast<uint16_t>(q1);
+        gate.param = param;
+        gates.push_back(gate);
+    }
+
+    // Произвольная унитарная матрица на кубитах qubits (2^k x 2^k по строкам)
+    void add_matrix(const std::vector<int>& targets, const std::complex<double>* m) {
+        Gate gate{};
+        gate.type = GateType::Matrix;
+        gate.arity = static_cast<uint8_t>(targets.size());
+        for (size_t j = 0; j < targets.size(); ++j) {
+            gate.qubits[j] = static_cast<uint16_t>(targets[j]);
+        }
+        gate.matrix = static_cast<uint32_t>(matrices.size());
+        size_t dim = size_t(1) << targets.size();
+        matrices.insert(matrices.end(), m, m + dim * dim);
+        gates.push_back(gate);
+    }
+};
+
+// Плотная матрица вентиля (2^arity x 2^arity по строкам)
+void gate_matrix(const Gate& gate, const Circuit& circuit, std::complex<double>* m) {
+    using C = std::complex<double>;
+    const double r = 1.0 / std::sqrt(2.0);
+    const C i(0, 1);
+    double half = gate.param / 2;
+    switch (gate.type) {
+    case GateType::H:  m[0] = r; m[1] = r; m[2] = r; m[3] = -r; break;
+    case GateType::X:  m[0] = 0; m[1] = 1; m[2] = 1; m[3] = 0; break;
+    case GateType::Y:  m[0] = 0; m[1] = -i; m[2] = i; m[3] = 0; break;
+    case GateType::Z:  m[0] = 1; m[1] = 0; m[2] = 0; m[3] = -1; break;
+    case GateType::S:  m[0] = 1; m[1] = 0; m[2] = 0; m[3] = i; break;
+    case GateType::T:  m[0] = 1; m[1] = 0; m[2] = 0; m[3] = std::polar(1.0, M_PI / 4); break;
+    case GateType::RX: m[0] = std::cos(half); m[1] = -i * std::sin(half); m[2] = -i * std::sin(half); m[3] = std::cos(half); break;
+    case GateType::RY: m[0] = std::cos(half); m[1] = -std::sin(half); m[2] = std::sin(half); m[3] = std::cos(half); break;
+    case GateType::RZ: m[0] = std::polar(1.0, -half); m[1] = 0; m[2] = 0; m[3] = std::polar(1.0, half); break;
+    case GateType::CNOT:
+    case GateType::CZ:
+    case GateType::SWAP:
+        std::fill(m, m + 16, C(0));
+        m[0] = 1;
+        if (gate.type == GateType::CNOT) { m[1 * 4 + 3] = 1; m[2 * 4 + 2] = 1; m[3 * 4 + 1] = 1; }
+        if (gate.type == GateType::CZ)   { m[1 * 4 + 1] = 1; m[2 * 4 + 2] = 1; m[3 * 4 + 3] = -1; }
+        if (gate.type == GateType::SWAP) { m[1 * 4 + 2] = 1; m[2 * 4 + 1] = 1; m[3 * 4 + 3] = 1; }
+        break;
+    case GateType::Matrix: {
+        size_t dim = size_t(1) << gate.arity;
+        std::copy(circuit.matrices.begin() + gate.matrix, circuit.matrices.begin() + gate.matrix + dim * dim, m);
+        break;
+    }
+    }
+}
+
+// Случайная схема: слои однокубитных поворотов и "кирпичная кладка" из CNOT
+Circuit make_random_circuit(int qubits, int depth, uint32_t seed) {
+    Circuit circuit;
+    circuit.qubits = qubits;
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<> angle(0, 2 * M_PI);
+    std::uniform_int_distribution<> kind(0, 2);
+    for (int layer = 0; layer < depth; ++layer) {
+        for (int q = 0; q < qubits; ++q) {
+            int k = kind(gen);
+            if (k == 0) circuit.add(GateType::H, q);
+            if (k == 1) circuit.add(GateType::RZ, q, -1, angle(gen));
+            if (k == 2) circuit.add(GateType::RX, q, -1, angle(gen));
+        }
+        for (int q = layer % 2; q + 1 < qubits; q += 2) {
+            circuit.add(GateType::CNOT, q, q + 1);
+        }
+    }
+    return circuit;
+}
+
+// Квантовое преобразование Фурье на qubits кубитах
+Circuit make_qft_circuit(int qubits) {
+    Circuit circuit;
+    circuit.qubits = qubits;
+    for (int q = qubits - 1; q >= 0; --q) {
+        circuit.add(GateType::H, q);
+        for (int k = q - 1; k >= 0; --k) {
+            // Контролируемый фазовый сдвиг, разложенный на CNOT и RZ
+            double phi = M_PI / static_cast<double>(1 << std::min(q - k, 30));
+            circuit.add(GateType::RZ, k, -1, phi / 2);
+            circuit.add(GateType::RZ, q, -1, phi / 2);
+            circuit.add(GateType::CNOT, k, q);
+            circuit.add(GateType::RZ, q, -1, -phi / 2);
+            circuit.add(GateType::CNOT, k, q);
+        }
+    }
+    return circuit;
+}
+
+// ===================== Разбор OpenQASM =====================
+// Подмножество OpenQASM 2 и 3: регистры (qreg/creg, qubit/bit), вентили qelib1.inc и
+// stdgates.inc без пользовательских определений, barrier и конечные измерения.
+// Лексемы - string_view в исходный текст, поэтому разбор не выделяет память на каждую
+// лексему; растут только массивы вентилей и матриц схемы. Вентили, которых нет среди
+// GateType, добавляются плотными матрицами (Matrix).
+
+const int qasm_max_qubits = 1024;
+
+// Базовые операции подмножества; управляемые вентили - базовая операция с controls
+enum class QasmGate : uint8_t { Id, H, X, Y, Z, S, Sdg, T, Tdg, SX, SXdg, RX, RY, RZ, P, U2, U3, Swap };
+
+struct QasmGateInfo {
+    std::string_view name;
+    QasmGate gate;
+    uint8_t params;
+    uint8_t controls;
+};
+
+constexpr QasmGateInfo qasm_gates[] = {
+    {"h", QasmGate::H, 0, 0},      {"x", QasmGate::X, 0, 0},       {"y", QasmGate::Y, 0, 0},
+    {"z", QasmGate::Z, 0, 0},      {"s", QasmGate::S, 0, 0},       {"sdg", QasmGate::Sdg, 0, 0},
+    {"t", QasmGate::T, 0, 0},      {"tdg", QasmGate::Tdg, 0, 0},   {"sx", QasmGate::SX, 0, 0},
+    {"sxdg", QasmGate::SXdg, 0, 0}, {"id", QasmGate::Id, 0, 0},    {"rx", QasmGate::RX, 1, 0},
+    {"ry", QasmGate::RY, 1, 0},    {"rz", QasmGate::RZ, 1, 0},     {"p", QasmGate::P, 1, 0},
+    {"u1", QasmGate::P, 1, 0},     {"phase", QasmGate::P, 1, 0},   {"u2", QasmGate::U2, 2, 0},
+    {"u3", QasmGate::U3, 3, 0},    {"u", QasmGate::U3, 3, 0},      {"U", QasmGate::U3, 3, 0},
+    {"cx", QasmGate::X, 0, 1},     {"CX", QasmGate::X, 0, 1},      {"cnot", QasmGate::X, 0, 1},
+    {"cy", QasmGate::Y, 0, 1},     {"cz", QasmGate::Z, 0, 1},      {"ch", QasmGate::H, 0, 1},
+    {"cp", QasmGate::P, 1, 1},     {"cu1", QasmGate::P, 1, 1},     {"cphase", QasmGate::P, 1, 1},
+    {"crx", QasmGate::RX, 1, 1},   {"cry", QasmGate::RY, 1, 1},    {"crz", QasmGate::RZ, 1, 1},
+    {"cu3", QasmGate::U3, 3, 1},   {"swap", QasmGate::Swap, 0, 0}, {"ccx", QasmGate::X, 0, 2},
+    {"cswap", QasmGate::Swap, 0, 1},
+};
+
+// Матрица базовой операции (2x2, для Swap - 4x4)
+void qasm_base_matrix(QasmGate gate, const double* p, std::complex<double>* m) {
+    using C = std::complex<double>;
+    const C i(0, 1);
+    auto u3 = [&](double theta, double phi, double lambda) {
+        m[0] = std::cos(theta / 2);
+        m[1] = -std::polar(1.0, lambda) * std::sin(theta / 2);
+        m[2] = std::polar(1.0, phi) * std::sin(theta / 2);
+        m[3] = std::polar(1.0, phi + lambda) * std::cos(theta / 2);
+    };
+    Gate native{};
+    native.arity = 1;
+    switch (gate) {
+    case QasmGate::Id:   m[0] = 1; m[1] = 0; m[2] = 0; m[3] = 1; return;
+    case QasmGate::Sdg:  m[0] = 1; m[1] = 0; m[2] = 0; m[3] = -i; return;
+    case QasmGate::Tdg:  m[0] = 1; m[1] = 0; m[2] = 0; m[3] = std::polar(1.0, -M_PI / 4); return;
+    case QasmGate::SX:   m[0] = C(0.5, 0.5); m[1] = C(0.5, -0.5); m[2] = C(0.5, -0.5); m[3] = C(0.5, 0.5); return;
+    case QasmGate::SXdg: m[0] = C(0.5, -0.5); m[1] = C(0.5, 0.5); m[2] = C(0.5, 0.5); m[3] = C(0.5, -0.5); return;
+    case QasmGate::P:    m[0] = 1; m[1] = 0; m[2] = 0; m[3] = std::polar(1.0, p[0]); return;
+    case QasmGate::U2:   u3(M_PI / 2, p[0], p[1]); return;
+    case QasmGate::U3:   u3(p[0], p[1], p[2]); return;
+    case QasmGate::Swap: native.type = GateType::SWAP; native.arity = 2; break;
+    case QasmGate::H:    native.type = GateType::H; break;
+    case QasmGate::X:    native.type = GateType::X; break;
+    case QasmGate::Y:    native.type = GateType::Y; break;
+    case QasmGate::Z:    native.type = GateType::Z; break;
+    case QasmGate::S:    native.type = GateType::S; break;
+    case QasmGate::T:    native.type = GateType::T; break;
+    case QasmGate::RX:   native.type = GateType::RX; native.param = p[0]; break;
+    case QasmGate::RY:   native.type = GateType::RY; native.param = p[0]; break;
+    case QasmGate::RZ:   native.type = GateType::RZ; native.param = p[0]; break;
+    }
+    gate_matrix(native, Circuit{}, m);
+}
+
+struct QasmRegister {
+    std::string_view name;
+    int offset;     // Первый кубит (бит) регистра
+    int size;
+    bool quantum;
+};
+
+struct QasmParser {
+    std::string_view src;
+    Circuit& circuit;
+    size_t pos = 0;
+    int line = 1;
+    int bits = 0;                    // Классических битов
+    int measurements = 0;
+    std::vector<QasmRegister> registers;
+    std::vector<uint8_t> measured;   // Кубит уже измерен (измерения только конечные)
+    std::string error;               // Заполняется только при ошибке
+
+    QasmParser(std::string_view source, Circuit& target) : src(source), circuit(target) {}
+
+    bool fail(std::string_view message, std::string_view token = {}) {
+        if (!error.empty()) return false;
+        error = "line " + std::to_string(line) + ": ";
+        error.append(message);
+        if (!token.empty()) {
+            error += " '";
+            error.append(token);
+            error += "'";
+        }
+        return false;
+    }
+
+    void skip_space() {
+        while (pos < src.size()) {
+            char c = src[pos];
+            if (c == '\n') {
+                ++line;
+                ++pos;
+            } else if (c == ' ' || c == '\t' || c == '\r') {
+                ++pos;
+            } else if (c == '/' && pos + 1 < src.size() && src[pos + 1] == '/') {
+                while (pos < src.size() && src[pos] != '\n') ++pos;
+            } else if (c == '/' && pos + 1 < src.size() && src[pos + 1] == '*') {
+                size_t end = src.find("*/", pos + 2);
+                end = end == std::string_view::npos ? src.size() : end + 2;
+                line += static_cast<int>(std::count(src.begin() + static_cast<long>(pos), src.begin() + static_cast<long>(end), '\n'));
+                pos = end;
+            } else {
+                break;
+            }
+        }
+    }
+
+    static bool is_identifier_char(char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || static_cast<unsigned char>(c) >= 0x80; // π и прочий UTF-8
+    }
+
+    // Следующая лексема: идентификатор, число, строка, "->", "**" или один символ
+    std::string_view next() {
+        skip_space();
+        if (pos >= src.size()) return {};
+        size_t start = pos;
+        char c = src[pos];
+        auto digit = [&](size_t at) { return at < src.size() && std::isdigit(static_cast<unsigned char>(src[at])); };
+        if (is_identifier_char(c) && !std::isdigit(static_cast<unsigned char>(c))) {
+            while (pos < src.size() && is_identifier_char(src[pos])) ++pos;
+        } else if (digit(pos) || (c == '.' && digit(pos + 1))) {
+            while (digit(pos) || (pos < src.size() && src[pos] == '.')) ++pos;
+            if (pos < src.size() && (src[pos] == 'e' || src[pos] == 'E')) {
+                size_t exponent = pos + 1;
+                if (exponent < src.size() && (src[exponent] == '+' || src[exponent] == '-')) ++exponent;
+                if (digit(exponent)) {
+                    pos = exponent;
+                    while (digit(pos)) ++pos;
+                }
+            }
+        } else if (c == '"') {
+            size_t end = src.find('"', pos + 1);
+            pos = end == std::string_view::npos ? src.size() : end + 1;
+        } else if ((c == '-' && pos + 1 < src.size() && src[pos + 1] == '>') ||
+                   (c == '*' && pos + 1 < src.size() && src[pos + 1] == '*')) {
+            pos += 2;
+        } else {
+            ++pos;
+        }
+        return src.substr(start, pos - start);
+    }
+
+    std::string_view peek() {
+        size_t saved_pos = pos;
+        int saved_line = line;
+        std::string_view token = next();
+        pos = saved_pos;
+        line = saved_line;
+        return token;
+    }
+
+    bool expect(std::string_view what) {
+        std::string_view token = next();
+        if (token == what) return true;
+        fail(std::string("expected '").append(what).append("' before"), token.empty() ? "end of file" : token);
+        return false;
+    }
+
+    bool integer(int& value) {
+        std::string_view token = next();
+        auto [end, ec] = std::from_chars(token.data(), token.data() + token.size(), value);
+        if (ec != std::errc() || end != token.data() + token.size() || value < 0) return fail("expected a non-negative integer, got", token);
+        return true;
+    }
+
+    // Выражения параметров: числа, pi, + - * / ^ (**), скобки и элементарные функции
+    bool expression(double& value) {
+        if (!term(value)) return false;
+        for (std::string_view op = peek(); op == "+" || op == "-"; op = peek()) {
+            bool plus = next() == "+";
+            double rhs;
+            if (!term(rhs)) return false;
+            value = plus ? value + rhs : value - rhs;
+        }
+        return true;
+    }
+
+    bool term(double& value) {
+        if (!unary(value)) return false;
+        for (std::string_view op = peek(); op == "*" || op == "/"; op = peek()) {
+            bool times = next() == "*";
+            double rhs;
+            if (!unary(rhs)) return false;
+            value = times ? value * rhs : value / rhs;
+        }
+        return true;
+    }
+
+    bool unary(double& value) {
+        std::string_view token = peek();
+        if (token == "-" || token == "+") {
+            next();
+            if (!unary(value)) return false;
+            if (token == "-") value = -value;
+            return true;
+        }
+        if (!primary(value)) return false;
+        std::string_view op = peek();
+        if (op == "^" || op == "**") {
+            next();
+            double exponent;
+            if (!unary(exponent)) return false;
+            value = std::pow(value, exponent);
+        }
+        return true;
+    }
+
+    bool primary(double& value) {
+        std::string_view token = next();
+        if (token.empty()) return fail("unexpected end of file in expression");
+        if (token == "(") return expression(value) && expect(")");
+        if (std::isdigit(static_cast<unsigned char>(token[0])) || token[0] == '.') {
+            auto [end, ec] = std::from_chars(token.data(), token.data() + token.size(), value);
+            if (ec != std::errc() || end != token.data() + token.size()) return fail("bad number", token);
+            return true;
+        }
+        if (token == "pi" || token == "π") {
+            value = M_PI;
+            return true;
+        }
+        if (token == "tau" || token == "τ") {
+            value = 2 * M_PI;
+            return true;
+        }
+        double (*function)(double) = nullptr;
+        if (token == "sin") function = std::sin;
+        if (token == "cos") function = std::cos;
+        if (token == "tan") function = std::tan;
+        if (token == "exp") function = std::exp;
+        if (token == "ln") function = std::log;
+        if (token == "sqrt") function = std::sqrt;
+        if (!function) return fail("unexpected token in expression", token);
+        if (!expect("(") || !expression(value) || !expect(")")) return false;
+        value = function(value);
+        return true;
+    }
+
+    const QasmRegister* find_register(std::string_view name) const {
+        for (const QasmRegister& r : registers) {
+            if (r.name == name) return &r;
+        }
+        return nullptr;
+    }
+
+    // Операнд: регистр целиком (count = размер) или элемент reg[i] (count = 0)
+    bool operand(bool quantum, int& first, int& count) {
+        std::string_view name = next();
+        const QasmRegister* r = find_register(name);
+        if (!r || r->quantum != quantum) return fail(quantum ? "unknown qubit register" : "unknown bit register", name);
+        first = r->offset;
+        count = r->size;
+        if (peek() != "[") return true;
+        next();
+        int index;
+        if (!integer(index) || !expect("]")) return false;
+        if (index >= r->size) return fail("index out of range for register", name);
+        first += index;
+        count = 0;
+        return true;
+    }
+
+    bool declare(std::string_view name, int size, bool quantum) {
+        if (!is_identifier_char(name.empty() ? ' ' : name[0]) || std::isdigit(static_cast<unsigned char>(name[0]))) {
+            return fail("expected a register name, got", name);
+        }
+        if (find_register(name)) return fail("register redeclared", name);
+        if (size < 1) return fail("register must not be empty", name);
+        int& total = quantum ? circuit.qubits : bits;
+        if (quantum && total + size > qasm_max_qubits) return fail("too many qubits in register", name);
+        registers.push_back({name, total, size, quantum});
+        total += size;
+        if (quantum) measured.resize(static_cast<size_t>(circuit.qubits), 0);
+        return true;
+    }
+
+    // qreg name[n]; creg name[n]; (OpenQASM 2)
+    bool declaration2(bool quantum) {
+        std::string_view name = next();
+        int size;
+        return expect("[") && integer(size) && expect("]") && expect(";") && declare(name, size, quantum);
+    }
+
+    // qubit[n] name; bit name; (OpenQASM 3)
+    bool declaration3(bool quantum) {
+        int size = 1;
+        if (peek() == "[") {
+            next();
+            if (!integer(size) || !expect("]")) return false;
+        }
+        std::string_view name = next();
+        return expect(";") && declare(name, size, quantum);
+    }
+
+    // measure q[i] -> c[j]; или c[j] = measure q[i]; (target - уже разобранный бит)
+    bool measure(bool has_target, int target_count) {
+        int first, count;
+        if (!operand(true, first, count)) return false;
+        if (!has_target && peek() == "->") {
+            next();
+            int bit, bit_count;
+            if (!operand(false, bit, bit_count)) return false;
+            has_target = true;
+            target_count = bit_count;
+        }
+        if (has_target && target_count != count) return fail("measure operands have different sizes");
+        if (!expect(";")) return false;
+        for (int j = 0; j < std::max(count, 1); ++j) measured[static_cast<size_t>(first + j)] = 1;
+        measurements += std::max(count, 1);
+        return true;
+    }
+
+    bool gate(std::string_view name) {
+        const QasmGateInfo* info = nullptr;
+        for (const QasmGateInfo& g : qasm_gates) {
+            if (g.name == name) {
+                info = &g;
+                break;
+            }
+        }
+        if (!info) return fail("unsupported gate or statement", name);
+
+        double params[3] = {0, 0, 0};
+        int param_count = 0;
+        if (peek() == "(") {
+            next();
+            while (peek() != ")") {
+                if (param_count == 3) return fail("too many parameters for gate", name);
+                if (!expression(params[param_count++])) return false;
+                if (peek() != ",") break;
+                next();
+            }
+            if (!expect(")")) return false;
+        }
+        if (param_count != info->params) return fail("wrong number of parameters for gate", name);
+
+        int arity = info->controls + (info->gate == QasmGate::Swap ? 2 : 1);
+        int first[max_gate_qubits], count[max_gate_qubits];
+        int broadcast = 0; // Число применений при передаче регистров целиком
+        for (int k = 0; k < arity; ++k) {
+            if (k > 0 && !expect(",")) return false;
+            if (!operand(true, first[k], count[k])) return false;
+            if (count[k] > 0 && broadcast > 0 && count[k] != broadcast) return fail("register sizes differ in gate", name);
+            if (count[k] > 0) broadcast = count[k];
+        }
+        if (!expect(";")) return false;
+        if (info->gate == QasmGate::Id) return true;
+
+        std::complex<double> base[16];
+        qasm_base_matrix(info->gate, params, base);
+        for (int j = 0; j < std::max(broadcast, 1); ++j) {
+            int q[max_gate_qubits];
+            for (int k = 0; k < arity; ++k) {
+                q[k] = first[k] + (count[k] > 0 ? j : 0);
+                if (measured[static_cast<size_t>(q[k])]) return fail("gate after measurement is not supported", name);
+                for (int l = 0; l < k; ++l) {
+                    if (q[l] == q[k]) return fail("repeated qubit in gate", name);
+                }
+            }
+            emit(*info, params, base, q, arity);
+        }
+        return true;
+    }
+
+    // Вентиль схемы: встроенный тип, если он есть, иначе плотная матрица
+    void emit(const QasmGateInfo& info, const double* params, const std::complex<double>* base, const int* q, int arity) {
+        if (info.controls == 0) {
+            switch (info.gate) {
+            case QasmGate::H:    circuit.add(GateType::H, q[0]); return;
+            case QasmGate::X:    circuit.add(GateType::X, q[0]); return;
+            case QasmGate::Y:    circuit.add(GateType::Y, q[0]); return;
+            case QasmGate::Z:    circuit.add(GateType::Z, q[0]); return;
+            case QasmGate::S:    circuit.add(GateType::S, q[0]); return;
+            case QasmGate::T:    circuit.add(GateType::T, q[0]); return;
+            case QasmGate::RX:   circuit.add(GateType::RX, q[0], -1, params[0]); return;
+            case QasmGate::RY:   circuit.add(GateType::RY, q[0], -1, params[0]); return;
+            case QasmGate::RZ:   circuit.add(GateType::RZ, q[0], -1, params[0]); return;
+            case QasmGate::Swap: circuit.add(GateType::SWAP, q[0], q[1]); return;
+            default: break;
+            }
+        }
+        if (info.controls == 1 && info.gate == QasmGate::X) return circuit.add(GateType::CNOT, q[0], q[1]);
+        if (info.controls == 1 && info.gate == QasmGate::Z) return circuit.add(GateType::CZ, q[0], q[1]);
+
+        // Управляющие кубиты - младшие биты локального индекса
+        size_t dim = size_t(1) << arity;
+        size_t base_dim = dim >> info.controls;
+        size_t mask = (size_t(1) << info.controls) - 1;
+        std::complex<double> m[64]; // До трех кубитов (ccx, cswap)
+        for (size_t r = 0; r < dim; ++r) {
+            for (size_t c = 0; c < dim; ++c) {
+                bool active = (r & mask) == mask && (c & mask) == mask;
+                m[r * dim + c] = active ? base[(r >> info.controls) * base_dim + (c >> info.controls)]
+                                        : std::complex<double>(r == c ? 1 : 0);
+            }
+        }
+        circuit.add_matrix(std::vector<int>(q, q + arity), m);
+    }
+
+    bool statement() {
+        std::string_view token = next();
+        if (token == "OPENQASM") {
+            std::string_view version = next();
+            if (version != "2.0" && version != "2" && version != "3.0" && version != "3") {
+                return fail("unsupported OpenQASM version", version);
+            }
+            return expect(";");
+        }
+        if (token == "include") {
+            next(); // Стандартные вентили встроены
+            return expect(";");
+        }
+        if (token == "qreg" || token == "creg") return declaration2(token == "qreg");
+        if (token == "qubit" || token == "bit") return declaration3(token == "qubit");
+        if (token == "barrier") {
+            while (!token.empty() && token != ";") token = next();
+            return !token.empty() || fail("unexpected end of file after barrier");
+        }
+        if (token == "measure") return measure(false, 0);
+        const QasmRegister* r = find_register(token);
+        if (r && !r->quantum) {
+            int count = r->size;
+            if (peek() == "[") {
+                int index;
+                next();
+                if (!integer(index) || !expect("]")) return false;
+                if (index >= r->size) return fail("index out of range for register", token);
+                count = 0;
+            }
+            return expect("=") && expect("measure") && measure(true, count);
+        }
+        return gate(token);
+    }
+};
+
+// Разбор текста OpenQASM в схему; при ошибке false и сообщение с номером строки
+bool parse_qasm(std::string_view source, Circuit& circuit, std::string* error = nullptr) {
+    circuit = Circuit{};
+    QasmParser parser(source, circuit);
+    while (true) {
+        parser.skip_space();
+        if (parser.pos >= source.size()) break;
+        if (!parser.statement()) {
+            if (error) *error = parser.error;
+            return false;
+        }
+    }
+    if (circuit.qubits == 0) {
+        if (error) *error = "no qubits declared";
+        return false;
+    }
+    return true;
+}
+
+// Запись схемы в OpenQASM 2 (вентили Matrix не записываются - вернется пустая строка)
+std::string circuit_to_qasm(const Circuit& circuit) {
+    std::string text = "OPENQASM 2.0;\ninclude \"qelib1.inc\";\nqreg q[" + std::to_string(circuit.qubits) + "];\n";
+    char buffer[96];
+    for (const Gate& g : circuit.gates) {
+        const char* name = nullptr;
+        switch (g.type) {
+        case GateType::H: name = "h"; break;
+        case GateType::X: name = "x"; break;
+        case GateType::Y: name = "y"; break;
+        case GateType::Z: name = "z"; break;
+        case GateType::S: name = "s"; break;
+        case GateType::T: name = "t"; break;
+        case GateType::RX: name = "rx"; break;
+        case GateType::RY: name = "ry"; break;
+        case GateType::RZ: name = "rz"; break;
+        case GateType::CNOT: name = "cx"; break;
+        case GateType::CZ: name = "cz"; break;
+        case GateType::SWAP: name = "swap"; break;
+        case GateType::Matrix: return {};
+        }
+        bool rotation = g.type == GateType::RX || g.type == GateType::RY || g.type == GateType::RZ;
+        int length = rotation ? std::snprintf(buffer, sizeof(buffer), "%s(%.17g) q[%d];\n", name, g.param, g.qubits[0])
+                   : g.arity == 2 ? std::snprintf(buffer, sizeof(buffer), "%s q[%d],q[%d];\n", name, g.qubits[0], g.qubits[1])
+                                  : std::snprintf(buffer, sizeof(buffer), "%s q[%d];\n", name, g.qubits[0]);
+        text.append(buffer, static_cast<size_t>(length));
+    }
+    return text;
+}
+
+// ===================== Слияние вентилей =====================
+// Каждый вентиль - полный проход по вектору состояния, поэтому соседние вентили
+// с пересекающимися кубитами объединяются в одну плотную матрицу до fusion_max_qubits
+// кубитов. Открытые блоки владеют своими кубитами монопольно: вентиль на чужих кубитах
+// с ними коммутирует, так что блоки можно выпускать в порядке закрытия.
+
+int fusion_max_qubits = 4; // 0 или 1 - слияние выключено
+
+// Применение матрицы g (arity кубитов на позициях pos) к вектору длины 2^m
+void apply_to_small_vector(std::complex<double>* vec, int m, const int* pos, int arity,
+                           const std::complex<double>* g) {
+    size_t dim = size_t(1) << arity;
+    std::complex<double> in[1 << max_gate_qubits];
+    for (size_t base = 0; base < (size_t(1) << m); ++base) {
+        bool is_base = true;
+        for (int j = 0; j < arity; ++j) is_base = is_base && !(base & (size_t(1) << pos[j]));
+        if (!is_base) continue;
+        size_t offsets[1 << max_gate_qubits];
+        for (size_t l = 0; l < dim; ++l) {
+            offsets[l] = base;
+            for (int j = 0; j < arity; ++j) {
+                if (l & (size_t(1) << j)) offsets[l] |= size_t(1) << pos[j];
+            }
+            in[l] = vec[offsets[l]];
+        }
+        for (size_t r = 0; r < dim; ++r) {
+            std::complex<double> sum = 0;
+            for (size_t c = 0; c < dim; ++c) sum += g[r * dim + c] * in[c];
+            vec[offsets[r]] = sum;
+        }
+    }
+}
+
+struct FusionBlock {
+    std::vector<int> qubits;  // Кубиты блока (по возрастанию)
+    std::vector<size_t> gates;// Индексы вентилей исходной схемы в порядке применения
+};
+
+// Выпуск блока: одиночный вентиль копируется как есть, остальные сворачиваются в матрицу
+void emit_fusion_block(const Circuit& source, const FusionBlock& block, Circuit& out) {
+    if (block.gates.size() == 1) {
+        Gate gate = source.gates[block.gates[0]];
+        if (gate.type == GateType::Matrix) {
+            size_t dim = size_t(1) << gate.arity;
+            uint32_t offset = static_cast<uint32_t>(out.matrices.size());
+            out.matrices.insert(out.matrices.end(), source.matrices.begin() + gate.matrix,
+                                source.matrices.begin() + gate.matrix + dim * dim);
+            gate.matrix = offset;
+        }
+        out.gates.push_back(gate);
+        return;
+    }
+    int m = static_cast<int>(block.qubits.size());
+    size_t dim = size_t(1) << m;
+    // Столбцы единичной матрицы хранятся подряд: columns[c * dim + r]
+    std::vector<std::complex<double>> columns(dim * dim, 0);
+    for (size_t c = 0; c < dim; ++c) columns[c * dim + c] = 1;
+    std::vector<std::complex<double>> g(size_t(1) << (2 * max_gate_qubits));
+    for (size_t index : block.gates) {
+        const Gate& gate = source.gates[index];
+        int pos[max_gate_qubits];
+        for (int j = 0; j < gate.arity; ++j) {
+            pos[j] = static_cast<int>(std::find(block.qubits.begin(), block.qubits.end(), gate.qubits[j]) - block.qubits.begin());
+        }
+        gate_matrix(gate, source, g.data());
+        for (size_t c = 0; c < dim; ++c) {
+            apply_to_small_vector(columns.data() + c * dim, m, pos, gate.arity, g.data());
+        }
+    }
+    std::vector<std::complex<double>> rows(dim * dim);
+    for (size_t r = 0; r < dim; ++r) {
+        for (size_t c = 0; c < dim; ++c) rows[r * dim + c] = columns[c * dim + r];
+    }
+    out.add_matrix(block.qubits, rows.data());
+}
+
+Circuit fuse_circuit(const Circuit& source, int max_qubits) {
+    max_qubits = std::min(max_qubits, max_gate_qubits);
+    Circuit out;
+    out.qubits = source.qubits;
+    std::vector<int> owner(source.qubits, -1); // Открытый блок, владеющий кубитом
+    std::vector<FusionBlock> blocks;
+    std::vector<bool> open;
+
+    auto close_block = [&](int b) {
+        emit_fusion_block(source, blocks[b], out);
+        for (int q : blocks[b].qubits) owner[q] = -1;
+        open[b] = false;
+    };
+
+    for (size_t index = 0; index < source.gates.size(); ++index) {
+        const Gate& gate = source.gates[index];
+        std::vector<int> touched;
+        std::vector<int> qubits(gate.qubits, gate.qubits + gate.arity);
+        for (int j = 0; j < gate.arity; ++j) {
+            int b = owner[gate.qubits[j]];
+            if (b >= 0 && std::find(touched.begin(), touched.end(), b) == touched.end()) touched.push_back(b);
+        }
+        for (int b : touched) qubits.insert(qubits.end(), blocks[b].qubits.begin(), blocks[b].qubits.end());
+        std::sort(qubits.begin(), qubits.end());
+        qubits.erase(std::unique(qubits.begin(), qubits.end()), qubits.end());
+
+        FusionBlock block;
+        if (static_cast<int>(qubits.size()) <= max_qubits) {
+            // Затронутые блоки на разных кубитах коммутируют - их можно склеить
+            block.qubits = qubits;
+            for (int b : touched) {
+                block.gates.insert(block.gates.end(), blocks[b].gates.begin(), blocks[b].gates.end());
+                open[b] = false;
+            }
+        } else {
+            for (int b : touched) close_block(b);
+            block.qubits.assign(gate.qubits, gate.qubits + gate.arity);
+            std::sort(block.qubits.begin(), block.qubits.end());
+        }
+        block.gates.push_back(index);
+        int id = static_cast<int>(blocks.size());
+        for (int q : block.qubits) owner[q] = id;
+        blocks.push_back(std::move(block));
+        open.push_back(true);
+    }
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        if (open[b]) close_block(static_cast<int>(b));
+    }
+    return out;
+}
+
+enum class Precision : uint8_t { Double, Float };
+
+// Исполнитель схемы: вектор состояния (шум не учитывается), траектории шума, матрица плотности,
+// MPS (большие схемы с малой запутанностью, без шума) или вектор, разделенный между процессами
+enum class Backend : uint8_t { Auto, StateVector, Trajectories, DensityMatrix, MPS, Distributed };
+
+// ===================== Разрезание схем =====================
+// Схема, которая не помещается на один процессор, делится по границе кубитов на два
+// фрагмента [0, split) и [split, n). Каждый двухкубитный вентиль через границу (CZ, а
+// также CNOT = H CZ H) заменяется разложением канала CZ на локальные операции:
+//   CZ = 1/2 [S x S] + 1/2 [S+ x S+] + 1/2 [M x I] - 1/2 [M x Z] + 1/2 [I x M] - 1/2 [Z x M],
+// где M - измерение Z со знаком исхода: M(rho) = P0 rho P0 - P1 rho P1. После раскрытия M
+// на каждом разрезе 10 слагаемых, а у фрагмента - 6 вариантов локальной операции
+// (I, Z, S, S+, P0, P1). Варианты фрагментов выполняются как обычные подзадачи, а
+// распределение вероятностей собирается из них классически: P(x) = sum c * pA(xA) * pB(xB).
+
+enum class CutOp : uint8_t { I, Z, S, Sdg, P0, P1 };
+const int cut_op_count = 6;
+
+struct CutTerm {
+    CutOp a, b;   // Операции на стороне фрагмента A и B
+    double coef;
+};
+
+const CutTerm cut_terms[] = {
+    {CutOp::S, CutOp::S, 0.5},    {CutOp::Sdg, CutOp::Sdg, 0.5},
+    {CutOp::P0, CutOp::I, 0.5},   {CutOp::P1, CutOp::I, -0.5},
+    {CutOp::P0, CutOp::Z, -0.5},  {CutOp::P1, CutOp::Z, 0.5},
+    {CutOp::I, CutOp::P0, 0.5},   {CutOp::I, CutOp::P1, -0.5},
+    {CutOp::Z, CutOp::P0, -0.5},  {CutOp::Z, CutOp::P1, 0.5},
+};
+
+int processor_max_qubits = 28; // Больше кубитов одному процессору не достается - такие схемы режутся
+int cutting_max_cuts = 3;      // 6^k вариантов каждого фрагмента и 10^k слагаемых при сборке
+
+struct CutPlan {
+    int split = 0;                  // Фрагмент A - кубиты [0, split), B - [split, n)
+    std::vector<size_t> cut_gates;  // Индексы разрезаемых вентилей
+};
+
+// Выбор границы с наименьшим числом разрезов; nullptr - схему нельзя разрезать
+std::shared_ptr<const CutPlan> plan_cut(const Circuit& circuit) {
+    int n = circuit.qubits;
+    std::shared_ptr<CutPlan> best;
+    for (int split = 1; split < n; ++split) {
+        if (split > processor_max_qubits || n - split > processor_max_qubits) continue;
+        auto plan = std::make_shared<CutPlan>();
+        plan->split = split;
+        bool feasible = true;
+        for (size_t i = 0; i < circuit.gates.size() && feasible; ++i) {
+            const Gate& gate = circuit.gates[i];
+            bool low = false, high = false;
+            for (int j = 0; j < gate.arity; ++j) (gate.qubits[j] < split ? low : high) = true;
+            if (!(low && high)) continue;
+            feasible = gate.type == GateType::CZ || gate.type == GateType::CNOT;
+            plan->cut_gates.push_back(i);
+        }
+        if (!feasible || static_cast<int>(plan->cut_gates.size()) > cutting_max_cuts) continue;
+        bool better = !best || plan->cut_gates.size() < best->cut_gates.size()
+                      || (plan->cut_gates.size() == best->cut_gates.size()
+                          && std::abs(2 * split - n) < std::abs(2 * best->split - n));
+        if (better) best = plan;
+    }
+    return best;
+}
+
+// Схема варианта фрагмента: variant - номер в системе счисления по основанию 6 (разряд на разрез)
+Circuit make_fragment_circuit(const Circuit& circuit, const CutPlan& plan, int fragment, int variant) {
+    Circuit out;
+    int offset = fragment == 0 ? 0 : plan.split;
+    out.qubits = fragment == 0 ? plan.split : circuit.qubits - plan.split;
+    auto mine = [&](int q) { return fragment == 0 ? q < plan.split : q >= plan.split; };
+    const std::complex<double> i(0, 1);
+    size_t next_cut = 0;
+    for (size_t g = 0; g < circuit.gates.size(); ++g) {
+        const Gate& gate = circuit.gates[g];
+        if (next_cut < plan.cut_gates.size() && plan.cut_gates[next_cut] == g) {
+            int digit = variant;
+            for (size_t k = 0; k < next_cut; ++k) digit /= cut_op_count;
+            CutOp op = static_cast<CutOp>(digit % cut_op_count);
+            ++next_cut;
+            int q = mine(gate.qubits[0]) ? gate.qubits[0] : gate.qubits[1];
+            int local = q - offset;
+            bool target_side = gate.type == GateType::CNOT && q == gate.qubits[1];
+            if (target_side) out.add(GateType::H, local);
+            if (op == CutOp::Z) out.add(GateType::Z, local);
+            if (op == CutOp::S) out.add(GateType::S, local);
+            if (op == CutOp::Sdg || op == CutOp::P0 || op == CutOp::P1) {
+                std::complex<double> m[4] = {1, 0, 0, -i};
+                if (op == CutOp::P0) m[3] = 0;
+                if (op == CutOp::P1) m[0] = 0, m[3] = 1;
+                out.add_matrix({local}, m);
+            }
+            if (target_side) out.add(GateType::H, local);
+            continue;
+        }
+        if (!mine(gate.qubits[0])) continue;
+        if (gate.type == GateType::Matrix) {
+            std::vector<int> targets;
+            for (int j = 0; j < gate.arity; ++j) targets.push_back(gate.qubits[j] - offset);
+            out.add_matrix(targets, circuit.matrices.data() + gate.matrix);
+        } else {
+            Gate copy = gate;
+            for (int j = 0; j < gate.arity; ++j) copy.qubits[j] = static_cast<uint16_t>(gate.qubits[j] - offset);
+            out.gates.push_back(copy);
+        }
+    }
+    return out;
+}
+
+struct ShotJob;
+struct MemoryReservation;
+
+const int cut_full_distribution_qubits = 22; // До скольких кубитов собирать полное распределение
+
+// Результаты вариантов фрагментов одной разрезанной задачи
+struct CutJob {
+    int task_id = 0;
+    std::shared_ptr<const Circuit> circuit;
+    std::shared_ptr<const CutPlan> plan;
+    int variants = 0;                 // 6^разрезов вариантов на фрагмент
+    bool full_distribution = false;   // Собирать ли полное распределение (2^n чисел)
+    std::vector<double> total[2];     // [фрагмент][вариант] - сумма вероятностей
+    std::vector<double> zero[2];      // Вероятность нулевого исхода фрагмента
+    std::vector<std::vector<double>> probabilities[2]; // Полные распределения (если нужны)
+    int shots = 0;                    // Шоты по собранному распределению
+    std::atomic<int> remaining{0};
+    std::chrono::steady_clock::time_point started;
+    std::shared_ptr<MemoryReservation> memory; // Распределения фрагментов и сборки в бюджете памяти
+};
+
+// Память задания разрезания сверх векторов фрагментов: распределения всех вариантов
+// обоих фрагментов, собранное распределение и (для шотов) выборщик по нему
+size_t cut_job_memory_bytes(const Circuit& circuit, const CutPlan& plan, int shots) {
+    if (circuit.qubits > cut_full_distribution_qubits) return 0;
+    size_t variants = 1;
+    for (size_t k = 0; k < plan.cut_gates.size(); ++k) variants *= cut_op_count;
+    size_t fragments = (size_t(1) << plan.split) + (size_t(1) << (circuit.qubits - plan.split));
+    size_t bytes = (variants * fragments + (size_t(1) << circuit.qubits)) * sizeof(double);
+    if (shots > 0) bytes += size_t(12) << circuit.qubits; // Таблица псевдонимов
+    return bytes;
+}
+
+// Признаки стоимости схемы для модели времени выполнения (см. circuit_cost_features)
+struct CostFeatures {
+    double compute = 0;  // Взвешенных амплитудо-операций на поток
+    double memory = 0;   // Байт проходов по вектору состояния на поток
+    double gates = 0;    // Вентилей исходной схемы, если она сливается
+};
+
+struct TrajectoryJob;
+struct Checkpoint;
+
+// Шум для моделирования траекториями: вероятности на каждом кубите вентиля после этого вентиля
+struct NoiseModel {
+    double depolarizing = 0;      // Вероятность ошибки Паули (X, Y, Z равновероятны)
+    double amplitude_damping = 0; // gamma - вероятность распада |1> -> |0>
+
+    bool active() const { return depolarizing > 0 || amplitude_damping > 0; }
+};
+
+const int trajectory_distribution_qubits = 22; // До скольких кубитов усреднять полное распределение траекторий
 
 // Структура для задачи квантового симулятора
 struct QuantumTask {
@@ -16,8 +952,34 @@ struct QuantumTask {
     int duration;       // Время выполнения в миллисекундах
     int required_qubits;// Требуемое количество кубитов
     bool is_split = false; // Была ли задача разделена
+    std::chrono::steady_clock::time_point enqueued_at{}; // Момент постановки в очередь
+    std::shared_ptr<const Circuit> circuit = nullptr; // Схема для симулятора (если нет - задача только ждет duration)
+    Precision precision = Precision::Double;   // Точность амплитуд
+    std::shared_ptr<const CutPlan> cut_plan = nullptr; // План разрезания (для схем больше processor_max_qubits)
+    std::shared_ptr<CutJob> cut_job = nullptr;         // Для варианта фрагмента: общий результат
+    int cut_fragment = 0;
+    int cut_variant = 0;
+    int shots = 0;                                     // Число измерений конечного состояния (0 - без выборки)
+    std::shared_ptr<ShotJob> shot_job = nullptr;       // Для подзадачи выборки: общий результат
+    int shot_index = 0;
+    CostFeatures cost{};                               // Признаки схемы для оценки и калибровки duration
+    NoiseModel noise{};
+    int trajectories = 0;                              // Траекторий шума (0 - идеальная схема)
+    std::shared_ptr<TrajectoryJob> trajectory_job = nullptr; // Для пакета траекторий: общий результат
+    int trajectory_batch = 0;
+    int trajectory_count = 0;                          // Траекторий в пакете
+    Backend backend = Backend::StateVector;            // Выбранный исполнитель (для DensityMatrix circuit - удвоенная схема)
+    std::shared_ptr<const Checkpoint> checkpoint = nullptr; // Вытесненная задача продолжается с контрольной точки
+    int preemptions = 0;
+    int subtask = 0;                                   // Номер подзадачи задачи id (0 - сама задача)
 };
 
+// Имя задачи в выводе и файлах: подзадача сохраняет id исходной задачи и получает номер
+// (7.12 - подзадача 12 задачи 7), поэтому не может совпасть с id другой задачи
+std::string task_name(const QuantumTask& task) {
+    return task.subtask == 0 ? std::to_string(task.id) : std::to_string(task.id) + "." + std::to_string(task.subtask);
+}
+
 // Оператор сравнения для очереди с приоритетами
 struct ComparePriority {
     bool operator()(const QuantumTask& t1, const QuantumTask& t2) {
@@ -34,114 +996,5086 @@ struct ComparePriority {
     }
 };
 
-std::priority_queue<QuantumTask, std::vector<QuantumTask>, ComparePriority> task_queue;
-std::counting_semaphore<4> quantum_processors(4); // 4 квантовых процессора
-std::mutex queue_mutex; // Мьютекс для синхронизации доступа к очереди
-std::mutex output_mutex; // Мьютекс для вывода в консоль
-std::atomic<int> failed_processor(-1); // Идентификатор вышедшего из строя процессора (-1 - все работают)
+// ===================== Память на huge pages =====================
+// Крупные блоки планировщика отображаются кратно 2 МБ с выравниванием по границе 2 МБ;
+// в режиме Transparent ядру разрешается отдать их прозрачными huge pages.
+// Зарезервированные huge pages (MAP_HUGETLB) планировщик не использует.
 
-// Функция для обработки задачи на квантовом процессоре
-void process_quantum_task(QuantumTask task, int processor_id) {
-    // Проверяем, не вышел ли процессор из строя
-    if (processor_id == failed_processor.load()) {
-        std::lock_guard<std::mutex> out_lock(output_mutex);
-        std::cout << "Task " << task.id << " failed on processor " << processor_id 
-                  << " (processor broken)" << std::endl;
-        return;
-    }
+enum class HugePageMode { Off, Transparent };
 
-    // Захватываем процессор
-    quantum_processors.acquire();
-    
-    {
-        std::lock_guard<std::mutex> out_lock(output_mutex);
-        std::cout << "Processor " << processor_id << ": Task " << task.id 
-                  << " (priority " << task.priority 
-                  << (task.is_critical ? ", CRITICAL" : "") 
-                  << ") started. Duration: " << task.duration << "ms" 
-                  << (task.is_split ? " (split task)" : "") << std::endl;
-    }
+HugePageMode huge_page_mode = HugePageMode::Off;
+const size_t huge_page_size = 2 * 1024 * 1024;
 
-    // Имитация выполнения задачи
-    std::this_thread::sleep_for(std::chrono::milliseconds(task.duration));
+size_t round_to_huge_page(size_t bytes) {
+    return (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+}
 
-    // Освобождаем процессор
-    quantum_processors.release();
-    
-    {
-        std::lock_guard<std::mutex> out_lock(output_mutex);
-        std::cout << "Processor " << processor_id << ": Task " << task.id << " completed." << std::endl;
+void* huge_page_alloc(size_t bytes) {
+    size_t rounded = round_to_huge_page(bytes);
+    // Берем с запасом и отрезаем края, чтобы участок начинался на границе 2 МБ
+    void* raw = mmap(nullptr, rounded + huge_page_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) throw std::bad_alloc();
+    uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+    uintptr_t aligned = (start + huge_page_size - 1) / huge_page_size * huge_page_size;
+    if (aligned > start) {
+        munmap(raw, aligned - start);
+    }
+    size_t tail = huge_page_size - (aligned - start);
+    if (tail > 0) {
+        munmap(reinterpret_cast<void*>(aligned + rounded), tail);
     }
+    if (huge_page_mode == HugePageMode::Transparent) {
+        madvise(reinterpret_cast<void*>(aligned), rounded, MADV_HUGEPAGE);
+    }
+    return reinterpret_cast<void*>(aligned);
 }
 
-// Функция для разделения задачи на более мелкие
-QuantumTask split_task(const QuantumTask& original_task) {
-    QuantumTask new_task = original_task;
-    new_task.id = original_task.id * 100 + rand() % 100; // Новый ID для подзадачи
-    new_task.duration = original_task.duration / 2;
-    new_task.required_qubits = original_task.required_qubits / 2;
-    new_task.is_split = true;
-    return new_task;
+void huge_page_free(void* ptr, size_t bytes) {
+    munmap(ptr, round_to_huge_page(bytes));
 }
 
-// Функция для добавления задач в очередь
-void add_quantum_task(int id, int priority, bool is_critical, int duration, int qubits) {
-    QuantumTask task = {id, priority, is_critical, duration, qubits};
-    
-    std::lock_guard<std::mutex> queue_lock(queue_mutex);
-    task_queue.push(task);
-    
-    std::lock_guard<std::mutex> out_lock(output_mutex);
-    std::cout << "Task " << id << " added to queue. Priority: " << priority 
-              << (is_critical ? " (CRITICAL)" : "") 
-              << ", Duration: " << duration << "ms, Qubits: " << qubits << std::endl;
-}
+// ===================== Прогрев при запуске =====================
+// Первые задачи после запуска платят за рост вектора очереди и отказы страниц.
+// С прогревом планировщик до приема задач выделяет очередь на queue_capacity задач
+// и закрепляет процессоры за ядрами.
 
-// Функция обработки задач из очереди
-void process_quantum_tasks(int processor_id) {
-    while (true) {
-        std::unique_lock<std::mutex> queue_lock(queue_mutex);
-        if (task_queue.empty()) {
-            queue_lock.unlock();
-            break;
-        }
-        
-        QuantumTask task = task_queue.top();
-        task_queue.pop();
-        queue_lock.unlock();
+struct WarmupConfig {
+    bool enabled = false;
+    size_t queue_capacity = 1 << 16; // Резерв задач в очереди
+    bool pin_threads = true;         // Закрепить потоки обработки за ядрами
+};
 
-        // Проверяем, не нужно ли разделить задачу (если процессор перегружен)
-        if (task.required_qubits > 5 && !task.is_split) { // Условная проверка на перегрузку
-            std::lock_guard<std::mutex> out_lock(output_mutex);
-            std::cout << "Processor " << processor_id << ": Task " << task.id 
-                      << " is too large, splitting..." << std::endl;
-            
-            queue_lock.lock();
-            QuantumTask sub_task1 = split_task(task);
-            QuantumTask sub_task2 = split_task(task);
-            task_queue.push(sub_task1);
-            task_queue.push(sub_task2);
-            queue_lock.unlock();
-            
-            continue;
+WarmupConfig warmup;
+
+// Хранилище очереди задач: от 2 МБ - через huge_page_alloc, меньше - обычный new
+template <typename T>
+struct QueueAllocator {
+    using value_type = T;
+
+    QueueAllocator() = default;
+    template <typename U>
+    QueueAllocator(const QueueAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        size_t bytes = n * sizeof(T);
+        if (bytes < huge_page_size) {
+            return static_cast<T*>(::operator new(bytes));
         }
+        return static_cast<T*>(huge_page_alloc(bytes));
+    }
 
-        process_quantum_task(task, processor_id);
+    void deallocate(T* ptr, size_t n) {
+        size_t bytes = n * sizeof(T);
+        if (bytes < huge_page_size) {
+            ::operator delete(ptr);
+        } else {
+            huge_page_free(ptr, bytes);
+        }
     }
-}
 
-// Функция для имитации сбоя процессора
-void simulate_processor_failure(int processor_id) {
-    std::this_thread::sleep_for(std::chrono::seconds(2));
-    failed_processor.store(processor_id);
-    
-    std::lock_guard<std::mutex> out_lock(output_mutex);
-    std::cout << "!!! Processor " << processor_id << " FAILED !!!" << std::endl;
-}
+    template <typename U>
+    bool operator==(const QueueAllocator<U>&) const { return true; }
+};
 
-int main() {
-    // Инициализация генератора случайных чисел
-    std::srand(std::time(nullptr));
+using TaskQueue = std::priority_queue<QuantumTask, std::vector<QuantumTask, QueueAllocator<QuantumTask>>, ComparePriority>;
+
+TaskQueue task_queue;
+std::counting_semaphore<4> quantum_processors(4); // 4 квантовых процессора
+std::mutex queue_mutex; // Мьютекс для синхронизации доступа к очереди
+std::mutex output_mutex; // Мьютекс для вывода в консоль
+std::atomic<int> failed_processor(-1); // Идентификатор вышедшего из строя процессора (-1 - все работают)
+bool verbose_log = true; // Подробный вывод о каждой задаче
+std::chrono::steady_clock::time_point program_start = std::chrono::steady_clock::now();
+
+// Задержки от постановки задачи в очередь до начала ее выполнения
+struct LatencyRecorder {
+    std::mutex mutex;
+    std::vector<double> samples_us;
+    double first_dispatch_us = 0; // От запуска программы до первой задачи
+
+    void record(std::chrono::steady_clock::time_point enqueued_at) {
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(mutex);
+        if (samples_us.empty()) {
+            first_dispatch_us = std::chrono::duration<double, std::micro>(now - program_start).count();
+        }
+        samples_us.push_back(std::chrono::duration<double, std::micro>(now - enqueued_at).count());
+    }
+
+    void print(const char* label) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (samples_us.empty()) return;
+        std::vector<double> sorted = samples_us;
+        std::sort(sorted.begin(), sorted.end());
+        double total = 0;
+        for (double us : sorted) total += us;
+        std::cout << label << ": first dispatch after " << first_dispatch_us << " us, latency avg "
+                  << total / sorted.size() << " us, p99 " << sorted[sorted.size() * 99 / 100]
+                  << " us, max " << sorted.back() << " us (" << sorted.size() << " tasks)" << std::endl;
+    }
+};
+
+LatencyRecorder dispatch_latency;
+
+// Процессор processor_id работает на ядре processor_id (по модулю числа ядер)
+void pin_processor_thread(int processor_id) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(processor_id % std::max(1u, std::thread::hardware_concurrency()), &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+// Очередь сразу на queue_capacity задач; задачи, поставленные до прогрева, переносятся
+void warm_up_scheduler() {
+    if (!warmup.enabled) return;
+    std::vector<QuantumTask, QueueAllocator<QuantumTask>> storage;
+    storage.reserve(warmup.queue_capacity);
+    // Запись каждого элемента заставляет ядро выделить страницы сейчас, а не под первыми задачами
+    storage.resize(warmup.queue_capacity);
+    storage.clear();
+    std::lock_guard<std::mutex> queue_lock(queue_mutex);
+    while (!task_queue.empty()) {
+        storage.push_back(task_queue.top());
+        task_queue.pop();
+    }
+    task_queue = TaskQueue(ComparePriority(), std::move(storage));
+}
+
+// ===================== Симулятор вектора состояния =====================
+// Вектор из 2^n амплитуд (complex<double> или complex<float>), выровненный по 64 байтам.
+// Каждый вентиль - один проход по вектору; проход делится между simulation_threads
+// потоками, если вектор достаточно велик. Потоки берутся из общего для всех процессоров
+// пула, а не создаются на каждый проход: у глубокой схемы проходов тысячи.
+
+int simulation_threads = std::max(1u, std::thread::hardware_concurrency() / 4); // Потоков на одну задачу
+const size_t parallel_min_chunk = size_t(1) << 14; // Меньшие проходы выполняются в одном потоке
+const int simulation_processors = 4; // Процессоров, одновременно выполняющих проходы (quantum_processors)
+
+thread_local bool inside_parallel_for = false; // Вложенные parallel_for выполняются в вызывающем потоке
+
+// Постоянные потоки для parallel_for. Проход делится на части; части ставятся в общую
+// очередь, и вызывающий поток сам выполняет оставшиеся части своего прохода, поэтому
+// проход завершается, даже если все потоки пула заняты проходами других процессоров.
+// Пул растет до (simulation_threads - 1) потоков на каждый процессор.
+struct ParallelPool {
+    struct Job {
+        void (*invoke)(const void* body, size_t begin, size_t end);
+        const void* body;
+        size_t count, chunk, parts;
+        size_t next = 0; // Следующая невзятая часть (под mutex)
+        size_t done = 0; // Выполненные части (под mutex)
+    };
+
+    std::mutex mutex;
+    std::condition_variable work_cv; // Появились части для пула
+    std::condition_variable done_cv; // Какой-то проход выполнен целиком
+    std::deque<Job*> jobs;           // Проходы, у которых остались невзятые части
+    std::atomic<int> workers{0};
+    std::vector<int> cpus;           // Ядра для потоков пула (пусто - без закрепления)
+
+    void grow(int wanted) {
+        if (workers.load(std::memory_order_relaxed) >= wanted) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        while (workers < wanted) {
+            std::thread([this] {
+                if (!cpus.empty()) {
+                    cpu_set_t set;
+                    CPU_ZERO(&set);
+                    for (int cpu : cpus) CPU_SET(cpu, &set);
+                    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+                }
+                worker();
+            }).detach();
+            ++workers;
+        }
+    }
+
+    // Берет часть прохода job (или первого в очереди, если job == nullptr); под mutex
+    static bool claim(std::deque<Job*>& jobs, Job*& job, size_t& part) {
+        if (job == nullptr) {
+            if (jobs.empty()) return false;
+            job = jobs.front();
+        }
+        if (job->next == job->parts) return false;
+        part = job->next++;
+        if (job->next == job->parts) jobs.erase(std::find(jobs.begin(), jobs.end(), job));
+        return true;
+    }
+
+    void run_part(Job* job, size_t part) {
+        size_t begin = part * job->chunk;
+        job->invoke(job->body, begin, std::min(job->count, begin + job->chunk));
+        bool finished;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = ++job->done == job->parts;
+        }
+        if (finished) done_cv.notify_all(); // После unlock job может быть уже уничтожен - его не трогаем
+    }
+
+    void worker() {
+        inside_parallel_for = true;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            Job* job = nullptr;
+            size_t part;
+            work_cv.wait(lock, [&] { return claim(jobs, job, part); });
+            lock.unlock();
+            run_part(job, part);
+            lock.lock();
+        }
+    }
+
+    void run(Job& job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job.next = 1; // Часть 0 - вызывающему потоку
+            jobs.push_back(&job);
+        }
+        for (size_t part = 1; part < job.parts; ++part) work_cv.notify_one();
+        run_part(&job, 0);
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            Job* own = &job;
+            size_t part;
+            if (!claim(jobs, own, part)) break;
+            lock.unlock();
+            run_part(&job, part);
+            lock.lock();
+        }
+        done_cv.wait(lock, [&] { return job.done == job.parts; });
+    }
+
+    // body(begin, end) по [0, count) частями по chunk
+    template <typename Body>
+    void run_chunks(size_t count, size_t chunk, Body& body) {
+        Job job;
+        job.invoke = [](const void* fn, size_t begin, size_t end) {
+            (*static_cast<Body*>(const_cast<void*>(fn)))(begin, end);
+        };
+        job.body = &body;
+        job.count = count;
+        job.chunk = chunk;
+        job.parts = (count + chunk - 1) / chunk;
+        run(job);
+    }
+};
+
+// Пулы создаются при первом использовании. После fork потоков пула в дочернем процессе нет,
+// а его мьютекс мог быть захвачен: ребенок забывает унаследованные копии (разрушить их
+// нельзя - деструктор ждал бы чужие потоки) и создает свой пул, только если он ему нужен
+const int max_numa_nodes = 64;
+std::atomic<ParallelPool*> parallel_pool{nullptr};               // Общий пул parallel_for
+std::atomic<ParallelPool*> node_touch_pools[max_numa_nodes] = {}; // Первое касание на узле
+std::mutex parallel_pool_mutex; // Создание пулов; захвачен на время fork
+
+// Пул из slot; новый пул закрепляет потоки за cpus
+ParallelPool& lazy_parallel_pool(std::atomic<ParallelPool*>& slot, const std::vector<int>& cpus = {}) {
+    ParallelPool* pool = slot.load(std::memory_order_acquire);
+    if (pool != nullptr) return *pool;
+    static const bool fork_handlers = [] {
+        pthread_atfork([] { parallel_pool_mutex.lock(); }, [] { parallel_pool_mutex.unlock(); },
+                       [] {
+                           parallel_pool.store(nullptr, std::memory_order_relaxed);
+                           for (auto& node_pool : node_touch_pools) node_pool.store(nullptr, std::memory_order_relaxed);
+                           parallel_pool_mutex.unlock();
+                       });
+        return true;
+    }();
+    (void)fork_handlers;
+    std::lock_guard<std::mutex> lock(parallel_pool_mutex);
+    pool = slot.load(std::memory_order_relaxed);
+    if (pool == nullptr) {
+        pool = new ParallelPool();
+        pool->cpus = cpus;
+        slot.store(pool, std::memory_order_release);
+    }
+    return *pool;
+}
+
+// Разбиение диапазона [0, count) между потоками: body(begin, end)
+template <typename Body>
+void parallel_for(size_t count, Body&& body, size_t min_chunk = parallel_min_chunk) {
+    size_t threads = inside_parallel_for ? 1 : std::min<size_t>(simulation_threads, count / min_chunk);
+    if (threads <= 1) {
+        body(size_t(0), count);
+        return;
+    }
+    ParallelPool& pool = lazy_parallel_pool(parallel_pool);
+    pool.grow((simulation_threads - 1) * simulation_processors);
+    inside_parallel_for = true;
+    pool.run_chunks(count, (count + threads - 1) / threads, body);
+    inside_parallel_for = false;
+}
+
+// ===================== Пул векторов состояния =====================
+// Задачи идут подряд с близким числом кубитов, и каждая заново выделяла бы 2^n амплитуд:
+// mmap, отказы страниц при первом касании, munmap. Пул хранит освобожденные буферы по
+// классам размера (степени двойки, от 2 МБ - кратно huge page) отдельно для каждого узла
+// NUMA и отдает их следующей задаче на том же узле: страницы уже выделены, остается
+// только обнулить вектор. Новый буфер касается потоками, закрепленными за ядрами узла
+// того потока, который его запросил, - страницы ложатся в память этого узла. Кэш
+// свободных буферов ограничен на каждом узле отдельно: сверх предела освобождаются
+// самые давно не использованные буферы этого узла. По умолчанию предел - 1/8 памяти
+// узла (MemTotal из sysfs), так что на всех узлах вместе кэш не больше 1/8 памяти -
+// запас сверх бюджета задач (3/4 памяти), и кэш не отнимает память у выполняемых векторов.
+
+bool amplitude_pool_enabled = true;
+size_t amplitude_pool_max_bytes = 0; // Предел кэша на узел; 0 - 1/8 памяти узла
+const size_t amplitude_pool_min_bytes = size_t(64) << 10; // Меньшие векторы - обычным aligned_alloc
+
+// Узлы NUMA из /sys: номер узла для каждого ядра и память узла (без sysfs - один узел)
+struct NumaTopology {
+    std::vector<int> node_of_cpu;
+    std::vector<std::vector<int>> cpus_of_node;
+    std::vector<size_t> memory_of_node; // MemTotal узла в байтах
+
+    NumaTopology() {
+        for (int node = 0;; ++node) {
+            std::ifstream list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            if (!list) break;
+            std::string text;
+            std::getline(list, text);
+            std::vector<int> cpus;
+            size_t pos = 0;
+            while (pos < text.size()) {
+                // Диапазоны вида "0-3,8-11"
+                size_t comma = text.find(',', pos);
+                std::string part = text.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+                size_t dash = part.find('-');
+                int first = std::atoi(part.c_str());
+                int last = dash == std::string::npos ? first : std::atoi(part.c_str() + dash + 1);
+                for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+                if (comma == std::string::npos) break;
+                pos = comma + 1;
+            }
+            for (int cpu : cpus) {
+                if (cpu >= static_cast<int>(node_of_cpu.size())) node_of_cpu.resize(cpu + 1, 0);
+                node_of_cpu[cpu] = node;
+            }
+            cpus_of_node.push_back(std::move(cpus));
+            // Строка вида "Node 0 MemTotal:       32768000 kB"
+            std::ifstream meminfo("/sys/devices/system/node/node" + std::to_string(node) + "/meminfo");
+            size_t memory = 0;
+            for (std::string line; std::getline(meminfo, line);) {
+                size_t pos = line.find("MemTotal:");
+                if (pos == std::string::npos) continue;
+                memory = static_cast<size_t>(std::atoll(line.c_str() + pos + 9)) << 10;
+                break;
+            }
+            memory_of_node.push_back(memory);
+        }
+        const size_t host_memory = static_cast<size_t>(double(sysconf(_SC_PHYS_PAGES)) * double(sysconf(_SC_PAGESIZE)));
+        if (cpus_of_node.empty()) {
+            cpus_of_node.emplace_back();
+            for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu) {
+                cpus_of_node.back().push_back(static_cast<int>(cpu));
+            }
+            memory_of_node.push_back(host_memory);
+        }
+        for (size_t& memory : memory_of_node) {
+            if (memory == 0) memory = host_memory / memory_of_node.size();
+        }
+    }
+
+    int current_node() const {
+        int cpu = sched_getcpu();
+        return cpu >= 0 && cpu < static_cast<int>(node_of_cpu.size()) ? node_of_cpu[cpu] : 0;
+    }
+};
+
+const NumaTopology& numa_topology() {
+    static const NumaTopology topology;
+    return topology;
+}
+
+// Обнуление буфера на узле node (первое касание страниц): части берут постоянные потоки,
+// закрепленные за ядрами узла, и сам вызывающий поток, который уже работает на этом узле
+void first_touch_on_node(char* data, size_t bytes, int node) {
+    const std::vector<int>& cpus = numa_topology().cpus_of_node[node];
+    size_t threads = std::min<size_t>({size_t(simulation_threads), cpus.size(), std::max<size_t>(1, bytes / (parallel_min_chunk * 16))});
+    if (threads <= 1 || inside_parallel_for || node >= max_numa_nodes) {
+        std::memset(data, 0, bytes);
+        return;
+    }
+    ParallelPool& pool = lazy_parallel_pool(node_touch_pools[node], cpus);
+    pool.grow(static_cast<int>(threads - 1) * simulation_processors);
+    auto touch = [data](size_t begin, size_t end) { std::memset(data + begin, 0, end - begin); };
+    inside_parallel_for = true;
+    pool.run_chunks(bytes, (bytes / threads + 4095) / 4096 * 4096, touch);
+    inside_parallel_for = false;
+}
+
+struct AmplitudePool {
+    struct Buffer {
+        void* data;
+        size_t bytes; // Класс размера
+        int node;
+    };
+
+    std::mutex mutex;
+    std::vector<Buffer> free_buffers; // Порядок освобождения: в начале - самые старые
+    size_t cached_bytes = 0;
+    std::vector<size_t> cached_on_node; // Кэш по узлам (предел - node_limit)
+    uint64_t hits = 0, misses = 0, evicted = 0;
+
+    static size_t node_limit(int node) {
+        return amplitude_pool_max_bytes > 0 ? amplitude_pool_max_bytes : numa_topology().memory_of_node[node] / 8;
+    }
+
+    static size_t size_class(size_t bytes) {
+        if (bytes >= huge_page_size) return round_to_huge_page(bytes);
+        size_t size = amplitude_pool_min_bytes;
+        while (size < bytes) size *= 2;
+        return size;
+    }
+
+    static void* allocate(size_t bytes) {
+        if (bytes >= huge_page_size) return huge_page_alloc(bytes);
+        void* data = std::aligned_alloc(4096, bytes);
+        if (data == nullptr) throw std::bad_alloc();
+        return data;
+    }
+
+    static void deallocate(void* data, size_t bytes) {
+        if (bytes >= huge_page_size) huge_page_free(data, bytes);
+        else std::free(data);
+    }
+
+    // Буфер не меньше bytes на узле текущего потока; zeroed - уже обнулен (новый буфер),
+    // node - узел, где страницы буфера были впервые затронуты (его и передают в release)
+    void* acquire(size_t bytes, bool& zeroed, int& node) {
+        const size_t size = size_class(bytes);
+        node = numa_topology().current_node();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = free_buffers.size(); i-- > 0;) {
+                if (free_buffers[i].bytes != size || free_buffers[i].node != node) continue;
+                void* data = free_buffers[i].data;
+                free_buffers.erase(free_buffers.begin() + static_cast<long>(i));
+                cached_bytes -= size;
+                cached_on_node[node] -= size;
+                hits++;
+                zeroed = false;
+                return data;
+            }
+            misses++;
+        }
+        void* data = allocate(size);
+        first_touch_on_node(static_cast<char*>(data), size, node);
+        zeroed = true;
+        return data;
+    }
+
+    void release(void* data, size_t bytes, int node) {
+        const size_t size = size_class(bytes);
+        std::vector<Buffer> dropped;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            const size_t limit = node_limit(node);
+            if (size > limit) {
+                dropped.push_back({data, size, node});
+            } else {
+                if (cached_on_node.size() <= size_t(node)) cached_on_node.resize(node + 1, 0);
+                free_buffers.push_back({data, size, node});
+                cached_bytes += size;
+                cached_on_node[node] += size;
+                // Вытесняем самые старые буферы этого узла, пока его кэш не уложится в предел
+                for (size_t i = 0; cached_on_node[node] > limit;) {
+                    if (free_buffers[i].node != node) {
+                        ++i;
+                        continue;
+                    }
+                    cached_bytes -= free_buffers[i].bytes;
+                    cached_on_node[node] -= free_buffers[i].bytes;
+                    dropped.push_back(free_buffers[i]);
+                    free_buffers.erase(free_buffers.begin() + static_cast<long>(i));
+                    evicted++;
+                }
+            }
+        }
+        for (const Buffer& buffer : dropped) deallocate(buffer.data, buffer.bytes); // munmap - вне мьютекса
+    }
+
+    void clear() {
+        std::vector<Buffer> dropped;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            dropped.swap(free_buffers);
+            cached_bytes = 0;
+            std::fill(cached_on_node.begin(), cached_on_node.end(), size_t(0));
+        }
+        for (const Buffer& buffer : dropped) deallocate(buffer.data, buffer.bytes);
+    }
+};
+
+AmplitudePool amplitude_pool;
+
+// Вставка нулевого бита в позицию bit
+inline size_t insert_zero_bit(size_t index, int bit) {
+    size_t low = index & ((size_t(1) << bit) - 1);
+    return ((index >> bit) << (bit + 1)) | low;
+}
+
+template <typename Real>
+struct StateVector {
+    using Amplitude = std::complex<Real>;
+
+    int qubits;
+    size_t size;
+    Amplitude* amplitudes;
+    bool owns_memory = true;
+    bool pooled = false;  // Буфер взят из amplitude_pool
+    int pool_node = 0;    // Узел NUMA первого касания буфера из пула
+
+    // Представление части чужого вектора (блок при блочном выполнении)
+    StateVector(Amplitude* data, int n) : qubits(n), size(size_t(1) << n), amplitudes(data), owns_memory(false) {}
+
+    explicit StateVector(int n) : qubits(n), size(size_t(1) << n) {
+        size_t bytes = std::max<size_t>(size * sizeof(Amplitude), 64);
+        if (amplitude_pool_enabled && bytes >= amplitude_pool_min_bytes) {
+            // Новый буфер пула уже обнулен на узле NUMA этого потока
+            bool zeroed = false;
+            amplitudes = static_cast<Amplitude*>(amplitude_pool.acquire(bytes, zeroed, pool_node));
+            pooled = true;
+            if (zeroed) amplitudes[0] = 1;
+            else reset();
+            return;
+        }
+        amplitudes = static_cast<Amplitude*>(std::aligned_alloc(64, (bytes + 63) / 64 * 64));
+        if (amplitudes == nullptr) throw std::bad_alloc();
+        // Первое касание страниц - теми же потоками, что будут применять вентили
+        reset();
+    }
+
+    // Состояние |0...0>
+    void reset() {
+        parallel_for(size, [this](size_t begin, size_t end) {
+            std::fill(amplitudes + begin, amplitudes + end, Amplitude(0));
+        });
+        amplitudes[0] = 1;
+    }
+
+    ~StateVector() {
+        if (!owns_memory) return;
+        if (pooled) amplitude_pool.release(amplitudes, std::max<size_t>(size * sizeof(Amplitude), 64), pool_node);
+        else std::free(amplitudes);
+    }
+
+    StateVector(const StateVector&) = delete;
+    StateVector& operator=(const StateVector&) = delete;
+};
+
+// Произведение амплитуд без проверок на NaN/inf из std::complex::operator* (__muldc3)
+template <typename A>
+inline A mul(const A& a, const A& b) {
+    return A(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+}
+
+// Однокубитная матрица m (2x2) на кубите q
+template <typename Real>
+void apply_matrix1(StateVector<Real>& state, int q, const std::complex<double>* m) {
+    using A = std::complex<Real>;
+    const A m00(m[0]), m01(m[1]), m10(m[2]), m11(m[3]);
+    A* amp = state.amplitudes;
+    size_t stride = size_t(1) << q;
+    parallel_for(state.size / 2, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            size_t i0 = insert_zero_bit(i, q);
+            A a0 = amp[i0];
+            A a1 = amp[i0 | stride];
+            amp[i0] = mul(m00, a0) + mul(m01, a1);
+            amp[i0 | stride] = mul(m10, a0) + mul(m11, a1);
+        }
+    });
+}
+
+// Диагональный однокубитный вентиль: фазы d0 и d1
+template <typename Real>
+void apply_diagonal1(StateVector<Real>& state, int q, std::complex<double> d0, std::complex<double> d1) {
+    using A = std::complex<Real>;
+    const A p0(d0), p1(d1);
+    A* amp = state.amplitudes;
+    size_t stride = size_t(1) << q;
+    parallel_for(state.size / 2, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            size_t i0 = insert_zero_bit(i, q);
+            amp[i0] = mul(amp[i0], p0);
+            amp[i0 | stride] = mul(amp[i0 | stride], p1);
+        }
+    });
+}
+
+// Двухкубитная матрица m (4x4) на кубитах q0 (младший бит) и q1
+template <typename Real>
+void apply_matrix2(StateVector<Real>& state, int q0, int q1, const std::complex<double>* m) {
+    using A = std::complex<Real>;
+    A mat[16];
+    for (int k = 0; k < 16; ++k) mat[k] = A(m[k]);
+    A* amp = state.amplitudes;
+    size_t s0 = size_t(1) << q0;
+    size_t s1 = size_t(1) << q1;
+    int low = std::min(q0, q1);
+    int high = std::max(q0, q1);
+    parallel_for(state.size / 4, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            size_t base = insert_zero_bit(insert_zero_bit(i, low), high);
+            size_t idx[4] = {base, base | s0, base | s1, base | s0 | s1};
+            A in[4] = {amp[idx[0]], amp[idx[1]], amp[idx[2]], amp[idx[3]]};
+            for (int r = 0; r < 4; ++r) {
+                amp[idx[r]] = mul(mat[r * 4], in[0]) + mul(mat[r * 4 + 1], in[1]) + mul(mat[r * 4 + 2], in[2]) + mul(mat[r * 4 + 3], in[3]);
+            }
+        }
+    });
+}
+
+// Перестановка амплитуд пар (CNOT и SWAP): меняются местами индексы base|from и base|to
+template <typename Real>
+void apply_pair_swap(StateVector<Real>& state, int q0, int q1, size_t from, size_t to) {
+    auto* amp = state.amplitudes;
+    int low = std::min(q0, q1);
+    int high = std::max(q0, q1);
+    parallel_for(state.size / 4, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            size_t base = insert_zero_bit(insert_zero_bit(i, low), high);
+            std::swap(amp[base | from], amp[base | to]);
+        }
+    });
+}
+
+// Матрица на произвольном числе кубитов (общий случай)
+template <typename Real>
+void apply_matrix_k(StateVector<Real>& state, const int* targets, int k, const std::complex<double>* m) {
+    using A = std::complex<Real>;
+    size_t dim = size_t(1) << k;
+    std::vector<A> mat(m, m + dim * dim);
+    std::vector<int> sorted(targets, targets + k);
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<size_t> offsets(dim, 0);
+    for (size_t local = 0; local < dim; ++local) {
+        for (int j = 0; j < k; ++j) {
+            if (local & (size_t(1) << j)) offsets[local] |= size_t(1) << targets[j];
+        }
+    }
+    A* amp = state.amplitudes;
+    parallel_for(state.size >> k, [&](size_t begin, size_t end) {
+        std::vector<A> in(dim);
+        for (size_t i = begin; i < end; ++i) {
+            size_t base = i;
+            for (int bit : sorted) base = insert_zero_bit(base, bit);
+            for (size_t l = 0; l < dim; ++l) in[l] = amp[base | offsets[l]];
+            for (size_t r = 0; r < dim; ++r) {
+                A sum = 0;
+                for (size_t c = 0; c < dim; ++c) sum += mul(mat[r * dim + c], in[c]);
+                amp[base | offsets[r]] = sum;
+            }
+        }
+    });
+}
+
+// ===================== Векторные ядра (AVX2 / AVX-512) =====================
+// Для амплитуд complex<double> часто встречающиеся вентили применяются векторными
+// ядрами: AVX2 обрабатывает 2 амплитуды за раз, AVX-512 - 4. Набор инструкций
+// выбирается при запуске по возможностям процессора. Ядру нужно, чтобы соседние
+// амплитуды попадали в один вектор, поэтому кубиты вентиля должны быть не младше
+// log2(ширины вектора); иначе (и для complex<float>) используется скалярный код.
+
+enum class SimdLevel { Scalar, AVX2, AVX512 };
+
+SimdLevel detect_simd_level() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")) return SimdLevel::AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return SimdLevel::AVX2;
+    return SimdLevel::Scalar;
+}
+
+SimdLevel simd_level = detect_simd_level();
+
+const char* simd_level_name(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::AVX512: return "AVX-512";
+    case SimdLevel::AVX2: return "AVX2";
+    default: return "scalar";
+    }
+}
+
+// --- AVX2: вектор = 2 амплитуды [re0, im0, re1, im1] ---
+
+// Умножение комплексного числа (mre, mim) на вектор амплитуд
+__attribute__((target("avx2,fma")))
+inline __m256d cmul_avx2(__m256d mre, __m256d mim, __m256d a) {
+    __m256d swapped = _mm256_permute_pd(a, 0x5);
+    return _mm256_fmaddsub_pd(mre, a, _mm256_mul_pd(mim, swapped));
+}
+
+__attribute__((target("avx2,fma")))
+void matrix1_avx2(double* d, int q, const std::complex<double>* m, size_t begin, size_t end) {
+    __m256d re[4], im[4];
+    for (int k = 0; k < 4; ++k) {
+        re[k] = _mm256_set1_pd(m[k].real());
+        im[k] = _mm256_set1_pd(m[k].imag());
+    }
+    size_t stride = size_t(1) << q;
+    for (size_t g = begin; g < end; ++g) {
+        size_t i0 = insert_zero_bit(g * 2, q);
+        __m256d a0 = _mm256_load_pd(d + 2 * i0);
+        __m256d a1 = _mm256_load_pd(d + 2 * (i0 + stride));
+        _mm256_store_pd(d + 2 * i0, _mm256_add_pd(cmul_avx2(re[0], im[0], a0), cmul_avx2(re[1], im[1], a1)));
+        _mm256_store_pd(d + 2 * (i0 + stride), _mm256_add_pd(cmul_avx2(re[2], im[2], a0), cmul_avx2(re[3], im[3], a1)));
+    }
+}
+
+__attribute__((target("avx2,fma")))
+void hadamard_avx2(double* d, int q, size_t begin, size_t end) {
+    const __m256d r = _mm256_set1_pd(1.0 / std::sqrt(2.0));
+    size_t stride = size_t(1) << q;
+    for (size_t g = begin; g < end; ++g) {
+        size_t i0 = insert_zero_bit(g * 2, q);
+        __m256d a0 = _mm256_load_pd(d + 2 * i0);
+        __m256d a1 = _mm256_load_pd(d + 2 * (i0 + stride));
+        _mm256_store_pd(d + 2 * i0, _mm256_mul_pd(r, _mm256_add_pd(a0, a1)));
+        _mm256_store_pd(d + 2 * (i0 + stride), _mm256_mul_pd(r, _mm256_sub_pd(a0, a1)));
+    }
+}
+
+__attribute__((target("avx2,fma")))
+void diagonal1_avx2(double* d, int q, std::complex<double> p0, std::complex<double> p1, size_t begin, size_t end) {
+    const __m256d re0 = _mm256_set1_pd(p0.real()), im0 = _mm256_set1_pd(p0.imag());
+    const __m256d re1 = _mm256_set1_pd(p1.real()), im1 = _mm256_set1_pd(p1.imag());
+    size_t stride = size_t(1) << q;
+    for (size_t g = begin; g < end; ++g) {
+        size_t i0 = insert_zero_bit(g * 2, q);
+        _mm256_store_pd(d + 2 * i0, cmul_avx2(re0, im0, _mm256_load_pd(d + 2 * i0)));
+        _mm256_store_pd(d + 2 * (i0 + stride), cmul_avx2(re1, im1, _mm256_load_pd(d + 2 * (i0 + stride))));
+    }
+}
+
+// Обмен амплитуд base|from и base|to (X: один кубит, CNOT и SWAP: два)
+__attribute__((target("avx2,fma")))
+void pair_swap_avx2(double* d, int low, int high, size_t from, size_t to, size_t begin, size_t end) {
+    for (size_t g = begin; g < end; ++g) {
+        size_t base = high < 0 ? insert_zero_bit(g * 2, low) : insert_zero_bit(insert_zero_bit(g * 2, low), high);
+        __m256d a = _mm256_load_pd(d + 2 * (base | from));
+        __m256d b = _mm256_load_pd(d + 2 * (base | to));
+        _mm256_store_pd(d + 2 * (base | from), b);
+        _mm256_store_pd(d + 2 * (base | to), a);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+void matrix2_avx2(double* d, int q0, int q1, const std::complex<double>* m, size_t begin, size_t end) {
+    __m256d re[16], im[16];
+    for (int k = 0; k < 16; ++k) {
+        re[k] = _mm256_set1_pd(m[k].real());
+        im[k] = _mm256_set1_pd(m[k].imag());
+    }
+    size_t s0 = size_t(1) << q0, s1 = size_t(1) << q1;
+    int low = std::min(q0, q1), high = std::max(q0, q1);
+    for (size_t g = begin; g < end; ++g) {
+        size_t base = insert_zero_bit(insert_zero_bit(g * 2, low), high);
+        size_t idx[4] = {base, base | s0, base | s1, base | s0 | s1};
+        __m256d in[4];
+        for (int c = 0; c < 4; ++c) in[c] = _mm256_load_pd(d + 2 * idx[c]);
+        for (int r = 0; r < 4; ++r) {
+            __m256d sum = cmul_avx2(re[r * 4], im[r * 4], in[0]);
+            for (int c = 1; c < 4; ++c) sum = _mm256_add_pd(sum, cmul_avx2(re[r * 4 + c], im[r * 4 + c], in[c]));
+            _mm256_store_pd(d + 2 * idx[r], sum);
+        }
+    }
+}
+
+// Плотная матрица на k кубитах (слитые вентили): элементы матрицы - отдельно re и im
+__attribute__((target("avx2,fma")))
+void matrix_k_avx2(double* d, const int* sorted, int k, const size_t* offsets, const double* mre,
+                   const double* mim, size_t begin, size_t end) {
+    size_t dim = size_t(1) << k;
+    __m256d in[1 << max_gate_qubits], swapped[1 << max_gate_qubits];
+    for (size_t g = begin; g < end; ++g) {
+        size_t base = g * 2;
+        for (int j = 0; j < k; ++j) base = insert_zero_bit(base, sorted[j]);
+        for (size_t c = 0; c < dim; ++c) {
+            in[c] = _mm256_load_pd(d + 2 * (base | offsets[c]));
+            swapped[c] = _mm256_permute_pd(in[c], 0x5);
+        }
+        for (size_t r = 0; r < dim; ++r) {
+            // Действительные и мнимые части матрицы копятся отдельно, знаки - одним fmaddsub
+            __m256d acc_re = _mm256_setzero_pd(), acc_im = _mm256_setzero_pd();
+            for (size_t c = 0; c < dim; ++c) {
+                acc_re = _mm256_fmadd_pd(_mm256_broadcast_sd(mre + r * dim + c), in[c], acc_re);
+                acc_im = _mm256_fmadd_pd(_mm256_broadcast_sd(mim + r * dim + c), swapped[c], acc_im);
+            }
+            _mm256_store_pd(d + 2 * (base | offsets[r]), _mm256_fmaddsub_pd(_mm256_set1_pd(1.0), acc_re, acc_im));
+        }
+    }
+}
+
+// --- AVX-512: вектор = 4 амплитуды ---
+
+__attribute__((target("avx512f,avx512dq")))
+inline __m512d cmul_avx512(__m512d mre, __m512d mim, __m512d a) {
+    __m512d swapped = _mm512_shuffle_pd(a, a, 0x55);
+    return _mm512_fmaddsub_pd(mre, a, _mm512_mul_pd(mim, swapped));
+}
+
+__attribute__((target("avx512f,avx512dq")))
+void matrix1_avx512(double* d, int q, const std::complex<double>* m, size_t begin, size_t end) {
+    __m512d re[4], im[4];
+    for (int k = 0; k < 4; ++k) {
+        re[k] = _mm512_set1_pd(m[k].real());
+        im[k] = _mm512_set1_pd(m[k].imag());
+    }
+    size_t stride = size_t(1) << q;
+    for (size_t g = begin; g < end; ++g) {
+        size_t i0 = insert_zero_bit(g * 4, q);
+        __m512d a0 = _mm512_load_pd(d + 2 * i0);
+        __m512d a1 = _mm512_load_pd(d + 2 * (i0 + stride));
+        _mm512_store_pd(d + 2 * i0, _mm512_add_pd(cmul_avx512(re[0], im[0], a0), cmul_avx512(re[1], im[1], a1)));
+        _mm512_store_pd(d + 2 * (i0 + stride), _mm512_add_pd(cmul_avx512(re[2], im[2], a0), cmul_avx512(re[3], im[3], a1)));
+    }
+}
+
+__attribute__((target("avx512f,avx512dq")))
+void hadamard_avx512(double* d, int q, size_t begin, size_t end) {
+    const __m512d r = _mm512_set1_pd(1.0 / std::sqrt(2.0));
+    size_t stride = size_t(1) << q;
+    for (size_t g = begin; g < end; ++g) {
+        size_t i0 = insert_zero_bit(g * 4, q);
+        __m512d a0 = _mm512_load_pd(d + 2 * i0);
+        __m512d a1 = _mm512_load_pd(d + 2 * (i0 + stride));
+        _mm512_store_pd(d + 2 * i0, _mm512_mul_pd(r, _mm512_add_pd(a0, a1)));
+        _mm512_store_pd(d + 2 * (i0 + stride), _mm512_mul_pd(r, _mm512_sub_pd(a0, a1)));
+    }
+}
+
+__attribute__((target("avx512f,avx512dq")))
+void diagonal1_avx512(double* d, int q, std::complex<double> p0, std::complex<double> p1, size_t begin, size_t end) {
+    const __m512d re0 = _mm512_set1_pd(p0.real()), im0 = _mm512_set1_pd(p0.imag());
+    const __m512d re1 = _mm512_set1_pd(p1.real()), im1 = _mm512_set1_pd(p1.imag());
+    size_t stride = size_t(1) << q;
+    for (size_t g = begin; g < end; ++g) {
+        size_t i0 = insert_zero_bit(g * 4, q);
+        _mm512_store_pd(d + 2 * i0, cmul_avx512(re0, im0, _mm512_load_pd(d + 2 * i0)));
+        _mm512_store_pd(d + 2 * (i0 + stride), cmul_avx512(re1, im1, _mm512_load_pd(d + 2 * (i0 + stride))));
+    }
+}
+
+__attribute__((target("avx512f,avx512dq")))
+void pair_swap_avx512(double* d, int low, int high, size_t from, size_t to, size_t begin, size_t end) {
+    for (size_t g = begin; g < end; ++g) {
+        size_t base = high < 0 ? insert_zero_bit(g * 4, low) : insert_zero_bit(insert_zero_bit(g * 4, low), high);
+        __m512d a = _mm512_load_pd(d + 2 * (base | from));
+        __m512d b = _mm512_load_pd(d + 2 * (base | to));
+        _mm512_store_pd(d + 2 * (base | from), b);
+        _mm512_store_pd(d + 2 * (base | to), a);
+    }
+}
+
+__attribute__((target("avx512f,avx512dq")))
+void matrix2_avx512(double* d, int q0, int q1, const std::complex<double>* m, size_t begin, size_t end) {
+    __m512d re[16], im[16];
+    for (int k = 0; k < 16; ++k) {
+        re[k] = _mm512_set1_pd(m[k].real());
+        im[k] = _mm512_set1_pd(m[k].imag());
+    }
+    size_t s0 = size_t(1) << q0, s1 = size_t(1) << q1;
+    int low = std::min(q0, q1), high = std::max(q0, q1);
+    for (size_t g = begin; g < end; ++g) {
+        size_t base = insert_zero_bit(insert_zero_bit(g * 4, low), high);
+        size_t idx[4] = {base, base | s0, base | s1, base | s0 | s1};
+        __m512d in[4];
+        for (int c = 0; c < 4; ++c) in[c] = _mm512_load_pd(d + 2 * idx[c]);
+        for (int r = 0; r < 4; ++r) {
+            __m512d sum = cmul_avx512(re[r * 4], im[r * 4], in[0]);
+            for (int c = 1; c < 4; ++c) sum = _mm512_add_pd(sum, cmul_avx512(re[r * 4 + c], im[r * 4 + c], in[c]));
+            _mm512_store_pd(d + 2 * idx[r], sum);
+        }
+    }
+}
+
+__attribute__((target("avx512f,avx512dq")))
+void matrix_k_avx512(double* d, const int* sorted, int k, const size_t* offsets, const double* mre,
+                     const double* mim, size_t begin, size_t end) {
+    size_t dim = size_t(1) << k;
+    __m512d in[1 << max_gate_qubits], swapped[1 << max_gate_qubits];
+    for (size_t g = begin; g < end; ++g) {
+        size_t base = g * 4;
+        for (int j = 0; j < k; ++j) base = insert_zero_bit(base, sorted[j]);
+        for (size_t c = 0; c < dim; ++c) {
+            in[c] = _mm512_load_pd(d + 2 * (base | offsets[c]));
+            swapped[c] = _mm512_shuffle_pd(in[c], in[c], 0x55);
+        }
+        for (size_t r = 0; r < dim; ++r) {
+            __m512d acc_re = _mm512_setzero_pd(), acc_im = _mm512_setzero_pd();
+            for (size_t c = 0; c < dim; ++c) {
+                acc_re = _mm512_fmadd_pd(_mm512_set1_pd(mre[r * dim + c]), in[c], acc_re);
+                acc_im = _mm512_fmadd_pd(_mm512_set1_pd(mim[r * dim + c]), swapped[c], acc_im);
+            }
+            _mm512_store_pd(d + 2 * (base | offsets[r]), _mm512_fmaddsub_pd(_mm512_set1_pd(1.0), acc_re, acc_im));
+        }
+    }
+}
+
+// k-кубитная матрица векторным ядром (все кубиты должны быть не младше ширины вектора)
+void apply_matrix_k_simd(double* d, size_t size, const int* targets, int k, const std::complex<double>* m) {
+    size_t dim = size_t(1) << k;
+    std::vector<int> sorted(targets, targets + k);
+    std::sort(sorted.begin(), sorted.end());
+    size_t offsets[1 << max_gate_qubits] = {};
+    for (size_t local = 0; local < dim; ++local) {
+        for (int j = 0; j < k; ++j) {
+            if (local & (size_t(1) << j)) offsets[local] |= size_t(1) << targets[j];
+        }
+    }
+    std::vector<double> mre(dim * dim), mim(dim * dim);
+    for (size_t i = 0; i < dim * dim; ++i) {
+        mre[i] = m[i].real();
+        mim[i] = m[i].imag();
+    }
+    const bool avx512 = simd_level == SimdLevel::AVX512;
+    size_t groups = size >> (k + (avx512 ? 2 : 1));
+    parallel_for(groups, [&](size_t b, size_t e) {
+        avx512 ? matrix_k_avx512(d, sorted.data(), k, offsets, mre.data(), mim.data(), b, e)
+               : matrix_k_avx2(d, sorted.data(), k, offsets, mre.data(), mim.data(), b, e);
+    });
+}
+
+// Применение вентиля векторным ядром; false - вентиль не подходит, нужен скалярный код
+bool apply_gate_simd(StateVector<double>& state, const Gate& gate, const Circuit& circuit) {
+    if (simd_level == SimdLevel::Scalar) return false;
+    const int width_bits = simd_level == SimdLevel::AVX512 ? 2 : 1; // log2(амплитуд в векторе)
+    const bool avx512 = simd_level == SimdLevel::AVX512;
+    int q0 = gate.qubits[0];
+    int q1 = gate.arity > 1 ? gate.qubits[1] : -1;
+    int low = *std::min_element(gate.qubits, gate.qubits + gate.arity);
+    int high = gate.arity > 1 ? std::max(q0, q1) : -1;
+    if (low < width_bits || state.qubits < gate.arity + width_bits) return false;
+
+    double* d = reinterpret_cast<double*>(state.amplitudes);
+    if (gate.arity > 2) {
+        int targets[max_gate_qubits];
+        std::copy(gate.qubits, gate.qubits + gate.arity, targets);
+        std::vector<std::complex<double>> big(size_t(1) << (2 * gate.arity));
+        gate_matrix(gate, circuit, big.data());
+        apply_matrix_k_simd(d, state.size, targets, gate.arity, big.data());
+        return true;
+    }
+    size_t groups = state.size >> (gate.arity + width_bits);
+    std::complex<double> m[16];
+
+    switch (gate.type) {
+    case GateType::H:
+        parallel_for(groups, [&](size_t b, size_t e) {
+            avx512 ? hadamard_avx512(d, q0, b, e) : hadamard_avx2(d, q0, b, e);
+        });
+        return true;
+    case GateType::X:
+        parallel_for(groups, [&](size_t b, size_t e) {
+            avx512 ? pair_swap_avx512(d, q0, -1, 0, size_t(1) << q0, b, e)
+                   : pair_swap_avx2(d, q0, -1, 0, size_t(1) << q0, b, e);
+        });
+        return true;
+    case GateType::Z:
+    case GateType::S:
+    case GateType::T:
+    case GateType::RZ:
+        gate_matrix(gate, circuit, m);
+        parallel_for(groups, [&](size_t b, size_t e) {
+            avx512 ? diagonal1_avx512(d, q0, m[0], m[3], b, e) : diagonal1_avx2(d, q0, m[0], m[3], b, e);
+        });
+        return true;
+    case GateType::CNOT:
+    case GateType::SWAP: {
+        size_t from = size_t(1) << q0;
+        size_t to = gate.type == GateType::CNOT ? from | (size_t(1) << q1) : size_t(1) << q1;
+        parallel_for(groups, [&](size_t b, size_t e) {
+            avx512 ? pair_swap_avx512(d, low, high, from, to, b, e) : pair_swap_avx2(d, low, high, from, to, b, e);
+        });
+        return true;
+    }
+    default:
+        gate_matrix(gate, circuit, m);
+        if (gate.arity == 1) {
+            parallel_for(groups, [&](size_t b, size_t e) {
+                avx512 ? matrix1_avx512(d, q0, m, b, e) : matrix1_avx2(d, q0, m, b, e);
+            });
+        } else {
+            parallel_for(groups, [&](size_t b, size_t e) {
+                avx512 ? matrix2_avx512(d, q0, q1, m, b, e) : matrix2_avx2(d, q0, q1, m, b, e);
+            });
+        }
+        return true;
+    }
+}
+
+// Применение одного вентиля
+template <typename Real>
+void apply_gate(StateVector<Real>& state, const Gate& gate, const Circuit& circuit) {
+    if constexpr (std::is_same_v<Real, double>) {
+        if (apply_gate_simd(state, gate, circuit)) return;
+    }
+    int q0 = gate.qubits[0];
+    int q1 = gate.arity > 1 ? gate.qubits[1] : -1;
+    std::complex<double> m[16];
+    switch (gate.type) {
+    case GateType::Z:
+    case GateType::S:
+    case GateType::T:
+    case GateType::RZ:
+        gate_matrix(gate, circuit, m);
+        apply_diagonal1(state, q0, m[0], m[3]);
+        break;
+    case GateType::CNOT:
+        apply_pair_swap(state, q0, q1, size_t(1) << q0, (size_t(1) << q0) | (size_t(1) << q1));
+        break;
+    case GateType::SWAP:
+        apply_pair_swap(state, q0, q1, size_t(1) << q0, size_t(1) << q1);
+        break;
+    case GateType::CZ:
+    case GateType::Matrix:
+        if (gate.arity > 2) {
+            int targets[max_gate_qubits];
+            std::copy(gate.qubits, gate.qubits + gate.arity, targets);
+            std::vector<std::complex<double>> big(size_t(1) << (2 * gate.arity));
+            gate_matrix(gate, circuit, big.data());
+            apply_matrix_k(state, targets, gate.arity, big.data());
+            break;
+        }
+        gate_matrix(gate, circuit, m);
+        if (gate.arity == 1) {
+            apply_matrix1(state, q0, m);
+        } else {
+            apply_matrix2(state, q0, q1, m);
+        }
+        break;
+    default:
+        gate_matrix(gate, circuit, m);
+        apply_matrix1(state, q0, m);
+        break;
+    }
+}
+
+template <typename Real>
+void run_circuit(StateVector<Real>& state, const Circuit& circuit) {
+    for (const Gate& gate : circuit.gates) {
+        apply_gate(state, gate, circuit);
+    }
+}
+
+// ===================== Блочное выполнение =====================
+// При большом числе кубитов вектор не помещается в кэш, и каждый вентиль читает его
+// из памяти заново. Младшие cache_block_qubits кубитов считаются локальными: серия
+// вентилей только на них применяется блок за блоком (2^cache_block_qubits амплитуд
+// подряд), пока блок лежит в кэше. Когда вентилю нужен старший кубит, старшие кубиты
+// с ближайшим использованием меняются местами с локальными, чье использование дальше
+// (правило Белади), - все пары одним проходом. Перестановка снимается в конце схемы.
+// Тот же план делит вектор между процессами (distributed): там старшие кубиты - номер
+// процесса, и в локальные переводится каждый вентиль, который перемешивает амплитуды по
+// старшему кубиту; вентили, диагональные по старшим кубитам, остаются глобальными.
+
+int cache_block_qubits = 16; // 2^16 амплитуд complex<double> = 1 МБ (0 - выключено)
+
+enum class RunKind { Local, Global, Swap };
+
+struct BlockedRun {
+    RunKind kind;
+    size_t begin = 0, end = 0;               // Диапазон вентилей плана (Local, Global)
+    std::vector<std::pair<int, int>> swaps;  // Непересекающиеся пары физических кубитов (Swap)
+};
+
+struct BlockedPlan {
+    Circuit physical;  // Вентили с физическими номерами кубитов в порядке выполнения
+    std::vector<BlockedRun> runs;
+    int local_qubits = 0;
+    int swaps = 0;     // Переставленных пар кубитов
+};
+
+const int distributed_pipeline_bits = 2; // Старшие локальные кубиты, по которым обмен делится на части
+
+// Не перемешивает ли вентиль амплитуды с разными значениями своего кубита j
+// (диагональный по нему или управляющий)
+bool gate_diagonal_on(const Gate& gate, const Circuit& circuit, int j) {
+    switch (gate.type) {
+    case GateType::Z: case GateType::S: case GateType::T: case GateType::RZ: case GateType::CZ:
+        return true;
+    case GateType::CNOT:
+        return j == 0;
+    case GateType::Matrix: {
+        size_t dim = size_t(1) << gate.arity;
+        const std::complex<double>* m = circuit.matrices.data() + gate.matrix;
+        for (size_t r = 0; r < dim; ++r) {
+            for (size_t c = 0; c < dim; ++c) {
+                if (((r ^ c) >> j) & 1 && m[r * dim + c] != 0.0) return false;
+            }
+        }
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+BlockedPlan plan_blocked(const Circuit& circuit, int local_qubits, bool distributed = false) {
+    int n = circuit.qubits;
+    BlockedPlan plan;
+    plan.local_qubits = std::min(local_qubits, n);
+    plan.physical.qubits = n;
+    plan.physical.matrices = circuit.matrices;
+    const int L = plan.local_qubits;
+
+    // Позиции использования каждого логического кубита
+    std::vector<std::vector<size_t>> uses(n);
+    for (size_t i = 0; i < circuit.gates.size(); ++i) {
+        const Gate& gate = circuit.gates[i];
+        for (int j = 0; j < gate.arity; ++j) uses[gate.qubits[j]].push_back(i);
+    }
+    auto use_from = [&](int logical, size_t from) {
+        auto it = std::lower_bound(uses[logical].begin(), uses[logical].end(), from);
+        return it == uses[logical].end() ? SIZE_MAX : *it;
+    };
+
+    std::vector<int> where(n), who(n); // логический -> физический и обратно
+    for (int q = 0; q < n; ++q) where[q] = who[q] = q;
+
+    auto append = [&](const Gate& gate) {
+        bool local = true;
+        for (int j = 0; j < gate.arity; ++j) local = local && gate.qubits[j] < L;
+        RunKind kind = local ? RunKind::Local : RunKind::Global;
+        size_t index = plan.physical.gates.size();
+        plan.physical.gates.push_back(gate);
+        if (plan.runs.empty() || plan.runs.back().kind != kind) {
+            plan.runs.push_back({kind, index, index + 1, {}});
+        } else {
+            plan.runs.back().end = index + 1;
+        }
+    };
+    auto swap_pass = [&](const std::vector<std::pair<int, int>>& pairs) {
+        for (auto [a, b] : pairs) {
+            std::swap(who[a], who[b]);
+            where[who[a]] = a;
+            where[who[b]] = b;
+        }
+        plan.swaps += static_cast<int>(pairs.size());
+        plan.runs.push_back({RunKind::Swap, 0, 0, pairs});
+    };
+
+    // Меняются только старшие локальные кубиты: тогда перестановка копирует отрезки
+    // не короче 2^(L/2) амплитуд, а не отдельные строки кэша
+    const int lowest = L / 2;
+    for (size_t i = 0; i < circuit.gates.size(); ++i) {
+        Gate gate = circuit.gates[i];
+        bool remap = false;
+        for (int j = 0; j < gate.arity; ++j) {
+            if (where[gate.qubits[j]] < L) continue;
+            remap = remap || (distributed ? !gate_diagonal_on(gate, circuit, j) : use_from(gate.qubits[j], i + 1) != SIZE_MAX);
+        }
+        if (remap) {
+            std::vector<std::pair<size_t, int>> incoming, victims; // (следующее использование, физический)
+            for (int p = L; p < n; ++p) {
+                size_t use = use_from(who[p], i);
+                if (use != SIZE_MAX) incoming.push_back({use, p});
+            }
+            // Старшие локальные кубиты распределенного вектора не уходят: по ним обмен делится на части
+            int highest = distributed ? L - distributed_pipeline_bits : L;
+            for (int p = lowest; p < highest; ++p) victims.push_back({use_from(who[p], i), p});
+            std::sort(incoming.begin(), incoming.end());
+            std::sort(victims.begin(), victims.end(), std::greater<>());
+            std::vector<std::pair<int, int>> pairs;
+            for (size_t k = 0; k < std::min(incoming.size(), victims.size()); ++k) {
+                if (incoming[k].first >= victims[k].first) break;
+                pairs.push_back({victims[k].second, incoming[k].second});
+            }
+            if (!pairs.empty()) swap_pass(pairs);
+        }
+        for (int j = 0; j < gate.arity; ++j) gate.qubits[j] = static_cast<uint16_t>(where[gate.qubits[j]]);
+        append(gate);
+    }
+    // Возвращаем кубиты на свои места: за проход - непересекающиеся пары
+    while (true) {
+        std::vector<std::pair<int, int>> pairs;
+        std::vector<bool> used(n, false);
+        for (int q = 0; q < n; ++q) {
+            int p = where[q];
+            if (p == q || used[p] || used[q]) continue;
+            used[p] = used[q] = true;
+            pairs.push_back({q, p});
+        }
+        if (pairs.empty()) break;
+        swap_pass(pairs);
+    }
+    return plan;
+}
+
+// Перестановка битов индекса по непересекающимся парам кубитов - один проход по вектору.
+// Биты ниже младшего переставляемого не меняются, поэтому обмен идет отрезками.
+template <typename Real>
+void apply_qubit_swaps(StateVector<Real>& state, const std::vector<std::pair<int, int>>& pairs) {
+    auto* amp = state.amplitudes;
+    int low = state.qubits;
+    for (auto [a, b] : pairs) low = std::min({low, a, b});
+    size_t run = size_t(1) << low;
+    parallel_for(state.size >> low, [&](size_t begin, size_t end) {
+        for (size_t chunk = begin; chunk < end; ++chunk) {
+            size_t i = chunk << low;
+            size_t j = i;
+            for (auto [a, b] : pairs) {
+                if (((i >> a) ^ (i >> b)) & 1) j ^= (size_t(1) << a) | (size_t(1) << b);
+            }
+            if (j > i) std::swap_ranges(amp + i, amp + i + run, amp + j); // Каждая пара обменивается один раз
+        }
+    }, std::max<size_t>(1, parallel_min_chunk >> low));
+}
+
+template <typename Real>
+void run_blocked(StateVector<Real>& state, const BlockedPlan& plan) {
+    size_t blocks = state.size >> plan.local_qubits;
+    for (const BlockedRun& run : plan.runs) {
+        if (run.kind == RunKind::Swap) {
+            apply_qubit_swaps(state, run.swaps);
+        } else if (run.kind == RunKind::Global || blocks == 1) {
+            for (size_t g = run.begin; g < run.end; ++g) apply_gate(state, plan.physical.gates[g], plan.physical);
+        } else {
+            parallel_for(blocks, [&](size_t begin, size_t end) {
+                for (size_t b = begin; b < end; ++b) {
+                    StateVector<Real> block(state.amplitudes + (b << plan.local_qubits), plan.local_qubits);
+                    for (size_t g = run.begin; g < run.end; ++g) apply_gate(block, plan.physical.gates[g], plan.physical);
+                }
+            }, 1);
+        }
+    }
+}
+
+// Выполнение схемы с учетом слияния вентилей и блочного режима
+template <typename Real>
+void execute_circuit(StateVector<Real>& state, const Circuit& circuit) {
+    Circuit fused;
+    const Circuit* source = &circuit;
+    if (fusion_max_qubits > 1) {
+        fused = fuse_circuit(circuit, fusion_max_qubits);
+        source = &fused;
+    }
+    if (cache_block_qubits > 0 && state.qubits > cache_block_qubits) {
+        run_blocked(state, plan_blocked(*source, cache_block_qubits));
+    } else {
+        run_circuit(state, *source);
+    }
+}
+
+// Итог выполнения схемы
+struct SimulationResult {
+    double seconds = 0;
+    double norm = 0;          // Должна быть равна 1 (контроль точности)
+    double probability_zero = 0; // Вероятность |0...0>
+};
+
+// Норма и P(0) конечного состояния; probabilities - если задан, туда пишется распределение исходов
+template <typename Real>
+void summarize_state(const StateVector<Real>& state, SimulationResult& result, std::vector<double>* probabilities) {
+    if (probabilities) {
+        probabilities->resize(state.size);
+        parallel_for(state.size, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) (*probabilities)[i] = std::norm(state.amplitudes[i]);
+        });
+    }
+    for (size_t i = 0; i < state.size; ++i) {
+        result.norm += std::norm(state.amplitudes[i]);
+    }
+    result.probability_zero = std::norm(state.amplitudes[0]);
+}
+
+template <typename Real>
+SimulationResult simulate_circuit(const Circuit& circuit, std::vector<double>* probabilities) {
+    auto start = std::chrono::steady_clock::now();
+    StateVector<Real> state(circuit.qubits);
+    execute_circuit(state, circuit);
+    SimulationResult result;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    summarize_state(state, result, probabilities);
+    return result;
+}
+
+SimulationResult simulate_circuit(const Circuit& circuit, Precision precision,
+                                  std::vector<double>* probabilities = nullptr) {
+    return precision == Precision::Float ? simulate_circuit<float>(circuit, probabilities)
+                                         : simulate_circuit<double>(circuit, probabilities);
+}
+
+// ===================== Модель стоимости =====================
+// Время схемы оценивается по тем проходам, которые сделает execute_circuit: схема
+// сливается, векторы больше cache_block_qubits выполняются блоками. Признаки -
+// вычислительная работа (амплитуды x вес ядра вентиля) и трафик памяти (полные
+// проходы по вектору в байтах), оба на поток, и число вентилей исходной схемы
+// (слияние стоит единицы микросекунд на вентиль и решает для малых схем).
+// Коэффициенты начинаются с замеров bench-gates для найденного набора инструкций и
+// уточняются взвешенным методом наименьших квадратов (относительная ошибка) по
+// фактическому времени задач, старые замеры постепенно забываются.
+
+// Амплитуд в миллисекунду на ядро для однокубитного вентиля (bench-gates, 20 кубитов)
+double default_amplitudes_per_ms(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::AVX512: return 1.25e6;
+    case SimdLevel::AVX2: return 1.0e6;
+    default: return 2.7e5;
+    }
+}
+
+const double default_bytes_per_ms = 1e7; // ~10 ГБ/с на поток
+const double default_ms_per_gate = 2.5e-3; // Слияние, 4 кубита
+const double float_compute_factor = 2.7;   // complex<float> идет скалярными ядрами
+const double cost_model_decay = 0.95;    // Вес предыдущих замеров при каждом новом
+const double cost_model_prior = 1.0;     // Вес начальных коэффициентов (в замерах)
+
+// Вес вентиля относительно однокубитного плотного прохода
+double gate_cost_weight(const Gate& gate) {
+    switch (gate.type) {
+    case GateType::CNOT:
+    case GateType::SWAP: return 0.5; // Меняются местами только половина амплитуд
+    case GateType::CZ: return 2.5;
+    case GateType::Matrix:
+        if (gate.arity == 1) return 1.0;
+        return 1.25 * double(size_t(1) << (gate.arity - 1)); // 4x4 - в 2.5 раза дольше 2x2
+    default: return 1.0;
+    }
+}
+
+CostFeatures circuit_cost_features(const Circuit& circuit, Precision precision, int fusion_qubits = fusion_max_qubits) {
+    Circuit fused;
+    const Circuit* source = &circuit;
+    if (fusion_qubits > 1) {
+        fused = fuse_circuit(circuit, fusion_qubits);
+        source = &fused;
+    }
+    double amplitudes = std::ldexp(1.0, circuit.qubits);
+    double bytes = amplitudes * double(precision == Precision::Float ? sizeof(std::complex<float>) : sizeof(std::complex<double>));
+    CostFeatures cost;
+    for (const Gate& gate : source->gates) cost.compute += gate_cost_weight(gate) * amplitudes;
+    // Векторные ядра есть только для double
+    if (precision == Precision::Float && simd_level != SimdLevel::Scalar) cost.compute *= float_compute_factor;
+    cost.memory = 2 * bytes; // Первое касание и итоговый проход по вероятностям
+    if (cache_block_qubits > 0 && circuit.qubits > cache_block_qubits) {
+        BlockedPlan plan = plan_blocked(*source, cache_block_qubits);
+        for (const BlockedRun& run : plan.runs) {
+            double passes = run.kind == RunKind::Global ? double(run.end - run.begin) : 1.0;
+            cost.memory += 2 * bytes * passes; // Чтение и запись
+        }
+    }
+    double threads = std::clamp(amplitudes / double(parallel_min_chunk), 1.0, double(simulation_threads));
+    cost.compute /= threads;
+    cost.memory /= threads;
+    cost.gates = fusion_qubits > 1 ? double(circuit.gates.size()) : 0;
+    return cost;
+}
+
+const int cost_features = 3;
+
+struct CostModel {
+    // Коэффициенты при compute, memory, gates (мс на единицу признака)
+    double coef[cost_features] = {1.0 / default_amplitudes_per_ms(simd_level), 1.0 / default_bytes_per_ms,
+                                  default_ms_per_gate};
+    // Нормальные уравнения по замерам: sum w*x*x', sum w*x*t с весом w = 1/t^2
+    double xx[cost_features][cost_features] = {};
+    double xt[cost_features] = {};
+    int samples = 0;
+};
+
+CostModel cost_model;
+std::mutex cost_mutex;
+
+double estimate_cost_ms(const CostFeatures& cost) {
+    std::lock_guard<std::mutex> cost_lock(cost_mutex);
+    return cost_model.coef[0] * cost.compute + cost_model.coef[1] * cost.memory + cost_model.coef[2] * cost.gates;
+}
+
+int estimate_duration_ms(const CostFeatures& cost) {
+    return static_cast<int>(std::clamp(std::ceil(estimate_cost_ms(cost)), 1.0, double(INT32_MAX)));
+}
+
+// Учет фактического времени выполненной схемы и пересчет коэффициентов
+void record_cost(const CostFeatures& cost, double seconds) {
+    double t = std::max(seconds * 1000, 1e-3);
+    double w = 1.0 / (t * t);
+    const double x[cost_features] = {cost.compute, cost.memory, cost.gates};
+    const double prior[cost_features] = {1.0 / default_amplitudes_per_ms(simd_level), 1.0 / default_bytes_per_ms,
+                                         default_ms_per_gate};
+    std::lock_guard<std::mutex> cost_lock(cost_mutex);
+    CostModel& m = cost_model;
+    for (int i = 0; i < cost_features; ++i) {
+        for (int j = 0; j < cost_features; ++j) m.xx[i][j] = cost_model_decay * m.xx[i][j] + w * x[i] * x[j];
+        m.xt[i] = cost_model_decay * m.xt[i] + w * x[i] * t;
+    }
+    m.samples++;
+
+    // Начальные коэффициенты входят как замеры вида c_i / prior_i = 1
+    double a[cost_features][cost_features + 1];
+    for (int i = 0; i < cost_features; ++i) {
+        for (int j = 0; j < cost_features; ++j) a[i][j] = m.xx[i][j] + (i == j ? cost_model_prior / (prior[i] * prior[i]) : 0);
+        a[i][cost_features] = m.xt[i] + cost_model_prior / prior[i];
+    }
+    // Исходная система нужна для запасного варианта ниже
+    double pp = 0, pt = 0;
+    for (int i = 0; i < cost_features; ++i) {
+        pt += prior[i] * a[i][cost_features];
+        for (int j = 0; j < cost_features; ++j) pp += prior[i] * prior[j] * a[i][j];
+    }
+    // Гаусс с выбором ведущего элемента
+    bool solved = true;
+    for (int c = 0; c < cost_features && solved; ++c) {
+        int pivot = c;
+        for (int r = c + 1; r < cost_features; ++r) {
+            if (std::abs(a[r][c]) > std::abs(a[pivot][c])) pivot = r;
+        }
+        std::swap(a[c], a[pivot]);
+        solved = a[c][c] > 0;
+        for (int r = 0; r < cost_features && solved; ++r) {
+            if (r == c) continue;
+            double f = a[r][c] / a[c][c];
+            for (int k = c; k <= cost_features; ++k) a[r][k] -= f * a[c][k];
+        }
+    }
+    double coef[cost_features];
+    for (int i = 0; i < cost_features && solved; ++i) {
+        coef[i] = a[i][cost_features] / a[i][i];
+        solved = coef[i] > 0;
+    }
+    if (!solved) {
+        // Признаки почти коллинеарны - масштабируем начальные коэффициенты целиком
+        for (int i = 0; i < cost_features; ++i) coef[i] = prior[i] * pt / pp;
+    }
+    std::copy(coef, coef + cost_features, m.coef);
+}
+
+// ===================== Матричные произведения состояний (MPS) =====================
+// Для схем, вектор состояния которых не помещается в память, но запутанность
+// невелика. Состояние - цепочка тензоров A[i] размера (левая связь, 2, правая связь),
+// кубит i - узел i. Однокубитный вентиль умножает тензор узла; k-кубитный вентиль
+// стягивает k соседних узлов, применяется и раскладывается обратно
+// последовательными SVD с отбрасыванием сингулярных чисел сверх mps_max_bond и ниже
+// mps_cutoff. Дальние кубиты сводятся к соседним перестановками (SWAP) и
+// возвращаются на место после вентиля. Отброшенный вес копится в оценку точности.
+
+int mps_max_bond = 64;          // Максимальная размерность связи
+double mps_cutoff = 1e-12;      // Относительный порог сингулярных чисел
+const double mps_svd_work_per_ms = 1e5; // (2 chi)^3 разложений в миллисекунду - для оценки длительности
+
+// SVD методом Якоби (односторонним): a (m x n, по строкам) = u * diag(s) * vh.
+// u: m x r, vh: r x n, r = min(m, n); сингулярные числа по убыванию
+void svd_jacobi(const std::vector<std::complex<double>>& a, int m, int n, std::vector<std::complex<double>>& u,
+                std::vector<double>& s, std::vector<std::complex<double>>& vh) {
+    using C = std::complex<double>;
+    // Ортогонализуем столбцы той ориентации, где их меньше
+    bool transposed = n > m;
+    int rows = transposed ? n : m, cols = transposed ? m : n;
+    std::vector<C> w(size_t(rows) * cols), v(size_t(cols) * cols, C(0)); // w и v - по столбцам
+    for (int i = 0; i < m; ++i) {
+        for (int j = 0; j < n; ++j) {
+            C x = a[size_t(i) * n + j];
+            if (transposed) w[size_t(i) * rows + j] = std::conj(x); // столбец i матрицы a^H
+            else w[size_t(j) * rows + i] = x;
+        }
+    }
+    for (int j = 0; j < cols; ++j) v[size_t(j) * cols + j] = 1;
+    for (int sweep = 0; sweep < 60; ++sweep) {
+        bool rotated = false;
+        for (int p = 0; p < cols - 1; ++p) {
+            for (int q = p + 1; q < cols; ++q) {
+                C* wp = &w[size_t(p) * rows];
+                C* wq = &w[size_t(q) * rows];
+                double alpha = 0, beta = 0;
+                C gamma = 0;
+                for (int k = 0; k < rows; ++k) {
+                    alpha += std::norm(wp[k]);
+                    beta += std::norm(wq[k]);
+                    gamma += std::conj(wp[k]) * wq[k];
+                }
+                double g = std::abs(gamma);
+                if (g <= 1e-15 * std::sqrt(alpha * beta) || g < 1e-300) continue;
+                rotated = true;
+                C phase = std::conj(gamma) / g; // Столбец q домножается на e^{-i arg gamma}
+                double zeta = (beta - alpha) / (2 * g);
+                double t = (zeta >= 0 ? 1.0 : -1.0) / (std::abs(zeta) + std::sqrt(1 + zeta * zeta));
+                double c = 1 / std::sqrt(1 + t * t), sn = c * t;
+                for (int k = 0; k < rows; ++k) {
+                    C x = wp[k], y = wq[k] * phase;
+                    wp[k] = c * x - sn * y;
+                    wq[k] = sn * x + c * y;
+                }
+                C* vp = &v[size_t(p) * cols];
+                C* vq = &v[size_t(q) * cols];
+                for (int k = 0; k < cols; ++k) {
+                    C x = vp[k], y = vq[k] * phase;
+                    vp[k] = c * x - sn * y;
+                    vq[k] = sn * x + c * y;
+                }
+            }
+        }
+        if (!rotated) break;
+    }
+    // w = a' * v, a' = w * v^H: сингулярные числа - нормы столбцов w
+    std::vector<int> order(cols);
+    std::vector<double> norms(cols);
+    for (int j = 0; j < cols; ++j) {
+        double sum = 0;
+        for (int k = 0; k < rows; ++k) sum += std::norm(w[size_t(j) * rows + k]);
+        norms[j] = std::sqrt(sum);
+        order[j] = j;
+    }
+    std::sort(order.begin(), order.end(), [&](int x, int y) { return norms[x] > norms[y]; });
+    int r = cols;
+    s.assign(r, 0.0);
+    std::vector<C> left(size_t(rows) * r), right(size_t(r) * cols); // left = w/s (rows x r), right = v^H (r x cols)
+    for (int j = 0; j < r; ++j) {
+        int col = order[j];
+        s[j] = norms[col];
+        double inv = s[j] > 0 ? 1 / s[j] : 0;
+        for (int k = 0; k < rows; ++k) left[size_t(k) * r + j] = w[size_t(col) * rows + k] * inv;
+        for (int k = 0; k < cols; ++k) right[size_t(j) * cols + k] = std::conj(v[size_t(col) * cols + k]);
+    }
+    if (!transposed) {
+        u = std::move(left);
+        vh = std::move(right);
+        return;
+    }
+    // a^H = left * s * right  =>  a = right^H * s * left^H
+    u.assign(size_t(m) * r, C(0));
+    vh.assign(size_t(r) * n, C(0));
+    for (int i = 0; i < m; ++i) {
+        for (int j = 0; j < r; ++j) u[size_t(i) * r + j] = std::conj(right[size_t(j) * cols + i]);
+    }
+    for (int j = 0; j < r; ++j) {
+        for (int k = 0; k < n; ++k) vh[size_t(j) * n + k] = std::conj(left[size_t(k) * r + j]);
+    }
+}
+
+struct MpsState {
+    int qubits = 0;
+    std::vector<std::vector<std::complex<double>>> sites; // Узел i: (left, 2, right) по строкам
+    std::vector<int> bond;    // bond[i] - связь между узлами i и i + 1
+    int center = 0;           // Центр ортогональности: левее узлы левоканонические, правее - правоканонические
+    double fidelity = 1;      // Произведение (1 - отброшенный вес) по всем разложениям
+    int max_bond = 1;
+
+    explicit MpsState(int n) : qubits(n), sites(n, std::vector<std::complex<double>>{1, 0}), bond(std::max(n - 1, 0), 1) {}
+
+    int left(int i) const { return i == 0 ? 1 : bond[i - 1]; }
+    int right(int i) const { return i == qubits - 1 ? 1 : bond[i]; }
+};
+
+// SVD с отбрасыванием: остается chi <= mps_max_bond сингулярных чисел выше mps_cutoff.
+// Разложение ведется в центре ортогональности, поэтому отброшенный вес - это потеря
+// точности всего состояния; оставшиеся числа перенормируются, норма сохраняется
+int mps_truncated_svd(MpsState& mps, const std::vector<std::complex<double>>& matrix, int rows, int cols,
+                      std::vector<std::complex<double>>& u, std::vector<double>& s, std::vector<std::complex<double>>& vh) {
+    svd_jacobi(matrix, rows, cols, u, s, vh);
+    double total = 0, kept = 0;
+    for (double x : s) total += x * x;
+    int chi = 0;
+    while (chi < static_cast<int>(s.size()) && chi < mps_max_bond && s[chi] > mps_cutoff * s[0]) {
+        kept += s[chi] * s[chi];
+        ++chi;
+    }
+    if (chi == 0) return 1; // Нулевое состояние
+    if (kept < total) mps.fidelity *= kept / total;
+    double renorm = std::sqrt(total / kept);
+    for (int c = 0; c < chi; ++c) s[c] *= renorm;
+    mps.max_bond = std::max(mps.max_bond, chi);
+    return chi;
+}
+
+// Сдвиг центра ортогональности на узел target
+void mps_move_center(MpsState& mps, int target) {
+    using C = std::complex<double>;
+    std::vector<C> matrix, u, vh;
+    std::vector<double> s;
+    while (mps.center < target) {
+        // Узел i = U, S * V^H уходит в узел i + 1
+        int i = mps.center;
+        int rows = mps.left(i) * 2, cols = mps.right(i);
+        int chi = mps_truncated_svd(mps, mps.sites[i], rows, cols, u, s, vh);
+        int r_full = static_cast<int>(s.size());
+        auto& site = mps.sites[i];
+        site.assign(size_t(rows) * chi, C(0));
+        for (int row = 0; row < rows; ++row) {
+            for (int c = 0; c < chi; ++c) site[size_t(row) * chi + c] = u[size_t(row) * r_full + c];
+        }
+        auto& next = mps.sites[i + 1];
+        int next_cols = 2 * mps.right(i + 1);
+        matrix.assign(size_t(chi) * next_cols, C(0));
+        for (int c = 0; c < chi; ++c) {
+            for (int x = 0; x < cols; ++x) {
+                C f = s[c] * vh[size_t(c) * cols + x];
+                for (int y = 0; y < next_cols; ++y) matrix[size_t(c) * next_cols + y] += f * next[size_t(x) * next_cols + y];
+            }
+        }
+        next = matrix;
+        mps.bond[i] = chi;
+        mps.center++;
+    }
+    while (mps.center > target) {
+        // Узел i = V^H, U * S уходит в узел i - 1
+        int i = mps.center;
+        int rows = mps.left(i), cols = 2 * mps.right(i);
+        int chi = mps_truncated_svd(mps, mps.sites[i], rows, cols, u, s, vh);
+        int r_full = static_cast<int>(s.size());
+        mps.sites[i].assign(vh.begin(), vh.begin() + size_t(chi) * cols);
+        auto& prev = mps.sites[i - 1];
+        int prev_rows = mps.left(i - 1) * 2;
+        matrix.assign(size_t(prev_rows) * chi, C(0));
+        for (int row = 0; row < prev_rows; ++row) {
+            for (int x = 0; x < rows; ++x) {
+                C f = prev[size_t(row) * rows + x];
+                if (f == C(0)) continue;
+                for (int c = 0; c < chi; ++c) matrix[size_t(row) * chi + c] += f * u[size_t(x) * r_full + c] * s[c];
+            }
+        }
+        prev = matrix;
+        mps.bond[i - 1] = chi;
+        mps.center--;
+    }
+}
+
+// Однокубитный вентиль на узле
+void mps_apply1(MpsState& mps, int site, const std::complex<double>* m) {
+    auto& a = mps.sites[site];
+    size_t r = mps.right(site);
+    for (size_t l = 0; l < size_t(mps.left(site)); ++l) {
+        for (size_t k = 0; k < r; ++k) {
+            std::complex<double> x0 = a[(l * 2) * r + k], x1 = a[(l * 2 + 1) * r + k];
+            a[(l * 2) * r + k] = m[0] * x0 + m[1] * x1;
+            a[(l * 2 + 1) * r + k] = m[2] * x0 + m[3] * x1;
+        }
+    }
+}
+
+// Вентиль на k соседних узлах [first, first + k): perm[d] - индекс в матрице вентиля
+// для индекса блока d (бит j - узел first + j)
+void mps_apply_block(MpsState& mps, int first, int k, const std::complex<double>* m, const std::vector<int>& perm) {
+    using C = std::complex<double>;
+    mps_move_center(mps, std::clamp(mps.center, first, first + k - 1));
+    const size_t L = mps.left(first), R = mps.right(first + k - 1);
+    // Стягивание узлов: t[l][d][r]
+    std::vector<C> t = mps.sites[first];
+    size_t dim = 2;
+    for (int j = 1; j < k; ++j) {
+        const auto& b = mps.sites[first + j];
+        size_t mid = mps.left(first + j), r = mps.right(first + j);
+        std::vector<C> next(L * dim * 2 * r, C(0));
+        for (size_t l = 0; l < L; ++l) {
+            for (size_t d = 0; d < dim; ++d) {
+                const C* row = &t[(l * dim + d) * mid];
+                for (size_t x = 0; x < mid; ++x) {
+                    if (row[x] == C(0)) continue;
+                    for (size_t s = 0; s < 2; ++s) {
+                        C* out = &next[(l * dim * 2 + (d | s << j)) * r];
+                        const C* in = &b[(x * 2 + s) * r];
+                        for (size_t y = 0; y < r; ++y) out[y] += row[x] * in[y];
+                    }
+                }
+            }
+        }
+        t = std::move(next);
+        dim *= 2;
+    }
+    // Применение вентиля по физическому индексу
+    std::vector<C> in(dim);
+    for (size_t l = 0; l < L; ++l) {
+        for (size_t r = 0; r < R; ++r) {
+            for (size_t d = 0; d < dim; ++d) in[d] = t[(l * dim + d) * R + r];
+            for (size_t d = 0; d < dim; ++d) {
+                C sum = 0;
+                for (size_t e = 0; e < dim; ++e) sum += m[size_t(perm[d]) * dim + size_t(perm[e])] * in[e];
+                t[(l * dim + d) * R + r] = sum;
+            }
+        }
+    }
+    // Обратное разложение слева направо
+    std::vector<C> matrix, u, vh;
+    std::vector<double> s;
+    size_t left_dim = L;
+    for (int j = 0; j < k - 1; ++j) {
+        size_t rest = dim / 2; // Физических состояний правее узла first + j
+        int rows = static_cast<int>(left_dim * 2), cols = static_cast<int>(rest * R);
+        matrix.assign(size_t(rows) * cols, C(0));
+        for (size_t l = 0; l < left_dim; ++l) {
+            for (size_t d = 0; d < dim; ++d) {
+                for (size_t r = 0; r < R; ++r) {
+                    matrix[(l * 2 + (d & 1)) * cols + (d >> 1) * R + r] = t[(l * dim + d) * R + r];
+                }
+            }
+        }
+        int chi = mps_truncated_svd(mps, matrix, rows, cols, u, s, vh);
+        int r_full = static_cast<int>(s.size());
+        auto& site = mps.sites[first + j];
+        site.assign(size_t(rows) * chi, C(0));
+        for (int row = 0; row < rows; ++row) {
+            for (int c = 0; c < chi; ++c) site[size_t(row) * chi + c] = u[size_t(row) * r_full + c];
+        }
+        mps.bond[first + j] = chi;
+        t.assign(size_t(chi) * rest * R, C(0));
+        for (int c = 0; c < chi; ++c) {
+            for (int col = 0; col < cols; ++col) t[size_t(c) * cols + col] = s[c] * vh[size_t(c) * cols + col];
+        }
+        left_dim = chi;
+        dim = rest;
+    }
+    mps.sites[first + k - 1] = std::move(t);
+    mps.center = first + k - 1;
+}
+
+// Перестановка соседних узлов i и i + 1
+void mps_swap(MpsState& mps, int i) {
+    static const std::complex<double> swap[16] = {1, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 0, 1};
+    mps_apply_block(mps, i, 2, swap, {0, 1, 2, 3});
+}
+
+void mps_apply_gate(MpsState& mps, const Gate& gate, const Circuit& circuit) {
+    std::complex<double> m[1 << (2 * max_gate_qubits)];
+    gate_matrix(gate, circuit, m);
+    if (gate.arity == 1) {
+        mps_apply1(mps, gate.qubits[0], m);
+        return;
+    }
+    // Кубиты вентиля по возрастанию сдвигаются к младшему перестановками соседей
+    std::vector<int> order(gate.arity);
+    for (int j = 0; j < gate.arity; ++j) order[j] = j;
+    std::sort(order.begin(), order.end(), [&](int x, int y) { return gate.qubits[x] < gate.qubits[y]; });
+    int first = gate.qubits[order[0]];
+    std::vector<int> swaps;
+    for (int j = 1; j < gate.arity; ++j) {
+        for (int site = gate.qubits[order[j]] - 1; site >= first + j; --site) {
+            mps_swap(mps, site);
+            swaps.push_back(site);
+        }
+    }
+    // Узел first + j держит кубит order[j]
+    std::vector<int> perm(size_t(1) << gate.arity);
+    for (size_t d = 0; d < perm.size(); ++d) {
+        int index = 0;
+        for (int j = 0; j < gate.arity; ++j) index |= int((d >> j) & 1) << order[j];
+        perm[d] = index;
+    }
+    mps_apply_block(mps, first, gate.arity, m, perm);
+    for (auto it = swaps.rbegin(); it != swaps.rend(); ++it) mps_swap(mps, *it);
+}
+
+// Свертка <psi|psi> слева направо
+double mps_norm(const MpsState& mps) {
+    std::vector<std::complex<double>> env{1};
+    for (int i = 0; i < mps.qubits; ++i) {
+        size_t L = mps.left(i), R = mps.right(i);
+        const auto& a = mps.sites[i];
+        std::vector<std::complex<double>> next(R * R, 0);
+        for (size_t l1 = 0; l1 < L; ++l1) {
+            for (size_t l2 = 0; l2 < L; ++l2) {
+                std::complex<double> e = env[l1 * L + l2];
+                if (e == 0.0) continue;
+                for (size_t s = 0; s < 2; ++s) {
+                    for (size_t r1 = 0; r1 < R; ++r1) {
+                        std::complex<double> x = e * std::conj(a[(l1 * 2 + s) * R + r1]);
+                        for (size_t r2 = 0; r2 < R; ++r2) next[r1 * R + r2] += x * a[(l2 * 2 + s) * R + r2];
+                    }
+                }
+            }
+        }
+        env = std::move(next);
+    }
+    return env[0].real();
+}
+
+// Амплитуда базисного состояния (бит q индекса - кубит q; старшие кубиты в |0>)
+std::complex<double> mps_amplitude(const MpsState& mps, uint64_t basis) {
+    std::vector<std::complex<double>> v{1};
+    for (int i = 0; i < mps.qubits; ++i) {
+        size_t L = mps.left(i), R = mps.right(i);
+        size_t s = i < 64 ? (basis >> i) & 1 : 0;
+        std::vector<std::complex<double>> next(R, 0);
+        for (size_t l = 0; l < L; ++l) {
+            for (size_t r = 0; r < R; ++r) next[r] += v[l] * mps.sites[i][(l * 2 + s) * R + r];
+        }
+        v = std::move(next);
+    }
+    return v[0];
+}
+
+using BitstringHistogram = std::unordered_map<std::string, uint64_t>; // Строка битов (кубит 0 - справа) -> число шотов
+
+// Выборка шотов: правые окружения считаются один раз, затем узлы разыгрываются
+// слева направо по условным вероятностям; шоты делятся между потоками
+BitstringHistogram mps_sample(const MpsState& mps, int shots, uint64_t seed) {
+    using C = std::complex<double>;
+    const int n = mps.qubits;
+    std::vector<std::vector<C>> env(n + 1); // env[i] - правое окружение левой связи узла i
+    env[n] = {1};
+    for (int i = n - 1; i >= 0; --i) {
+        size_t L = mps.left(i), R = mps.right(i);
+        const auto& a = mps.sites[i];
+        env[i].assign(L * L, 0);
+        for (size_t l1 = 0; l1 < L; ++l1) {
+            for (size_t l2 = 0; l2 < L; ++l2) {
+                C sum = 0;
+                for (size_t s = 0; s < 2; ++s) {
+                    for (size_t r1 = 0; r1 < R; ++r1) {
+                        C x = a[(l1 * 2 + s) * R + r1];
+                        if (x == 0.0) continue;
+                        for (size_t r2 = 0; r2 < R; ++r2) sum += x * env[i + 1][r1 * R + r2] * std::conj(a[(l2 * 2 + s) * R + r2]);
+                    }
+                }
+                env[i][l1 * L + l2] = sum;
+            }
+        }
+    }
+    BitstringHistogram histogram;
+    std::mutex merge_mutex;
+    parallel_for(static_cast<size_t>(shots), [&](size_t begin, size_t end) {
+        std::seed_seq seq{seed, uint64_t(begin)};
+        std::mt19937_64 gen(seq);
+        std::uniform_real_distribution<double> uniform(0, 1);
+        BitstringHistogram local;
+        std::string bits(n, '0');
+        std::vector<C> v, w[2];
+        for (size_t shot = begin; shot < end; ++shot) {
+            v.assign(1, 1);
+            for (int i = 0; i < n; ++i) {
+                size_t L = mps.left(i), R = mps.right(i);
+                double p[2];
+                for (size_t s = 0; s < 2; ++s) {
+                    w[s].assign(R, 0);
+                    for (size_t l = 0; l < L; ++l) {
+                        for (size_t r = 0; r < R; ++r) w[s][r] += v[l] * mps.sites[i][(l * 2 + s) * R + r];
+                    }
+                    C sum = 0;
+                    for (size_t r1 = 0; r1 < R; ++r1) {
+                        for (size_t r2 = 0; r2 < R; ++r2) sum += w[s][r1] * env[i + 1][r1 * R + r2] * std::conj(w[s][r2]);
+                    }
+                    p[s] = std::max(sum.real(), 0.0);
+                }
+                int s = uniform(gen) * (p[0] + p[1]) < p[0] ? 0 : 1;
+                bits[n - 1 - i] = char('0' + s);
+                double scale = p[s] > 0 ? 1 / std::sqrt(p[s]) : 0;
+                v.resize(R);
+                for (size_t r = 0; r < R; ++r) v[r] = w[s][r] * scale;
+            }
+            local[bits]++;
+        }
+        std::lock_guard<std::mutex> merge_lock(merge_mutex);
+        for (const auto& [outcome, count] : local) histogram[outcome] += count;
+    }, 64);
+    return histogram;
+}
+
+// Оценка сверху log2 ранга Шмидта на связях линейной цепочки: каждый вентиль, чьи
+// кубиты лежат по обе стороны связи, умножает ранг не больше чем на свой
+// операторный ранг Шмидта (CNOT и CZ - 2, SWAP - 4, k-кубитная матрица - 4^min(частей)).
+// Возвращает наибольшую оценку на связях, которые пересекает вентиль
+int mps_update_bound(std::vector<int>& bound, const Gate& gate, int qubits) {
+    int low = *std::min_element(gate.qubits, gate.qubits + gate.arity);
+    int high = *std::max_element(gate.qubits, gate.qubits + gate.arity);
+    int largest = 0;
+    for (int b = low; b < high; ++b) {
+        int below = 0;
+        for (int j = 0; j < gate.arity; ++j) below += gate.qubits[j] <= b;
+        int rank_log2 = gate.type == GateType::CNOT || gate.type == GateType::CZ ? 1 : 2 * std::min(below, gate.arity - below);
+        bound[b] = std::min(bound[b] + rank_log2, std::min(b + 1, qubits - b - 1));
+        largest = std::max(largest, bound[b]);
+    }
+    return largest;
+}
+
+int mps_bond_bound_log2(const Circuit& circuit) {
+    std::vector<int> bound(std::max(circuit.qubits - 1, 0), 0);
+    for (const Gate& gate : circuit.gates) {
+        if (gate.arity > 1) mps_update_bound(bound, gate, circuit.qubits);
+    }
+    return bound.empty() ? 0 : *std::max_element(bound.begin(), bound.end());
+}
+
+// Размерность связи, которой хватит схеме (не больше mps_max_bond)
+int mps_expected_bond(const Circuit& circuit) {
+    int log2 = mps_bond_bound_log2(circuit);
+    return log2 >= 30 ? mps_max_bond : std::min(1 << log2, mps_max_bond);
+}
+
+size_t mps_memory_bytes(const Circuit& circuit) {
+    size_t chi = static_cast<size_t>(mps_expected_bond(circuit));
+    int arity = 1;
+    for (const Gate& gate : circuit.gates) arity = std::max(arity, int(gate.arity));
+    // Тензоры узлов и рабочие массивы блока (стянутые узлы, матрица, U и V^H)
+    return (size_t(circuit.qubits) * 2 + 4 * (size_t(1) << arity)) * chi * chi * sizeof(std::complex<double>);
+}
+
+// Длительность по числу SVD (разложения блока и перестановки туда и обратно) размером
+// (2 chi) x (2 chi), где chi растет вместе с оценкой ранга на пересекаемых связях
+int estimate_mps_duration_ms(const Circuit& circuit) {
+    std::vector<int> bound(std::max(circuit.qubits - 1, 0), 0);
+    double work = 0;
+    for (const Gate& gate : circuit.gates) {
+        if (gate.arity < 2) continue;
+        int log2 = mps_update_bound(bound, gate, circuit.qubits);
+        double chi = log2 >= 30 ? mps_max_bond : std::min(1 << log2, mps_max_bond);
+        int low = *std::min_element(gate.qubits, gate.qubits + gate.arity);
+        int high = *std::max_element(gate.qubits, gate.qubits + gate.arity);
+        double svds = (gate.arity - 1) + 2.0 * (high - low - gate.arity + 1);
+        work += svds * std::pow(2 * chi, 3);
+    }
+    return static_cast<int>(std::clamp(std::ceil(work / mps_svd_work_per_ms), 1.0, double(INT32_MAX)));
+}
+
+struct MpsResult {
+    double norm = 0;
+    double probability_zero = 0;
+    double fidelity = 1;      // Оценка точности после отбрасывания
+    int max_bond = 1;
+    BitstringHistogram counts; // Шоты (если задавались)
+    double seconds = 0;
+};
+
+std::vector<std::pair<int, MpsResult>> mps_results; // id задачи -> результат (под output_mutex)
+
+MpsResult simulate_mps(const Circuit& circuit, int shots, uint64_t seed) {
+    auto start = std::chrono::steady_clock::now();
+    MpsState mps(circuit.qubits);
+    for (const Gate& gate : circuit.gates) mps_apply_gate(mps, gate, circuit);
+    MpsResult result;
+    result.norm = mps_norm(mps);
+    result.probability_zero = std::norm(mps_amplitude(mps, 0));
+    result.fidelity = mps.fidelity;
+    result.max_bond = mps.max_bond;
+    if (shots > 0) result.counts = mps_sample(mps, shots, seed);
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+void finish_mps_task(const QuantumTask& task, MpsResult result) {
+    std::lock_guard<std::mutex> out_lock(output_mutex);
+    if (task.shots > 0) {
+        std::vector<std::pair<std::string, uint64_t>> top(result.counts.begin(), result.counts.end());
+        std::sort(top.begin(), top.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+        std::cout << "Task " << task.id << ": " << task.shots << " shots from MPS, " << result.counts.size()
+                  << " distinct outcomes, top:";
+        for (size_t i = 0; i < std::min<size_t>(3, top.size()); ++i) {
+            std::cout << " " << top[i].first << "x" << top[i].second;
+        }
+        std::cout << std::endl;
+    }
+    if (result.fidelity < 1 - 1e-9) {
+        std::cout << "Task " << task.id << ": MPS truncated at bond " << mps_max_bond << ", fidelity estimate "
+                  << result.fidelity << std::endl;
+    }
+    mps_results.emplace_back(task.id, std::move(result));
+}
+
+// ===================== Бюджет памяти узла =====================
+// Вектор состояния занимает sizeof(амплитуды) * 2^n байт (16 * 2^n для double), поэтому
+// задача берется на выполнение, только если сумма векторов выполняемых задач остается
+// в бюджете. Задача, которой сейчас не хватает памяти, откладывается, а процессор берет
+// следующую подходящую. Если отложенная задача ждет дольше memory_starvation_ms,
+// меньшие задачи больше не запускаются, пока для нее не освободится память.
+// Задачи, не помещающиеся в бюджет даже на пустом узле, отклоняются.
+
+size_t default_memory_budget() {
+    double memory = double(sysconf(_SC_PHYS_PAGES)) * double(sysconf(_SC_PAGESIZE));
+    return static_cast<size_t>(memory * 0.75);
+}
+
+struct MemoryBudget {
+    size_t limit = default_memory_budget();
+    size_t in_use = 0;  // Векторы выполняемых задач
+    size_t peak = 0;
+    int delayed = 0;    // Сколько раз задача откладывалась из-за памяти
+    int rejected = 0;
+};
+
+// Все поля и отложенные задачи защищены queue_mutex
+MemoryBudget memory_budget;
+std::vector<QuantumTask> memory_delayed; // По убыванию важности (ComparePriority)
+std::condition_variable memory_cv; // Память освободилась
+int memory_starvation_ms = 500;
+int running_tasks = 0; // Взятые и еще не завершенные задачи: они могут породить подзадачи
+
+size_t task_memory_bytes(const QuantumTask& task) {
+    if (task.cut_plan && !task.cut_job) {
+        // Режется на фрагменты: память задания (передается ему при разрезании) и место
+        // для наибольшего фрагмента, чтобы фрагменты вообще могли пройти в бюджет
+        int largest = std::max(task.cut_plan->split, task.circuit->qubits - task.cut_plan->split);
+        return cut_job_memory_bytes(*task.circuit, *task.cut_plan, task.shots) + ((sizeof(double) * 3) << largest);
+    }
+    if (task.shot_job) return 0;                  // Выборщик общий для подзадач, его память держит ShotJob
+    if (task.trajectories > 0 && !task.trajectory_job) return 0; // Делится на пакеты траекторий
+    if (task.backend == Backend::MPS) return mps_memory_bytes(*task.circuit);
+    int qubits = task.circuit ? task.circuit->qubits : task.required_qubits;
+    size_t amplitude = task.precision == Precision::Float ? sizeof(std::complex<float>) : sizeof(std::complex<double>);
+    // Для выборки шотов еще распределение (8 байт на исход) и выборщик (до 12 байт)
+    if (task.circuit && task.shots > 0 && task.backend != Backend::DensityMatrix) amplitude += 20;
+    // Пакет траекторий копит сумму распределений
+    if (task.trajectory_job && qubits <= trajectory_distribution_qubits) amplitude += sizeof(double);
+    // Вариант фрагмента считает вероятности всех исходов
+    if (task.cut_job) amplitude += sizeof(double);
+    if (qubits >= 58) return SIZE_MAX;
+    return amplitude << qubits;
+}
+
+bool memory_fits(size_t bytes) {
+    return bytes <= memory_budget.limit && memory_budget.in_use + bytes <= memory_budget.limit;
+}
+
+void reserve_task_memory(size_t bytes) {
+    memory_budget.in_use += bytes;
+    memory_budget.peak = std::max(memory_budget.peak, memory_budget.in_use);
+}
+
+void release_task_memory(const QuantumTask& task) {
+    {
+        std::lock_guard<std::mutex> queue_lock(queue_mutex);
+        memory_budget.in_use -= task_memory_bytes(task);
+        running_tasks--;
+    }
+    memory_cv.notify_all();
+}
+
+// Память общего результата подзадач (распределения фрагментов, выборщик шотов). Задача,
+// которая делится на подзадачи, передает эту часть своей памяти объекту задания, и она
+// остается занятой, пока последняя подзадача не отпустит задание. Деструктор берет
+// queue_mutex, поэтому последнюю копию задачи с заданием нельзя уничтожать под ним.
+struct MemoryReservation {
+    size_t bytes;
+
+    explicit MemoryReservation(size_t reserved) : bytes(reserved) {
+        std::lock_guard<std::mutex> queue_lock(queue_mutex);
+        reserve_task_memory(bytes);
+    }
+
+    ~MemoryReservation() {
+        {
+            std::lock_guard<std::mutex> queue_lock(queue_mutex);
+            memory_budget.in_use -= bytes;
+        }
+        memory_cv.notify_all();
+    }
+
+    MemoryReservation(const MemoryReservation&) = delete;
+    MemoryReservation& operator=(const MemoryReservation&) = delete;
+};
+
+// Выбор следующей задачи с учетом памяти (под queue_mutex); память задачи резервируется.
+// more_expected - могут ли еще прийти задачи извне (тогда при пустой очереди ждем на cv).
+// false - задач больше не будет.
+template <typename MoreExpected>
+bool take_admitted_task(std::unique_lock<std::mutex>& lock, QuantumTask& task,
+                        std::condition_variable& cv, MoreExpected more_expected) {
+    ComparePriority lower;
+    while (true) {
+        // Отложенные задачи - первыми, по приоритету
+        bool starving = false;
+        for (size_t i = 0; i < memory_delayed.size(); ++i) {
+            size_t bytes = task_memory_bytes(memory_delayed[i]);
+            if (memory_fits(bytes)) {
+                task = memory_delayed[i];
+                memory_delayed.erase(memory_delayed.begin() + static_cast<long>(i));
+                reserve_task_memory(bytes);
+                running_tasks++;
+                return true;
+            }
+            auto waited = std::chrono::steady_clock::now() - memory_delayed[i].enqueued_at;
+            starving = starving || waited > std::chrono::milliseconds(memory_starvation_ms);
+        }
+
+        if (!starving && !task_queue.empty()) {
+            QuantumTask next = task_queue.top();
+            task_queue.pop();
+            size_t bytes = task_memory_bytes(next);
+            if (bytes > memory_budget.limit) {
+                memory_budget.rejected++;
+                size_t limit = memory_budget.limit;
+                lock.unlock(); // output_mutex берется до queue_mutex, а не после
+                {
+                    QuantumTask rejected = std::move(next); // Задание подзадачи освобождается без queue_mutex
+                    std::lock_guard<std::mutex> out_lock(output_mutex);
+                    std::cout << "Task " << task_name(rejected) << " rejected: needs " << (bytes >> 20)
+                              << " MB, host memory budget is " << (limit >> 20) << " MB" << std::endl;
+                }
+                lock.lock();
+                continue;
+            }
+            if (memory_fits(bytes)) {
+                task = next;
+                reserve_task_memory(bytes);
+                running_tasks++;
+                return true;
+            }
+            memory_budget.delayed++;
+            // Вставка с сохранением порядка (равные - в порядке откладывания), без сортировки на каждом круге
+            auto position = std::upper_bound(memory_delayed.begin(), memory_delayed.end(), next,
+                                             [&](const QuantumTask& a, const QuantumTask& b) { return lower(b, a); });
+            memory_delayed.insert(position, std::move(next));
+            continue;
+        }
+
+        // Ждем освобождения памяти, подзадач выполняющихся задач или новых задач
+        if (memory_delayed.empty() && task_queue.empty() && running_tasks == 0 && !more_expected()) return false;
+        cv.wait(lock);
+    }
+}
+
+// ===================== Измерения (шоты) =====================
+// Задача с shots > 0 моделируется один раз, после чего из конечного распределения
+// строится выборщик, общий для подзадач. Шоты делятся между подзадачами, которые
+// идут через обычную очередь на разные процессоры; у каждой подзадачи свой поток
+// случайных чисел, а гистограммы исходов сливаются в общую. Выборщик - таблица
+// псевдонимов (O(1) на шот, построение дороже) или префиксные суммы с двоичным
+// поиском (O(log N) на шот, построение параллельное).
+
+enum class SamplingMethod : uint8_t { Auto, Alias, Cumulative };
+
+SamplingMethod sampling_method = SamplingMethod::Auto;
+int shots_per_subtask = 1 << 16;  // Меньше шотов на подзадачу не выделяем
+int max_shot_subtasks = 16;
+
+struct ShotSampler {
+    SamplingMethod method = SamplingMethod::Cumulative;
+    size_t size = 0;
+    std::vector<double> cumulative;  // Префиксные суммы вероятностей
+    std::vector<double> keep;        // Таблица псевдонимов: вероятность оставить столбец
+    std::vector<uint32_t> alias;     // Таблица псевдонимов: альтернативный исход
+    double total = 0;
+
+    uint64_t sample(std::mt19937_64& gen) const {
+        uint64_t r = gen();
+        if (method == SamplingMethod::Alias) {
+            uint64_t column = ((r >> 32) * size) >> 32;
+            double fraction = double(r & 0xffffffffu) * (1.0 / 4294967296.0);
+            return fraction < keep[column] ? column : alias[column];
+        }
+        double u = double(r >> 11) * (1.0 / 9007199254740992.0) * total;
+        size_t index = static_cast<size_t>(std::upper_bound(cumulative.begin(), cumulative.end(), u) - cumulative.begin());
+        return std::min(index, size - 1);
+    }
+};
+
+// Параллельные префиксные суммы: суммы кусков, смещения, затем досчет кусков
+void build_cumulative(ShotSampler& sampler, const std::vector<double>& probabilities) {
+    size_t n = probabilities.size();
+    sampler.cumulative.resize(n);
+    size_t chunks = std::max<size_t>(1, std::min<size_t>(n / parallel_min_chunk, 4 * static_cast<size_t>(simulation_threads)));
+    size_t chunk = (n + chunks - 1) / chunks;
+    std::vector<double> offsets(chunks + 1, 0.0);
+    parallel_for(chunks, [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c) {
+            double sum = 0;
+            for (size_t i = c * chunk; i < std::min(n, (c + 1) * chunk); ++i) {
+                sum += std::max(probabilities[i], 0.0);
+                sampler.cumulative[i] = sum;
+            }
+            offsets[c + 1] = sum;
+        }
+    }, 1);
+    for (size_t c = 0; c < chunks; ++c) offsets[c + 1] += offsets[c];
+    parallel_for(chunks, [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c) {
+            for (size_t i = c * chunk; i < std::min(n, (c + 1) * chunk); ++i) sampler.cumulative[i] += offsets[c];
+        }
+    }, 1);
+    sampler.total = offsets[chunks];
+}
+
+// Таблица псевдонимов (метод Воуза)
+void build_alias(ShotSampler& sampler, const std::vector<double>& probabilities) {
+    size_t n = probabilities.size();
+    double total = 0;
+    for (double p : probabilities) total += std::max(p, 0.0);
+    sampler.total = total;
+    sampler.keep.resize(n);
+    sampler.alias.resize(n);
+    std::vector<uint32_t> small, large;
+    for (size_t i = 0; i < n; ++i) {
+        sampler.keep[i] = std::max(probabilities[i], 0.0) * double(n) / total;
+        sampler.alias[i] = static_cast<uint32_t>(i);
+        (sampler.keep[i] < 1.0 ? small : large).push_back(static_cast<uint32_t>(i));
+    }
+    while (!small.empty() && !large.empty()) {
+        uint32_t less = small.back();
+        small.pop_back();
+        uint32_t more = large.back();
+        sampler.alias[less] = more;
+        sampler.keep[more] -= 1.0 - sampler.keep[less];
+        if (sampler.keep[more] < 1.0) {
+            large.pop_back();
+            small.push_back(more);
+        }
+    }
+    for (uint32_t i : small) sampler.keep[i] = 1.0; // Остатки из-за округления
+    for (uint32_t i : large) sampler.keep[i] = 1.0;
+}
+
+std::shared_ptr<const ShotSampler> make_sampler(const std::vector<double>& probabilities, int shots) {
+    auto sampler = std::make_shared<ShotSampler>();
+    sampler->size = probabilities.size();
+    sampler->method = sampling_method;
+    if (sampler->method == SamplingMethod::Auto) {
+        // Таблица окупается, когда шотов много относительно числа исходов
+        sampler->method = uint64_t(shots) * 8 >= probabilities.size() ? SamplingMethod::Alias : SamplingMethod::Cumulative;
+    }
+    if (sampler->method == SamplingMethod::Alias && probabilities.size() <= (size_t(1) << 32)) {
+        build_alias(*sampler, probabilities);
+    } else {
+        sampler->method = SamplingMethod::Cumulative;
+        build_cumulative(*sampler, probabilities);
+    }
+    return sampler;
+}
+
+using ShotHistogram = std::unordered_map<uint64_t, uint64_t>; // исход -> число шотов
+
+// Общее состояние подзадач одной задачи с шотами
+struct ShotJob {
+    int task_id = 0;
+    int shots = 0;
+    int subtasks = 0;
+    std::shared_ptr<const ShotSampler> sampler;
+    std::mutex merge_mutex;
+    ShotHistogram histogram;
+    std::atomic<int> remaining{0};
+    std::chrono::steady_clock::time_point started;
+    std::shared_ptr<MemoryReservation> memory; // Выборщик в бюджете памяти до последней подзадачи
+};
+
+std::vector<std::pair<int, ShotHistogram>> shot_results; // id задачи -> гистограмма (под output_mutex)
+
+// Постановка подзадач выборки в очередь (шоты делятся поровну)
+void dispatch_shots(const QuantumTask& task, std::shared_ptr<const ShotSampler> sampler) {
+    auto job = std::make_shared<ShotJob>();
+    job->task_id = task.id;
+    job->shots = task.shots;
+    job->sampler = std::move(sampler);
+    job->subtasks = std::clamp((task.shots + shots_per_subtask - 1) / shots_per_subtask, 1, max_shot_subtasks);
+    job->remaining = job->subtasks;
+    job->started = std::chrono::steady_clock::now();
+    // Выборщик переживает задачу, которая его построила (и в чью память он входил):
+    // до последней подзадачи его память занята заданием
+    const ShotSampler& built = *job->sampler;
+    job->memory = std::make_shared<MemoryReservation>(built.cumulative.capacity() * sizeof(double) +
+                                                      built.keep.capacity() * sizeof(double) +
+                                                      built.alias.capacity() * sizeof(uint32_t));
+    {
+        std::lock_guard<std::mutex> queue_lock(queue_mutex);
+        for (int i = 0; i < job->subtasks; ++i) {
+            QuantumTask part = task;
+            part.subtask = 1 + i;
+            part.circuit = nullptr;
+            part.cut_plan = nullptr;
+            part.cut_job = nullptr;
+            part.shots = task.shots / job->subtasks + (i < task.shots % job->subtasks ? 1 : 0);
+            part.duration = std::max(1, part.shots / 5000); // Порядка 5-10 млн шотов/с
+            part.cost = {};
+            part.shot_job = job;
+            part.shot_index = i;
+            part.is_split = true;
+            task_queue.push(part);
+        }
+    }
+    memory_cv.notify_all();
+}
+
+// Выборка шотов подзадачи; последняя подзадача завершает задачу
+void run_shot_subtask(const QuantumTask& task) {
+    ShotJob& job = *task.shot_job;
+    // Свой поток случайных чисел у каждой подзадачи
+    std::seed_seq seed{job.task_id, task.shot_index, 117};
+    std::mt19937_64 gen(seed);
+    ShotHistogram local;
+    for (int s = 0; s < task.shots; ++s) local[job.sampler->sample(gen)]++;
+    {
+        std::lock_guard<std::mutex> merge_lock(job.merge_mutex);
+        for (const auto& [outcome, count] : local) job.histogram[outcome] += count;
+    }
+    if (job.remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - job.started).count();
+    std::vector<std::pair<uint64_t, uint64_t>> top(job.histogram.begin(), job.histogram.end());
+    std::sort(top.begin(), top.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+    std::lock_guard<std::mutex> out_lock(output_mutex);
+    std::cout << "Task " << job.task_id << ": " << job.shots << " shots in " << job.subtasks << " subtasks ("
+              << (job.sampler->method == SamplingMethod::Alias ? "alias table" : "cumulative search") << ", "
+              << seconds * 1000 << "ms), " << job.histogram.size() << " distinct outcomes, top:";
+    for (size_t i = 0; i < std::min<size_t>(3, top.size()); ++i) {
+        std::cout << " " << top[i].first << "x" << top[i].second;
+    }
+    std::cout << std::endl;
+    shot_results.emplace_back(job.task_id, std::move(job.histogram));
+}
+
+// ===================== Шум: траектории Монте-Карло =====================
+// После каждого вентиля на каждом его кубите действует деполяризующий канал (с
+// вероятностью p - случайная ошибка X, Y или Z) и амплитудное затухание gamma: переход
+// |1> -> |0> с вероятностью gamma * P(1) или его отсутствие, оба с перенормировкой.
+// Среднее распределение по траекториям сходится к диагонали матрицы плотности.
+// Траектории независимы, поэтому задача делится на пакеты, которые идут через очередь
+// на разные процессоры; у каждого пакета свой поток случайных чисел, суммы
+// распределений сливаются в общий результат.
+
+int max_trajectory_batches = 16;
+const int trajectory_fusion_min_qubits = 14; // Меньше - слияние дороже самих проходов
+
+// Общее состояние пакетов траекторий одной задачи
+struct TrajectoryJob {
+    int task_id = 0;
+    std::shared_ptr<const Circuit> circuit;
+    NoiseModel noise;
+    int trajectories = 0;
+    int batches = 0;
+    int shots = 0;                   // Шоты по среднему распределению
+    std::mutex merge_mutex;
+    std::vector<double> distribution; // Сумма распределений траекторий (если собирается)
+    double probability_zero = 0;      // Сумма P(0...0) траекторий
+    std::atomic<int> remaining{0};
+    std::chrono::steady_clock::time_point started;
+};
+
+struct TrajectoryResult {
+    int trajectories = 0;
+    double probability_zero = 0;      // Среднее по траекториям
+    std::vector<double> distribution; // Среднее распределение (если собиралось)
+    double seconds = 0;
+};
+
+std::vector<std::pair<int, TrajectoryResult>> trajectory_results; // id задачи -> результат (под output_mutex)
+
+// Вероятность единицы на кубите q
+template <typename Real>
+double probability_one(const StateVector<Real>& state, int q) {
+    std::mutex sum_mutex;
+    double total = 0;
+    size_t stride = size_t(1) << q;
+    parallel_for(state.size / 2, [&](size_t begin, size_t end) {
+        double sum = 0;
+        for (size_t i = begin; i < end; ++i) sum += std::norm(state.amplitudes[insert_zero_bit(i, q) | stride]);
+        std::lock_guard<std::mutex> sum_lock(sum_mutex);
+        total += sum;
+    });
+    return total;
+}
+
+// Амплитудное затухание на кубите q с розыгрышем перехода
+template <typename Real>
+void apply_amplitude_damping(StateVector<Real>& state, int q, double gamma, std::mt19937_64& gen) {
+    double p1 = probability_one(state, q);
+    if (p1 <= 0) return; // Кубит в |0>: отсутствие перехода ничего не меняет
+    double jump = gamma * p1;
+    if (std::uniform_real_distribution<double>(0, 1)(gen) < jump) {
+        // K1 = sqrt(gamma)|0><1|, после нормировки a0 = a1 / sqrt(P(1))
+        const std::complex<double> m[4] = {0, 1.0 / std::sqrt(p1), 0, 0};
+        apply_matrix1(state, q, m);
+    } else {
+        // K0 = |0><0| + sqrt(1 - gamma)|1><1|
+        double norm = 1.0 / std::sqrt(1 - jump);
+        apply_diagonal1(state, q, norm, std::sqrt(1 - gamma) * norm);
+    }
+}
+
+// Одна траектория из |0...0>
+template <typename Real>
+void run_trajectory(StateVector<Real>& state, const Circuit& circuit, const NoiseModel& noise, std::mt19937_64& gen) {
+    std::uniform_real_distribution<double> uniform(0, 1);
+    const GateType paulis[3] = {GateType::X, GateType::Y, GateType::Z};
+    state.reset();
+    if (noise.amplitude_damping <= 0 && circuit.qubits >= trajectory_fusion_min_qubits) {
+        // Ошибки Паули не зависят от состояния: разыгрываются заранее и вставляются
+        // в схему, которая затем сливается и выполняется блоками как обычно
+        Circuit noisy;
+        noisy.qubits = circuit.qubits;
+        noisy.matrices = circuit.matrices;
+        noisy.gates.reserve(circuit.gates.size() * 2);
+        for (const Gate& gate : circuit.gates) {
+            noisy.gates.push_back(gate);
+            for (int j = 0; j < gate.arity; ++j) {
+                if (uniform(gen) < noise.depolarizing) noisy.add(paulis[gen() % 3], gate.qubits[j]);
+            }
+        }
+        execute_circuit(state, noisy);
+        return;
+    }
+    // Малые векторы и затухание (оно зависит от состояния) - вентили по одному
+    for (const Gate& gate : circuit.gates) {
+        apply_gate(state, gate, circuit);
+        for (int j = 0; j < gate.arity; ++j) {
+            if (uniform(gen) < noise.depolarizing) {
+                Gate error{};
+                error.type = paulis[gen() % 3];
+                error.arity = 1;
+                error.qubits[0] = gate.qubits[j];
+                apply_gate(state, error, circuit);
+            }
+            if (noise.amplitude_damping > 0) apply_amplitude_damping(state, gate.qubits[j], noise.amplitude_damping, gen);
+        }
+    }
+}
+
+template <typename Real>
+void run_trajectory_batch(const QuantumTask& task) {
+    TrajectoryJob& job = *task.trajectory_job;
+    std::seed_seq seed{job.task_id, task.trajectory_batch, 120};
+    std::mt19937_64 gen(seed); // Свой поток случайных чисел у каждого пакета
+    const Circuit& circuit = *job.circuit;
+    StateVector<Real> state(circuit.qubits);
+    std::vector<double> sum(job.distribution.size(), 0.0);
+    double zero = 0;
+    for (int t = 0; t < task.trajectory_count; ++t) {
+        run_trajectory(state, circuit, job.noise, gen);
+        zero += std::norm(state.amplitudes[0]);
+        if (sum.empty()) continue;
+        parallel_for(state.size, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) sum[i] += std::norm(state.amplitudes[i]);
+        });
+    }
+    std::lock_guard<std::mutex> merge_lock(job.merge_mutex);
+    job.probability_zero += zero;
+    for (size_t i = 0; i < sum.size(); ++i) job.distribution[i] += sum[i];
+}
+
+// Деление задачи на пакеты траекторий
+std::vector<QuantumTask> trajectory_task(const QuantumTask& original_task) {
+    auto job = std::make_shared<TrajectoryJob>();
+    job->task_id = original_task.id;
+    job->circuit = original_task.circuit;
+    job->noise = original_task.noise;
+    job->trajectories = original_task.trajectories;
+    job->batches = std::min(original_task.trajectories, max_trajectory_batches);
+    job->shots = original_task.shots;
+    if (original_task.circuit->qubits <= trajectory_distribution_qubits) {
+        job->distribution.assign(size_t(1) << original_task.circuit->qubits, 0.0);
+    }
+    job->remaining = job->batches;
+    job->started = std::chrono::steady_clock::now();
+
+    std::vector<QuantumTask> parts;
+    for (int b = 0; b < job->batches; ++b) {
+        QuantumTask part = original_task;
+        part.subtask = 1 + b;
+        part.is_split = true;
+        part.shots = 0;
+        part.trajectory_job = job;
+        part.trajectory_batch = b;
+        part.trajectory_count = job->trajectories / job->batches + (b < job->trajectories % job->batches ? 1 : 0);
+        part.duration = std::max(1, static_cast<int>(int64_t(original_task.duration) * part.trajectory_count / job->trajectories));
+        parts.push_back(part);
+    }
+    return parts;
+}
+
+// Завершение пакета; последний пакет усредняет результат
+void finish_trajectory_batch(const QuantumTask& task) {
+    TrajectoryJob& job = *task.trajectory_job;
+    if (job.remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+    TrajectoryResult result;
+    result.trajectories = job.trajectories;
+    result.probability_zero = job.probability_zero / job.trajectories;
+    result.distribution = std::move(job.distribution);
+    for (double& p : result.distribution) p /= job.trajectories;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - job.started).count();
+    {
+        std::lock_guard<std::mutex> out_lock(output_mutex);
+        std::cout << "Task " << job.task_id << ": " << job.trajectories << " noisy trajectories in " << job.batches
+                  << " batches (p=" << job.noise.depolarizing << ", gamma=" << job.noise.amplitude_damping << ") in "
+                  << result.seconds * 1000 << "ms, P(0) " << result.probability_zero << std::endl;
+    }
+    if (job.shots > 0 && !result.distribution.empty()) {
+        QuantumTask parent = task;
+        parent.id = job.task_id;
+        parent.subtask = 0;
+        parent.shots = job.shots;
+        parent.trajectory_job = nullptr;
+        dispatch_shots(parent, make_sampler(result.distribution, job.shots));
+    }
+    std::lock_guard<std::mutex> out_lock(output_mutex);
+    trajectory_results.emplace_back(job.task_id, std::move(result));
+}
+
+// ===================== Матрица плотности =====================
+// Для малых схем с шумом - точное моделирование. Матрица плотности n кубитов хранится
+// как вектор состояния 2n кубитов: rho[r][c] лежит по индексу r + (c << n). Тогда
+// U rho U^+ - это U на кубитах строки q и U* на кубитах столбца q + n, а канал с
+// операторами Крауса K_k на кубите q - плотная матрица 4x4 (супероператор
+// sum_k K_k (x) K_k*) на паре (q, q + n). Схема удваивается один раз и дальше идет
+// обычным путем: слияние, блоки и векторные ядра.
+
+int density_max_qubits = 12;          // 4^12 амплитуд complex<double> = 256 МБ
+int default_noise_trajectories = 1000; // Если траекторий не задано, а выбраны траектории
+
+// Супероператор канала шума на одном кубите: деполяризация, затем затухание.
+// Локальный бит 0 - кубит строки, бит 1 - кубит столбца
+void noise_superoperator(const NoiseModel& noise, std::complex<double>* s) {
+    using C = std::complex<double>;
+    auto kraus_superoperator = [](const std::vector<std::array<C, 4>>& kraus, C* out) {
+        std::fill(out, out + 16, C(0));
+        for (const auto& k : kraus) {
+            for (int r = 0; r < 2; ++r) for (int c = 0; c < 2; ++c)
+                for (int r0 = 0; r0 < 2; ++r0) for (int c0 = 0; c0 < 2; ++c0)
+                    out[(r | c << 1) * 4 + (r0 | c0 << 1)] += k[r * 2 + r0] * std::conj(k[c * 2 + c0]);
+        }
+    };
+    const double p = noise.depolarizing, g = noise.amplitude_damping;
+    const double a = std::sqrt(1 - p), b = std::sqrt(p / 3);
+    const C i(0, 1);
+    C depolarizing[16], damping[16];
+    kraus_superoperator({{a, 0, 0, a}, {0, b, b, 0}, {0, -i * b, i * b, 0}, {b, 0, 0, -b}}, depolarizing);
+    kraus_superoperator({{1, 0, 0, std::sqrt(1 - g)}, {0, std::sqrt(g), 0, 0}}, damping);
+    for (int r = 0; r < 4; ++r) {
+        for (int c = 0; c < 4; ++c) {
+            s[r * 4 + c] = 0;
+            for (int k = 0; k < 4; ++k) s[r * 4 + c] += damping[r * 4 + k] * depolarizing[k * 4 + c];
+        }
+    }
+}
+
+// Удвоенная схема для матрицы плотности: вентиль на строках, сопряженный - на столбцах, затем шум
+Circuit make_density_circuit(const Circuit& circuit, const NoiseModel& noise) {
+    const int n = circuit.qubits;
+    Circuit out;
+    out.qubits = 2 * n;
+    std::complex<double> channel[16];
+    noise_superoperator(noise, channel);
+    std::vector<std::complex<double>> m;
+    for (const Gate& gate : circuit.gates) {
+        out.gates.push_back(gate);
+        if (gate.type == GateType::Matrix) {
+            // Матрицы переносятся в массив удвоенной схемы
+            size_t dim = size_t(1) << gate.arity;
+            out.gates.back().matrix = static_cast<uint32_t>(out.matrices.size());
+            out.matrices.insert(out.matrices.end(), circuit.matrices.begin() + gate.matrix,
+                                circuit.matrices.begin() + gate.matrix + dim * dim);
+        }
+        Gate column = gate;
+        for (int j = 0; j < gate.arity; ++j) column.qubits[j] = static_cast<uint16_t>(gate.qubits[j] + n);
+        switch (gate.type) {
+        case GateType::H: case GateType::X: case GateType::Z: case GateType::RY:
+        case GateType::CNOT: case GateType::CZ: case GateType::SWAP:
+            out.gates.push_back(column); // Вещественная матрица
+            break;
+        case GateType::RX: case GateType::RZ:
+            column.param = -gate.param;  // Сопряжение меняет знак угла
+            out.gates.push_back(column);
+            break;
+        default: {
+            m.resize(size_t(1) << (2 * gate.arity));
+            gate_matrix(gate, circuit, m.data());
+            for (auto& x : m) x = std::conj(x);
+            out.add_matrix(std::vector<int>(column.qubits, column.qubits + gate.arity), m.data());
+            break;
+        }
+        }
+        if (!noise.active()) continue;
+        for (int j = 0; j < gate.arity; ++j) out.add_matrix({gate.qubits[j], gate.qubits[j] + n}, channel);
+    }
+    return out;
+}
+
+// Выполнение удвоенной схемы; probabilities - диагональ rho (распределение исходов)
+template <typename Real>
+SimulationResult simulate_density(const Circuit& doubled, std::vector<double>* probabilities) {
+    auto start = std::chrono::steady_clock::now();
+    StateVector<Real> state(doubled.qubits);
+    execute_circuit(state, doubled);
+    SimulationResult result;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t dim = size_t(1) << (doubled.qubits / 2);
+    if (probabilities) probabilities->resize(dim);
+    for (size_t r = 0; r < dim; ++r) {
+        double p = state.amplitudes[r * (dim + 1)].real();
+        result.norm += p; // След
+        if (probabilities) (*probabilities)[r] = p;
+    }
+    result.probability_zero = state.amplitudes[0].real();
+    return result;
+}
+
+SimulationResult simulate_density(const Circuit& doubled, Precision precision, std::vector<double>* probabilities = nullptr) {
+    return precision == Precision::Float ? simulate_density<float>(doubled, probabilities)
+                                         : simulate_density<double>(doubled, probabilities);
+}
+
+// Признаки стоимости всех траекторий: без слияния, если вентили идут по одному,
+// и с проходами затухания (вероятность единицы и перенормировка)
+CostFeatures trajectory_cost_features(const Circuit& circuit, const NoiseModel& noise, Precision precision, int trajectories) {
+    bool fused = noise.amplitude_damping <= 0 && circuit.qubits >= trajectory_fusion_min_qubits;
+    CostFeatures cost = circuit_cost_features(circuit, precision, fused ? fusion_max_qubits : 0);
+    if (noise.amplitude_damping > 0) {
+        // Два скалярных прохода по половине вектора на кубит вентиля; операция затухания обходится еще
+        // примерно в 1/25 накладных расходов слияния на вентиль
+        double operations = 0;
+        for (const Gate& gate : circuit.gates) operations += gate.arity;
+        double threads = std::clamp(std::ldexp(1.0, circuit.qubits) / double(parallel_min_chunk), 1.0, double(simulation_threads));
+        double scalar = default_amplitudes_per_ms(simd_level) / default_amplitudes_per_ms(SimdLevel::Scalar);
+        cost.compute += scalar * operations * std::ldexp(1.0, circuit.qubits) / threads;
+        cost.gates += operations / 25;
+    }
+    cost.compute *= trajectories;
+    cost.memory *= trajectories;
+    cost.gates *= trajectories;
+    return cost;
+}
+
+// Автоматический выбор исполнителя для схемы с шумом: матрица плотности, если она
+// помещается и по модели стоимости быстрее траекторий
+Backend choose_noisy_backend(const Circuit& circuit, const NoiseModel& noise, Precision precision, int trajectories,
+                             std::shared_ptr<const Circuit>& density) {
+    if (circuit.qubits > density_max_qubits) return Backend::Trajectories;
+    auto doubled = std::make_shared<Circuit>(make_density_circuit(circuit, noise));
+    double density_ms = estimate_cost_ms(circuit_cost_features(*doubled, precision));
+    double trajectories_ms = estimate_cost_ms(trajectory_cost_features(circuit, noise, precision, trajectories));
+    if (density_ms > trajectories_ms) return Backend::Trajectories;
+    density = std::move(doubled);
+    return Backend::DensityMatrix;
+}
+
+// ===================== Распределенный вектор состояния =====================
+// Вектор схемы из 30+ кубитов делится между 2^p локальными процессами (заменитель узлов
+// кластера): старшие p кубитов - номер процесса, у каждого 2^(n-p) амплитуд. План -
+// тот же plan_blocked: вентили на локальных кубитах выполняются каждым процессом у
+// себя, вентили, диагональные по старшим кубитам, - с подставленными битами номера,
+// а перед вентилем, перемешивающим старший кубит, он меняется местами с локальным.
+// Перестановка пар (локальный, старший) - попарные обмены по сокетам: процесс r и
+// r ^ d (d = 1..2^p-1 по порядку) меняются частью вектора, в которой биты локальных
+// кубитов пар равны битам номера партнера. Обмен делится на 2^distributed_pipeline_bits
+// частей по старшим локальным кубитам: пока передается следующая часть, к пришедшей
+// уже применяются вентили следующей серии, не задевающие старшие локальные кубиты.
+
+int distributed_processes = 4;            // Процессов на задачу (степень двойки; 1 - выключено)
+const int distributed_min_qubits = 30;    // Меньшие схемы моделируются одним процессом
+const int distributed_min_local_qubits = 16; // Чтобы любому вентилю хватало локальных кубитов
+
+// Число старших кубитов (log2 процессов): не больше processes процессов, у каждого
+// не меньше distributed_min_local_qubits кубитов
+int distributed_global_qubits(int qubits, int processes) {
+    int p = 0;
+    while ((2 << p) <= processes && qubits - (p + 1) >= distributed_min_local_qubits) ++p;
+    return p;
+}
+
+bool send_all(int fd, const void* data, size_t len) {
+    const char* ptr = static_cast<const char*>(data);
+    while (len > 0) {
+        ssize_t n = ::send(fd, ptr, len, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        ptr += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool recv_all(int fd, void* data, size_t len) {
+    char* ptr = static_cast<char*>(data);
+    while (len > 0) {
+        ssize_t n = ::recv(fd, ptr, len, 0);
+        if (n <= 0) return false;
+        ptr += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Итог процесса-участника (отправляется родителю)
+struct DistributedReport {
+    double norm = 0;               // Сумма |a|^2 локальной части
+    double amplitude_zero[2] = {}; // Амплитуда |0...0> (только у процесса 0)
+    double compute_seconds = 0;    // Применение вентилей
+    double exchange_seconds = 0;   // Обмены (включая ожидание партнеров)
+    uint64_t bytes_sent = 0;
+    int exchanges = 0;             // Проходов перестановки со старшими кубитами
+    int overlapped_gates = 0;      // Вентилей, примененных во время обмена
+    double marginal_one[64] = {};  // P(кубит = 1) по локальной части, в логической нумерации кубитов
+};
+
+struct DistributedStats {
+    int processes = 1;
+    double seconds = 0;
+    double compute_seconds = 0;    // Максимум по процессам
+    double exchange_seconds = 0;   // Максимум по процессам
+    uint64_t bytes_sent = 0;       // Сумма по процессам
+    int exchanges = 0;
+    int overlapped_gates = 0;
+    std::vector<double> marginal_one; // P(кубит = 1) для каждого кубита - для сверки раскладки
+};
+
+// Серия вентилей на локальных кубитах: блоками кэша, если вектор велик
+void run_local_segment(StateVector<double>& state, const Circuit& segment) {
+    if (cache_block_qubits > 0 && state.qubits > cache_block_qubits) {
+        run_blocked(state, plan_blocked(segment, cache_block_qubits));
+    } else {
+        run_circuit(state, segment);
+    }
+}
+
+struct DistributedRank {
+    int rank, ranks, local_qubits;
+    std::vector<int> peers; // peers[r] - сокет к процессу r
+    StateVector<double> state;
+    DistributedReport report;
+
+    DistributedRank(int rank_, int ranks_, int local, std::vector<int> peers_)
+        : rank(rank_), ranks(ranks_), local_qubits(local), peers(std::move(peers_)), state(local) {
+        if (rank != 0) state.amplitudes[0] = 0;
+    }
+
+    // Вентиль, диагональный по старшим кубитам: биты номера подставляются в матрицу
+    void apply_global(const Gate& gate, const Circuit& circuit) {
+        size_t dim = size_t(1) << gate.arity;
+        std::vector<std::complex<double>> m(dim * dim);
+        gate_matrix(gate, circuit, m.data());
+        std::vector<int> targets, positions; // Локальные кубиты и их биты в индексе вентиля
+        size_t fixed = 0;
+        for (int j = 0; j < gate.arity; ++j) {
+            if (gate.qubits[j] < local_qubits) {
+                targets.push_back(gate.qubits[j]);
+                positions.push_back(j);
+            } else if ((rank >> (gate.qubits[j] - local_qubits)) & 1) {
+                fixed |= size_t(1) << j;
+            }
+        }
+        auto full = [&](size_t sub) {
+            size_t index = fixed;
+            for (size_t t = 0; t < positions.size(); ++t) index |= ((sub >> t) & 1) << positions[t];
+            return index;
+        };
+        if (targets.empty()) {
+            // Только фаза процесса
+            std::complex<double> phase = m[fixed * dim + fixed];
+            if (phase == 1.0) return;
+            parallel_for(state.size, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) state.amplitudes[i] = mul(state.amplitudes[i], phase);
+            });
+            return;
+        }
+        size_t sub_dim = size_t(1) << targets.size();
+        std::vector<std::complex<double>> sub(sub_dim * sub_dim);
+        for (size_t r = 0; r < sub_dim; ++r) {
+            for (size_t c = 0; c < sub_dim; ++c) sub[r * sub_dim + c] = m[full(r) * dim + full(c)];
+        }
+        Circuit local;
+        local.qubits = local_qubits;
+        local.add_matrix(targets, sub.data());
+        apply_gate(state, local.gates[0], local);
+    }
+
+    // Проход перестановки пар физических кубитов. prefix - вентили следующей серии,
+    // которые применяются к частям вектора по мере их прихода
+    void apply_swaps(const std::vector<std::pair<int, int>>& swaps, const Circuit* prefix) {
+        const int L = local_qubits;
+        std::vector<std::pair<int, int>> local_pairs, mixed, global_pairs; // mixed: (локальный, бит номера)
+        for (auto [a, b] : swaps) {
+            if (a > b) std::swap(a, b);
+            if (b < L) local_pairs.push_back({a, b});
+            else if (a < L) mixed.push_back({a, b - L});
+            else global_pairs.push_back({a - L, b - L});
+        }
+        auto compute_start = std::chrono::steady_clock::now();
+        if (!local_pairs.empty()) apply_qubit_swaps(state, local_pairs);
+        report.compute_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - compute_start).count();
+        if (mixed.empty() && global_pairs.empty()) {
+            if (prefix) run_local_segment(state, *prefix);
+            return;
+        }
+
+        // Партнеры: номер после перестановки битов номера, биты смешанных пар - любые
+        std::vector<int> partners;
+        for (int d = 1; d < ranks; ++d) {
+            int other = rank ^ d;
+            bool valid = true;
+            for (auto [g1, g2] : global_pairs) {
+                valid = valid && ((other >> g1) & 1) == ((rank >> g2) & 1) && ((other >> g2) & 1) == ((rank >> g1) & 1);
+            }
+            int free_bits = ranks - 1;
+            for (auto [g1, g2] : global_pairs) free_bits &= ~((1 << g1) | (1 << g2));
+            for (auto [l, g] : mixed) free_bits &= ~(1 << g);
+            valid = valid && ((other ^ rank) & free_bits) == 0;
+            if (valid) partners.push_back(other);
+        }
+        // Часть обмена с партнером: индексы со значениями битов смешанных пар, равными битам
+        // номера партнера, - 2^(L - |mixed|) амплитуд отрезками по 2^(младший бит) подряд
+        std::vector<int> bits;
+        for (auto [l, g] : mixed) bits.push_back(l);
+        std::sort(bits.begin(), bits.end());
+        const int low = bits.empty() ? L - distributed_pipeline_bits : bits.front();
+        const int pieces = 1 << distributed_pipeline_bits;
+        const size_t run = size_t(1) << low;
+        const size_t piece_elements = (size_t(1) << (L - mixed.size())) / pieces;
+        const size_t runs_per_piece = piece_elements / run;
+        auto run_offset = [&](int other, size_t run_index) { // Начало отрезка в локальном векторе
+            size_t index = run_index << low;
+            for (int bit : bits) index = insert_zero_bit(index, bit);
+            for (auto [l, g] : mixed) index |= size_t((other >> g) & 1) << l;
+            return index;
+        };
+
+        auto exchange_start = std::chrono::steady_clock::now();
+        const size_t units = size_t(pieces) * partners.size();
+        std::atomic<size_t> packed(0); // Сколько частей отправитель уже скопировал из вектора
+        std::mutex ready_mutex;
+        std::condition_variable ready_cv;
+        size_t pieces_ready = 0;
+        std::atomic<bool> failed(false);
+        auto* amp = state.amplitudes;
+
+        std::thread sender([&] {
+            std::vector<std::complex<double>> buffer(piece_elements);
+            for (size_t unit = 0; unit < units; ++unit) {
+                int other = partners[unit % partners.size()];
+                size_t first = (unit / partners.size()) * runs_per_piece;
+                for (size_t k = 0; k < runs_per_piece; ++k) {
+                    std::copy_n(amp + run_offset(other, first + k), run, buffer.data() + k * run);
+                }
+                packed.store(unit + 1, std::memory_order_release);
+                if (!send_all(peers[other], buffer.data(), piece_elements * sizeof(buffer[0]))) failed = true;
+            }
+        });
+        std::thread receiver([&] {
+            std::vector<std::complex<double>> buffer(piece_elements);
+            for (size_t unit = 0; unit < units; ++unit) {
+                int other = partners[unit % partners.size()];
+                size_t first = (unit / partners.size()) * runs_per_piece;
+                if (!recv_all(peers[other], buffer.data(), piece_elements * sizeof(buffer[0]))) failed = true;
+                while (packed.load(std::memory_order_acquire) <= unit) std::this_thread::yield();
+                for (size_t k = 0; k < runs_per_piece; ++k) {
+                    std::copy_n(buffer.data() + k * run, run, amp + run_offset(other, first + k));
+                }
+                if ((unit + 1) % partners.size() == 0) {
+                    std::lock_guard<std::mutex> ready_lock(ready_mutex);
+                    pieces_ready++;
+                    ready_cv.notify_one();
+                }
+            }
+        });
+        // Вентили следующей серии - к каждой части, как только она пришла
+        double overlapped = 0;
+        if (prefix) {
+            const int piece_qubits = L - distributed_pipeline_bits;
+            for (int piece = 0; piece < pieces; ++piece) {
+                {
+                    std::unique_lock<std::mutex> ready_lock(ready_mutex);
+                    ready_cv.wait(ready_lock, [&] { return pieces_ready > size_t(piece); });
+                }
+                auto start = std::chrono::steady_clock::now();
+                StateVector<double> part(amp + (size_t(piece) << piece_qubits), piece_qubits);
+                run_local_segment(part, *prefix);
+                overlapped += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+            report.overlapped_gates += static_cast<int>(prefix->gates.size());
+        }
+        sender.join();
+        receiver.join();
+        if (failed) throw std::runtime_error("distributed exchange failed");
+        report.compute_seconds += overlapped;
+        report.exchange_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - exchange_start).count() - overlapped;
+        report.bytes_sent += units * piece_elements * sizeof(std::complex<double>);
+        report.exchanges++;
+    }
+
+    void run(const BlockedPlan& plan) {
+        const int L = local_qubits;
+        for (size_t r = 0; r < plan.runs.size(); ++r) {
+            const BlockedRun& current = plan.runs[r];
+            if (current.kind == RunKind::Swap) {
+                // Начало следующей серии, не задевающее старшие локальные кубиты, - во время обмена
+                Circuit prefix;
+                prefix.qubits = L - distributed_pipeline_bits;
+                prefix.matrices = plan.physical.matrices;
+                size_t skip = 0;
+                if (r + 1 < plan.runs.size() && plan.runs[r + 1].kind == RunKind::Local) {
+                    const BlockedRun& next = plan.runs[r + 1];
+                    for (size_t g = next.begin; g < next.end; ++g) {
+                        const Gate& gate = plan.physical.gates[g];
+                        if (*std::max_element(gate.qubits, gate.qubits + gate.arity) >= prefix.qubits) break;
+                        prefix.gates.push_back(gate);
+                    }
+                    skip = prefix.gates.size();
+                }
+                apply_swaps(current.swaps, skip > 0 ? &prefix : nullptr);
+                if (skip > 0) {
+                    // Остаток серии - обычным порядком
+                    const BlockedRun& next = plan.runs[++r];
+                    run_segment(plan, next.begin + skip, next.end);
+                }
+                continue;
+            }
+            if (current.kind == RunKind::Local) {
+                run_segment(plan, current.begin, current.end);
+                continue;
+            }
+            auto start = std::chrono::steady_clock::now();
+            for (size_t g = current.begin; g < current.end; ++g) {
+                const Gate& gate = plan.physical.gates[g];
+                bool local = *std::max_element(gate.qubits, gate.qubits + gate.arity) < L;
+                if (local) apply_gate(state, gate, plan.physical);
+                else apply_global(gate, plan.physical);
+            }
+            report.compute_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        double norm = 0;
+        for (size_t i = 0; i < state.size; ++i) norm += std::norm(state.amplitudes[i]);
+        report.norm = norm;
+        if (rank == 0) {
+            report.amplitude_zero[0] = state.amplitudes[0].real();
+            report.amplitude_zero[1] = state.amplitudes[0].imag();
+        }
+    }
+
+    void run_segment(const BlockedPlan& plan, size_t begin, size_t end) {
+        if (begin >= end) return;
+        auto start = std::chrono::steady_clock::now();
+        Circuit segment;
+        segment.qubits = local_qubits;
+        segment.matrices = plan.physical.matrices;
+        segment.gates.assign(plan.physical.gates.begin() + begin, plan.physical.gates.begin() + end);
+        run_local_segment(state, segment);
+        report.compute_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+// Процесс-участник: выполнение плана, отчет родителю, затем выборка назначенных ему шотов
+int run_distributed_rank(int rank, int ranks, const BlockedPlan& plan, std::vector<int> peers, int parent_fd) {
+    DistributedRank node(rank, ranks, plan.local_qubits, std::move(peers));
+    try {
+        node.run(plan);
+    } catch (const std::exception&) {
+        return 1;
+    }
+    // Маргинальные вероятности: старшие (глобальные) кубиты задаются номером процесса
+    for (size_t i = 0; i < node.state.size; ++i) {
+        double probability = std::norm(node.state.amplitudes[i]);
+        for (int q = 0; q < plan.local_qubits; ++q) {
+            if ((i >> q) & 1) node.report.marginal_one[q] += probability;
+        }
+    }
+    for (int g = 0; (1 << g) < ranks; ++g) {
+        if ((rank >> g) & 1) node.report.marginal_one[plan.local_qubits + g] = node.report.norm;
+    }
+    if (!send_all(parent_fd, &node.report, sizeof(node.report))) return 1;
+    int64_t shots = 0;
+    if (!recv_all(parent_fd, &shots, sizeof(shots))) return 1;
+    std::vector<std::pair<uint64_t, uint64_t>> counts;
+    if (shots > 0) {
+        std::vector<double> probabilities(node.state.size);
+        for (size_t i = 0; i < node.state.size; ++i) probabilities[i] = std::norm(node.state.amplitudes[i]);
+        auto sampler = make_sampler(probabilities, static_cast<int>(shots));
+        std::seed_seq seed{uint64_t(rank), uint64_t(shots), uint64_t(123)};
+        std::mt19937_64 gen(seed);
+        ShotHistogram local;
+        for (int64_t s = 0; s < shots; ++s) local[(uint64_t(rank) << plan.local_qubits) | sampler->sample(gen)]++;
+        counts.assign(local.begin(), local.end());
+    }
+    uint64_t size = counts.size();
+    if (!send_all(parent_fd, &size, sizeof(size))) return 1;
+    return send_all(parent_fd, counts.data(), size * sizeof(counts[0])) ? 0 : 1;
+}
+
+// Моделирование схемы processes процессами (степень двойки). Процессы порождаются fork:
+// дочерний процесс только считает и обменивается через сокеты, не трогая мьютексов родителя.
+// shots > 0 - шоты делятся между процессами по их доле нормы (histogram)
+SimulationResult simulate_distributed(const Circuit& circuit, int processes, DistributedStats* stats = nullptr,
+                                      int shots = 0, ShotHistogram* histogram = nullptr) {
+    auto start = std::chrono::steady_clock::now();
+    const int p = distributed_global_qubits(circuit.qubits, processes);
+    const int ranks = 1 << p;
+    Circuit fused = fusion_max_qubits > 1 ? fuse_circuit(circuit, fusion_max_qubits) : circuit;
+    BlockedPlan plan = plan_blocked(fused, circuit.qubits - p, true);
+
+    // Полная сетка сокетов между процессами и сокет к каждому процессу от родителя
+    std::vector<std::vector<int>> peers(ranks, std::vector<int>(ranks, -1));
+    std::vector<int> parent_fds(ranks, -1);
+    std::vector<pid_t> pids;
+    // Ошибка запуска: закрываем сокеты, останавливаем уже запущенные процессы
+    auto abort_start = [&](const char* what) {
+        for (auto& row : peers) {
+            for (int fd : row) {
+                if (fd >= 0) close(fd);
+            }
+        }
+        for (int fd : parent_fds) {
+            if (fd >= 0) close(fd);
+        }
+        for (pid_t pid : pids) {
+            kill(pid, SIGKILL);
+            waitpid(pid, nullptr, 0);
+        }
+        throw std::runtime_error(what);
+    };
+    for (int a = 0; a < ranks; ++a) {
+        for (int b = a + 1; b < ranks; ++b) {
+            int sv[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) abort_start("socketpair failed");
+            peers[a][b] = sv[0];
+            peers[b][a] = sv[1];
+        }
+    }
+    std::cout.flush();
+    for (int r = 0; r < ranks; ++r) {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) abort_start("socketpair failed");
+        pid_t pid = fork();
+        if (pid < 0) {
+            close(sv[0]);
+            close(sv[1]);
+            abort_start("fork failed");
+        }
+        if (pid == 0) {
+            // Мьютекс пула мог быть захвачен другим потоком родителя в момент fork
+            amplitude_pool_enabled = false;
+            close(sv[0]);
+            for (int other = 0; other < r; ++other) close(parent_fds[other]);
+            for (int a = 0; a < ranks; ++a) {
+                for (int b = 0; b < ranks; ++b) {
+                    if (a != r && peers[a][b] >= 0) close(peers[a][b]);
+                }
+            }
+            std::_Exit(run_distributed_rank(r, ranks, plan, peers[r], sv[1]));
+        }
+        close(sv[1]);
+        parent_fds[r] = sv[0];
+        pids.push_back(pid);
+    }
+    for (auto& row : peers) {
+        for (int fd : row) {
+            if (fd >= 0) close(fd);
+        }
+    }
+
+    SimulationResult result;
+    DistributedStats total;
+    total.processes = ranks;
+    total.marginal_one.assign(circuit.qubits, 0.0);
+    std::vector<DistributedReport> reports(ranks);
+    bool ok = true;
+    for (int r = 0; r < ranks; ++r) {
+        ok = recv_all(parent_fds[r], &reports[r], sizeof(DistributedReport)) && ok;
+        result.norm += reports[r].norm;
+        for (int q = 0; q < circuit.qubits; ++q) total.marginal_one[q] += reports[r].marginal_one[q];
+        total.compute_seconds = std::max(total.compute_seconds, reports[r].compute_seconds);
+        total.exchange_seconds = std::max(total.exchange_seconds, reports[r].exchange_seconds);
+        total.bytes_sent += reports[r].bytes_sent;
+        total.exchanges = std::max(total.exchanges, reports[r].exchanges);
+        total.overlapped_gates = std::max(total.overlapped_gates, reports[r].overlapped_gates);
+    }
+    result.probability_zero = std::norm(std::complex<double>(reports[0].amplitude_zero[0], reports[0].amplitude_zero[1]));
+    // Число шотов процесса - по его доле нормы
+    std::mt19937_64 gen(static_cast<uint64_t>(circuit.gates.size()));
+    int64_t left = shots;
+    double mass = result.norm;
+    for (int r = 0; r < ranks; ++r) {
+        int64_t count = 0;
+        if (r == ranks - 1) {
+            count = left;
+        } else if (left > 0 && mass > 0) {
+            count = std::binomial_distribution<int64_t>(left, std::clamp(reports[r].norm / mass, 0.0, 1.0))(gen);
+        }
+        left -= count;
+        mass -= reports[r].norm;
+        ok = send_all(parent_fds[r], &count, sizeof(count)) && ok;
+    }
+    for (int r = 0; r < ranks; ++r) {
+        uint64_t size = 0;
+        ok = recv_all(parent_fds[r], &size, sizeof(size)) && ok;
+        std::vector<std::pair<uint64_t, uint64_t>> counts(ok ? size : 0);
+        ok = recv_all(parent_fds[r], counts.data(), counts.size() * sizeof(counts[0])) && ok;
+        if (histogram) {
+            for (const auto& [outcome, count] : counts) (*histogram)[outcome] += count;
+        }
+        close(parent_fds[r]);
+    }
+    for (pid_t pid : pids) {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    if (!ok) throw std::runtime_error("distributed simulation failed");
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    total.seconds = result.seconds;
+    if (stats) *stats = total;
+    return result;
+}
+
+// ===================== Контрольные точки и вытеснение =====================
+// Длинная схема выполняется отрезками вентилей (примерно по preempt_check_ms). Между
+// отрезками задача проверяет, не ждет ли в очереди задача более высокого приоритета
+// (или критическая при том же приоритете); если ждет, вектор и номер следующего вентиля
+// сбрасываются в файл, память освобождается, а задача возвращается в очередь и
+// продолжается с этого места на любом процессоре. Файл пишется через mmap параллельно
+// кусками по checkpoint_chunk_bytes: у каждого куска свое место, поэтому потоки не
+// согласуют смещения. Сжатие без потерь рассчитано на разреженные векторы: нулевой
+// кусок не пишется вовсе (остается дырой файла), кусок с малой долей ненулевых слов
+// хранится битовой маской и самими словами. Плотный случайный вектор не сжимается.
+
+std::string checkpoint_dir = "/tmp";
+bool checkpoint_compression = true;
+bool preemption_enabled = true;
+const size_t checkpoint_chunk_bytes = size_t(1) << 20;
+const int preempt_check_ms = 50;       // Длительность отрезка между проверками
+const int preempt_min_duration_ms = 200; // Более короткие задачи не вытесняются
+const int max_preemptions = 3;         // Чтобы низкоприоритетная задача не голодала
+
+struct Checkpoint {
+    std::string path;
+    size_t next_gate = 0;      // Счетчик команд: первый невыполненный вентиль исходной схемы
+    int qubits = 0;
+    size_t raw_bytes = 0;
+    size_t stored_bytes = 0;   // Байт данных в файле после сжатия
+    double write_seconds = 0;
+};
+
+struct CheckpointHeader {
+    uint32_t magic;
+    uint32_t amplitude_bytes; // sizeof(complex<Real>)
+    int32_t qubits;
+    uint32_t chunks;
+    uint64_t next_gate;
+    uint64_t chunk_bytes;
+};
+
+enum class ChunkKind : uint32_t { Raw, Zero, Sparse };
+
+struct ChunkEntry {
+    ChunkKind kind;
+    uint32_t stored; // Байт в слоте куска
+};
+
+const uint32_t checkpoint_magic = 0x504b4351; // "QCKP"
+const size_t checkpoint_page = 4096;
+
+// Слот куска: данные или маска (бит на 8-байтовое слово) и ненулевые слова
+size_t checkpoint_slot_bytes(size_t chunk) {
+    return (chunk + chunk / 64 + checkpoint_page - 1) / checkpoint_page * checkpoint_page;
+}
+
+size_t checkpoint_data_offset(uint32_t chunks) {
+    size_t table = sizeof(CheckpointHeader) + chunks * sizeof(ChunkEntry);
+    return (table + checkpoint_page - 1) / checkpoint_page * checkpoint_page;
+}
+
+size_t compress_chunk(const uint64_t* words, size_t count, char* out, ChunkKind& kind) {
+    size_t nonzero = 0;
+    for (size_t i = 0; i < count; ++i) nonzero += words[i] != 0;
+    if (nonzero == 0) {
+        kind = ChunkKind::Zero;
+        return 0;
+    }
+    size_t mask_bytes = (count + 7) / 8;
+    if (mask_bytes + nonzero * 8 >= count * 8) {
+        kind = ChunkKind::Raw;
+        std::memcpy(out, words, count * 8);
+        return count * 8;
+    }
+    kind = ChunkKind::Sparse;
+    std::vector<uint8_t> mask(mask_bytes, 0);
+    uint64_t* packed = reinterpret_cast<uint64_t*>(out + (mask_bytes + 7) / 8 * 8);
+    size_t k = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (words[i] == 0) continue;
+        mask[i / 8] |= uint8_t(1u << (i % 8));
+        packed[k++] = words[i];
+    }
+    std::memcpy(out, mask.data(), mask_bytes);
+    return (mask_bytes + 7) / 8 * 8 + k * 8;
+}
+
+void decompress_chunk(const char* in, ChunkKind kind, uint64_t* words, size_t count) {
+    if (kind == ChunkKind::Zero) {
+        std::fill(words, words + count, 0);
+    } else if (kind == ChunkKind::Raw) {
+        std::memcpy(words, in, count * 8);
+    } else {
+        size_t mask_bytes = (count + 7) / 8;
+        const uint8_t* mask = reinterpret_cast<const uint8_t*>(in);
+        const uint64_t* packed = reinterpret_cast<const uint64_t*>(in + (mask_bytes + 7) / 8 * 8);
+        size_t k = 0;
+        for (size_t i = 0; i < count; ++i) words[i] = (mask[i / 8] >> (i % 8)) & 1 ? packed[k++] : 0;
+    }
+}
+
+template <typename Real>
+std::shared_ptr<Checkpoint> write_checkpoint(const StateVector<Real>& state, const std::string& path, size_t next_gate) {
+    auto start = std::chrono::steady_clock::now();
+    const size_t raw = state.size * sizeof(std::complex<Real>);
+    const size_t chunk = std::min(checkpoint_chunk_bytes, raw);
+    const uint32_t chunks = static_cast<uint32_t>((raw + chunk - 1) / chunk);
+    const size_t slot = checkpoint_slot_bytes(chunk);
+    const size_t data = checkpoint_data_offset(chunks);
+    const size_t file_bytes = data + chunks * slot;
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) return nullptr;
+    // Файл заводится разреженным: страницы, которых никто не коснулся, не занимают диск
+    if (ftruncate(fd, static_cast<off_t>(file_bytes)) != 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    void* mapped = mmap(nullptr, file_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) return nullptr;
+    char* base = static_cast<char*>(mapped);
+    auto* header = reinterpret_cast<CheckpointHeader*>(base);
+    *header = {checkpoint_magic, uint32_t(sizeof(std::complex<Real>)), state.qubits, chunks, next_gate, chunk};
+    auto* table = reinterpret_cast<ChunkEntry*>(base + sizeof(CheckpointHeader));
+    const char* source = reinterpret_cast<const char*>(state.amplitudes);
+
+    std::atomic<size_t> stored(0);
+    parallel_for(chunks, [&](size_t begin, size_t end) {
+        size_t local = 0;
+        for (size_t c = begin; c < end; ++c) {
+            size_t bytes = std::min(chunk, raw - c * chunk);
+            char* out = base + data + c * slot;
+            ChunkEntry entry{ChunkKind::Raw, uint32_t(bytes)};
+            if (checkpoint_compression && bytes % 8 == 0) {
+                entry.stored = static_cast<uint32_t>(
+                    compress_chunk(reinterpret_cast<const uint64_t*>(source + c * chunk), bytes / 8, out, entry.kind));
+            } else {
+                std::memcpy(out, source + c * chunk, bytes);
+            }
+            table[c] = entry;
+            local += entry.stored;
+        }
+        stored += local;
+    }, 1);
+    munmap(mapped, file_bytes);
+
+    auto checkpoint = std::make_shared<Checkpoint>();
+    checkpoint->path = path;
+    checkpoint->next_gate = next_gate;
+    checkpoint->qubits = state.qubits;
+    checkpoint->raw_bytes = raw;
+    checkpoint->stored_bytes = stored;
+    checkpoint->write_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return checkpoint;
+}
+
+// Чтение в вектор того же размера; файл удаляется после чтения
+template <typename Real>
+bool read_checkpoint(const Checkpoint& checkpoint, StateVector<Real>& state) {
+    int fd = ::open(checkpoint.path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info {};
+    if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(CheckpointHeader)) {
+        ::close(fd);
+        return false;
+    }
+    size_t file_bytes = static_cast<size_t>(info.st_size);
+    void* mapped = mmap(nullptr, file_bytes, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) return false;
+    const char* base = static_cast<const char*>(mapped);
+    const auto* header = reinterpret_cast<const CheckpointHeader*>(base);
+    const size_t raw = state.size * sizeof(std::complex<Real>);
+    bool ok = header->magic == checkpoint_magic && header->amplitude_bytes == sizeof(std::complex<Real>) &&
+              header->qubits == state.qubits &&
+              header->chunks * header->chunk_bytes >= raw &&
+              checkpoint_data_offset(header->chunks) + header->chunks * checkpoint_slot_bytes(header->chunk_bytes) <= file_bytes;
+    if (ok) {
+        const size_t chunk = header->chunk_bytes;
+        const size_t slot = checkpoint_slot_bytes(chunk);
+        const size_t data = checkpoint_data_offset(header->chunks);
+        const auto* table = reinterpret_cast<const ChunkEntry*>(base + sizeof(CheckpointHeader));
+        char* target = reinterpret_cast<char*>(state.amplitudes);
+        parallel_for(header->chunks, [&](size_t begin, size_t end) {
+            for (size_t c = begin; c < end; ++c) {
+                size_t bytes = std::min(chunk, raw - c * chunk);
+                const char* in = base + data + c * slot;
+                if (table[c].kind == ChunkKind::Raw && bytes % 8 != 0) {
+                    std::memcpy(target + c * chunk, in, bytes);
+                } else {
+                    decompress_chunk(in, table[c].kind, reinterpret_cast<uint64_t*>(target + c * chunk), bytes / 8);
+                }
+            }
+        }, 1);
+    }
+    munmap(mapped, file_bytes);
+    ::unlink(checkpoint.path.c_str());
+    return ok;
+}
+
+// Ждет ли задача, которой стоит уступить процессор (под queue_mutex)
+bool should_preempt(const QuantumTask& task) {
+    if (!preemption_enabled || task.is_critical || task.preemptions >= max_preemptions) return false;
+    auto outranks = [&](const QuantumTask& waiting) {
+        return waiting.priority < task.priority ||
+               (waiting.priority == task.priority && waiting.is_critical && !task.is_critical);
+    };
+    std::lock_guard<std::mutex> queue_lock(queue_mutex);
+    if (!task_queue.empty() && outranks(task_queue.top())) return true;
+    for (const QuantumTask& waiting : memory_delayed) {
+        if (outranks(waiting)) return true;
+    }
+    return false;
+}
+
+// Задача вытесняемая: обычная схема на векторе состояния, достаточно длинная
+bool task_preemptible(const QuantumTask& task) {
+    return preemption_enabled && task.circuit && task.backend == Backend::StateVector && !task.cut_job &&
+           !task.shot_job && !task.trajectory_job && (task.checkpoint || task.duration >= preempt_min_duration_ms);
+}
+
+std::vector<std::pair<int, SimulationResult>> preemptible_results; // id задачи -> результат (под output_mutex)
+
+// Выполнение схемы отрезками с возможной приостановкой. Возвращает false, если задача
+// вытеснена: тогда suspended - ее контрольная точка. Если контрольную точку прочитать
+// не удалось, схема выполняется заново, а из задачи убирается checkpoint
+template <typename Real>
+bool simulate_preemptible(QuantumTask& task, SimulationResult& result, std::vector<double>* probabilities,
+                          std::shared_ptr<const Checkpoint>& suspended) {
+    auto start = std::chrono::steady_clock::now();
+    const Circuit& circuit = *task.circuit;
+    StateVector<Real> state(circuit.qubits);
+    size_t pc = 0;
+    if (task.checkpoint && read_checkpoint(*task.checkpoint, state)) {
+        pc = task.checkpoint->next_gate;
+    } else if (task.checkpoint) {
+        {
+            std::lock_guard<std::mutex> out_lock(output_mutex);
+            std::cout << "Task " << task_name(task) << ": cannot read checkpoint " << task.checkpoint->path
+                      << ", restarting from gate 0" << std::endl;
+        }
+        ::unlink(task.checkpoint->path.c_str());
+        task.checkpoint = nullptr;
+        task.duration = estimate_duration_ms(task.cost);
+        state.reset();
+    }
+    const size_t total = circuit.gates.size();
+    // duration - оценка оставшейся части; отрезок - доля вентилей на preempt_check_ms
+    const size_t step = std::max<size_t>(1, (total - pc) * preempt_check_ms / std::max(task.duration, 1));
+    Circuit segment;
+    segment.qubits = circuit.qubits;
+    segment.matrices = circuit.matrices;
+    while (pc < total) {
+        size_t end = std::min(total, pc + step);
+        segment.gates.assign(circuit.gates.begin() + pc, circuit.gates.begin() + end);
+        execute_circuit(state, segment);
+        pc = end;
+        if (pc < total && should_preempt(task)) {
+            std::string path = checkpoint_dir + "/qtask_" + std::to_string(getpid()) + "_" + task_name(task) + ".ckpt";
+            auto checkpoint = write_checkpoint(state, path, pc);
+            if (!checkpoint) continue; // Не удалось записать - работаем дальше
+            suspended = std::move(checkpoint);
+            result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return false;
+        }
+    }
+    summarize_state(state, result, probabilities);
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+// ===================== Сборка разрезанных схем =====================
+// Результат разрезанной схемы после классической сборки
+struct CutResult {
+    double norm = 0;               // Должна быть равна 1
+    double probability_zero = 0;
+    std::vector<double> distribution; // Полное распределение (если собиралось)
+    double seconds = 0;            // От разрезания до конца сборки
+};
+
+std::vector<std::pair<int, CutResult>> cut_results; // id задачи -> результат (под output_mutex)
+
+// Выполнение варианта фрагмента: сумма вероятностей, P(0) и при необходимости все вероятности
+void run_cut_fragment(const QuantumTask& task) {
+    CutJob& job = *task.cut_job;
+    StateVector<double> state(task.circuit->qubits);
+    execute_circuit(state, *task.circuit);
+    std::vector<double> probabilities(state.size);
+    parallel_for(state.size, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) probabilities[i] = std::norm(state.amplitudes[i]);
+    });
+    double total = 0;
+    for (double p : probabilities) total += p;
+    job.total[task.cut_fragment][task.cut_variant] = total;
+    job.zero[task.cut_fragment][task.cut_variant] = probabilities[0];
+    if (job.full_distribution) job.probabilities[task.cut_fragment][task.cut_variant] = std::move(probabilities);
+}
+
+// Классическая сборка: сумма по 10^k слагаемым, полное распределение - строками параллельно
+CutResult reconstruct_cut(const CutJob& job) {
+    struct Combo { int a, b; double coef; };
+    std::vector<Combo> combos = {{0, 0, 1.0}};
+    int weight = 1;
+    for (size_t k = 0; k < job.plan->cut_gates.size(); ++k) {
+        std::vector<Combo> next;
+        for (const Combo& c : combos) {
+            for (const CutTerm& t : cut_terms) {
+                next.push_back({c.a + static_cast<int>(t.a) * weight, c.b + static_cast<int>(t.b) * weight, c.coef * t.coef});
+            }
+        }
+        combos = std::move(next);
+        weight *= cut_op_count;
+    }
+
+    CutResult result;
+    for (const Combo& c : combos) {
+        result.norm += c.coef * job.total[0][c.a] * job.total[1][c.b];
+        result.probability_zero += c.coef * job.zero[0][c.a] * job.zero[1][c.b];
+    }
+    if (job.full_distribution) {
+        int split = job.plan->split;
+        size_t row_size = size_t(1) << split;
+        size_t rows = size_t(1) << (job.circuit->qubits - split);
+        result.distribution.assign(rows * row_size, 0.0);
+        parallel_for(rows, [&](size_t begin, size_t end) {
+            for (size_t row = begin; row < end; ++row) {
+                double* out = result.distribution.data() + row * row_size;
+                for (const Combo& c : combos) {
+                    double w = c.coef * job.probabilities[1][c.b][row];
+                    if (w == 0) continue;
+                    const double* pa = job.probabilities[0][c.a].data();
+                    for (size_t x = 0; x < row_size; ++x) out[x] += w * pa[x];
+                }
+            }
+        }, std::max<size_t>(1, parallel_min_chunk >> split));
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - job.started).count();
+    return result;
+}
+
+// Разрезание задачи: по подзадаче на каждый вариант каждого фрагмента
+std::vector<QuantumTask> cut_task(const QuantumTask& original_task) {
+    auto job = std::make_shared<CutJob>();
+    job->task_id = original_task.id;
+    job->circuit = original_task.circuit;
+    job->plan = original_task.cut_plan;
+    job->variants = 1;
+    for (size_t k = 0; k < job->plan->cut_gates.size(); ++k) job->variants *= cut_op_count;
+    job->full_distribution = original_task.circuit->qubits <= cut_full_distribution_qubits;
+    job->shots = original_task.shots;
+    job->started = std::chrono::steady_clock::now();
+    // Память распределений резервируется до освобождения памяти исходной задачи,
+    // в которую она уже входит, поэтому бюджет не превышается
+    size_t job_bytes = cut_job_memory_bytes(*job->circuit, *job->plan, job->shots);
+    if (job_bytes > 0) job->memory = std::make_shared<MemoryReservation>(job_bytes);
+    for (int f = 0; f < 2; ++f) {
+        job->total[f].assign(job->variants, 0.0);
+        job->zero[f].assign(job->variants, 0.0);
+        job->probabilities[f].resize(job->full_distribution ? job->variants : 0);
+    }
+    job->remaining = 2 * job->variants;
+
+    std::vector<QuantumTask> parts;
+    for (int f = 0; f < 2; ++f) {
+        for (int v = 0; v < job->variants; ++v) {
+            QuantumTask part = original_task;
+            part.subtask = 1 + f * job->variants + v;
+            part.precision = Precision::Double; // Фрагменты всегда моделируются в double
+            part.circuit = std::make_shared<Circuit>(make_fragment_circuit(*original_task.circuit, *job->plan, f, v));
+            part.required_qubits = part.circuit->qubits;
+            part.cost = circuit_cost_features(*part.circuit, Precision::Double);
+            part.duration = estimate_duration_ms(part.cost);
+            part.is_split = true;
+            part.cut_job = job;
+            part.cut_fragment = f;
+            part.cut_variant = v;
+            part.shots = 0;
+            parts.push_back(part);
+        }
+    }
+    return parts;
+}
+
+// Завершение варианта; последний вариант собирает результат
+void finish_cut_fragment(const QuantumTask& task) {
+    if (task.cut_job->remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+    const CutJob& job = *task.cut_job;
+    CutResult result = reconstruct_cut(job);
+    {
+        std::lock_guard<std::mutex> out_lock(output_mutex);
+        std::cout << "Task " << job.task_id << " reconstructed from " << 2 * job.variants
+                  << " fragment runs (" << job.plan->cut_gates.size() << " cuts) in "
+                  << result.seconds * 1000 << "ms, norm " << result.norm << ", P(0) " << result.probability_zero << std::endl;
+        if (job.shots > 0 && !job.full_distribution) {
+            std::cout << "Task " << job.task_id << ": " << job.shots << " shots skipped, distribution of "
+                      << job.circuit->qubits << " qubits is not reconstructed" << std::endl;
+        }
+    }
+    if (job.shots > 0 && job.full_distribution) {
+        // Квазивероятности сборки могут быть чуть ниже нуля - выборщик их отсекает
+        QuantumTask parent = task;
+        parent.id = job.task_id;
+        parent.shots = job.shots;
+        dispatch_shots(parent, make_sampler(result.distribution, job.shots));
+    }
+    std::lock_guard<std::mutex> out_lock(output_mutex);
+    cut_results.emplace_back(job.task_id, std::move(result));
+}
+
+// Функция для обработки задачи на квантовом процессоре
+void process_quantum_task(QuantumTask task, int processor_id) {
+    // Проверяем, не вышел ли процессор из строя
+    if (processor_id == failed_processor.load()) {
+        std::lock_guard<std::mutex> out_lock(output_mutex);
+        std::cout << "Task " << task_name(task) << " failed on processor " << processor_id 
+                  << " (processor broken)" << std::endl;
+        return;
+    }
+
+    // Захватываем процессор
+    quantum_processors.acquire();
+    dispatch_latency.record(task.enqueued_at);
+    
+    if (verbose_log) {
+        std::lock_guard<std::mutex> out_lock(output_mutex);
+        std::cout << "Processor " << processor_id << ": Task " << task_name(task) 
+                  << " (priority " << task.priority 
+                  << (task.is_critical ? ", CRITICAL" : "") 
+                  << ") started. Duration: " << task.duration << "ms" 
+                  << (task.is_split ? " (split task)" : "") << std::endl;
+    }
+
+    // Выполнение схемы на симуляторе или имитация выполнения задачи
+    SimulationResult result;
+    MpsResult mps_result;
+    std::shared_ptr<const ShotSampler> sampler;
+    std::shared_ptr<const Checkpoint> suspended; // Задача вытеснена
+    if (task.trajectory_job) {
+        auto start = std::chrono::steady_clock::now();
+        task.precision == Precision::Float ? run_trajectory_batch<float>(task) : run_trajectory_batch<double>(task);
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } else if (task.shot_job) {
+        auto start = std::chrono::steady_clock::now();
+        run_shot_subtask(task);
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } else if (task.cut_job) {
+        auto start = std::chrono::steady_clock::now();
+        run_cut_fragment(task);
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } else if (task.backend == Backend::Distributed) {
+        ShotHistogram histogram;
+        DistributedStats stats;
+        try {
+            result = simulate_distributed(*task.circuit, distributed_processes, &stats, task.shots, &histogram);
+        } catch (const std::exception& e) {
+            // Сбой процесса или сокета: задача завершается ошибкой, память освобождает вызывающий
+            quantum_processors.release();
+            std::lock_guard<std::mutex> out_lock(output_mutex);
+            std::cout << "Task " << task_name(task) << " failed: " << e.what() << std::endl;
+            return;
+        }
+        if (task.shots > 0) {
+            std::vector<std::pair<uint64_t, uint64_t>> top(histogram.begin(), histogram.end());
+            std::sort(top.begin(), top.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+            std::lock_guard<std::mutex> out_lock(output_mutex);
+            std::cout << "Task " << task.id << ": " << task.shots << " shots from " << stats.processes
+                      << " processes, " << histogram.size() << " distinct outcomes, top:";
+            for (size_t i = 0; i < std::min<size_t>(3, top.size()); ++i) {
+                std::cout << " " << top[i].first << "x" << top[i].second;
+            }
+            std::cout << std::endl;
+            shot_results.emplace_back(task.id, std::move(histogram));
+        }
+    } else if (task.backend == Backend::MPS) {
+        mps_result = simulate_mps(*task.circuit, task.shots, static_cast<uint64_t>(task.id));
+        result.norm = mps_result.norm;
+        result.probability_zero = mps_result.probability_zero;
+        result.seconds = mps_result.seconds;
+    } else if (task.backend == Backend::DensityMatrix) {
+        std::vector<double> probabilities;
+        result = simulate_density(*task.circuit, task.precision, task.shots > 0 ? &probabilities : nullptr);
+        if (task.shots > 0) sampler = make_sampler(probabilities, task.shots);
+    } else if (task_preemptible(task)) {
+        std::vector<double> probabilities;
+        auto* distribution = task.shots > 0 ? &probabilities : nullptr;
+        bool finished = task.precision == Precision::Float
+                            ? simulate_preemptible<float>(task, result, distribution, suspended)
+                            : simulate_preemptible<double>(task, result, distribution, suspended);
+        if (finished && task.shots > 0) sampler = make_sampler(probabilities, task.shots);
+        if (finished) {
+            std::lock_guard<std::mutex> out_lock(output_mutex);
+            preemptible_results.emplace_back(task.id, result);
+        }
+    } else if (task.circuit && task.shots > 0) {
+        // Схема моделируется один раз, шоты раздаются подзадачам
+        std::vector<double> probabilities;
+        result = simulate_circuit(*task.circuit, task.precision, &probabilities);
+        sampler = make_sampler(probabilities, task.shots);
+    } else if (task.circuit) {
+        result = simulate_circuit(*task.circuit, task.precision);
+    } else {
+        std::this_thread::sleep_for(std::chrono::milliseconds(task.duration));
+    }
+
+    // Освобождаем процессор
+    quantum_processors.release();
+    if (suspended) {
+        // Обратно в очередь с оставшейся частью оценки; память вектора освободится как обычно
+        QuantumTask rest = task;
+        rest.checkpoint = suspended;
+        rest.preemptions++;
+        rest.enqueued_at = std::chrono::steady_clock::now();
+        double done = double(suspended->next_gate - (task.checkpoint ? task.checkpoint->next_gate : 0)) /
+                      double(task.circuit->gates.size() - (task.checkpoint ? task.checkpoint->next_gate : 0));
+        rest.duration = std::max(1, static_cast<int>(task.duration * (1 - done)));
+        {
+            std::lock_guard<std::mutex> queue_lock(queue_mutex);
+            task_queue.push(rest);
+        }
+        memory_cv.notify_all();
+        std::lock_guard<std::mutex> out_lock(output_mutex);
+        std::cout << "Processor " << processor_id << ": Task " << task_name(task) << " preempted at gate " << suspended->next_gate
+                  << "/" << task.circuit->gates.size() << ", checkpoint " << (suspended->raw_bytes >> 20) << " MB ("
+                  << (suspended->stored_bytes >> 20) << " MB stored) in " << suspended->write_seconds * 1000 << "ms"
+                  << std::endl;
+        return;
+    }
+    if (task.circuit && task.shots == 0 && !task.trajectory_job && task.backend != Backend::MPS &&
+        task.backend != Backend::Distributed && !task.checkpoint) {
+        record_cost(task.cost, result.seconds);
+    }
+    if (task.cut_job) finish_cut_fragment(task);
+    if (task.trajectory_job) finish_trajectory_batch(task);
+    if (sampler) dispatch_shots(task, std::move(sampler));
+    if (task.backend == Backend::MPS) finish_mps_task(task, mps_result);
+    
+    if (verbose_log) {
+        std::lock_guard<std::mutex> out_lock(output_mutex);
+        std::cout << "Processor " << processor_id << ": Task " << task_name(task) << " completed.";
+        if (task.trajectory_job) {
+            std::cout << " Batch " << task.trajectory_batch << ": " << task.trajectory_count << " trajectories in "
+                      << result.seconds * 1000 << "ms";
+        } else if (task.shot_job) {
+            std::cout << " Sampled " << task.shots << " shots in " << result.seconds * 1000 << "ms";
+        } else if (task.cut_job) {
+            std::cout << " Fragment " << task.cut_fragment << " variant " << task.cut_variant << " in "
+                      << result.seconds * 1000 << "ms";
+        } else if (task.backend == Backend::Distributed) {
+            std::cout << " Simulated " << task.circuit->gates.size() << " gates on " << task.circuit->qubits
+                      << " qubits split across processes in " << result.seconds * 1000 << "ms, norm " << result.norm
+                      << ", P(0) " << result.probability_zero;
+        } else if (task.backend == Backend::MPS) {
+            std::cout << " MPS of " << task.circuit->qubits << " qubits (" << task.circuit->gates.size()
+                      << " gates, bond " << mps_result.max_bond << ") in " << result.seconds * 1000 << "ms, norm "
+                      << result.norm << ", P(0) " << result.probability_zero;
+        } else if (task.backend == Backend::DensityMatrix) {
+            std::cout << " Density matrix of " << task.circuit->qubits / 2 << " qubits (" << task.circuit->gates.size()
+                      << " gates with noise) in " << result.seconds * 1000 << "ms, trace " << result.norm
+                      << ", P(0) " << result.probability_zero;
+        } else if (task.circuit) {
+            std::cout << " Simulated " << task.circuit->gates.size() << " gates on " << task.circuit->qubits
+                      << " qubits in " << result.seconds * 1000 << "ms, norm " << result.norm
+                      << ", P(0) " << result.probability_zero;
+        }
+        std::cout << std::endl;
+    }
+}
+
+// Функция для разделения задачи на более мелкие: шумная схема делится на пакеты траекторий,
+// большая схема разрезается на фрагменты, задача без схемы делится пополам по времени и кубитам
+std::vector<QuantumTask> split_task(const QuantumTask& original_task) {
+    if (original_task.trajectories > 0) return trajectory_task(original_task);
+    if (original_task.cut_plan) return cut_task(original_task);
+    std::vector<QuantumTask> parts;
+    for (int part = 0; part < 2; ++part) {
+        QuantumTask new_task = original_task;
+        new_task.id = original_task.id * 100 + rand() % 100; // Новый ID для подзадачи
+        new_task.duration = original_task.duration / 2;
+        new_task.required_qubits = original_task.required_qubits / 2;
+        new_task.is_split = true;
+        parts.push_back(new_task);
+    }
+    return parts;
+}
+
+// Схема, помещающаяся на процессор, режется, только если фрагменты со сборкой
+// по модели стоимости в cut_min_speedup раз дешевле прямого моделирования
+bool cost_based_cutting = true;
+const double cut_min_speedup = 4;
+const int cut_min_duration_ms = 100; // Короче - не режем
+
+double estimate_cut_ms(const Circuit& circuit, const CutPlan& plan) {
+    int variants = 1;
+    for (size_t k = 0; k < plan.cut_gates.size(); ++k) variants *= cut_op_count;
+    double ms = 0;
+    for (int f = 0; f < 2; ++f) {
+        // Варианты отличаются несколькими однокубитными вентилями
+        Circuit fragment = make_fragment_circuit(circuit, plan, f, 0);
+        ms += variants * estimate_cost_ms(circuit_cost_features(fragment, Precision::Double));
+    }
+    if (circuit.qubits <= cut_full_distribution_qubits) {
+        CostFeatures assembly; // 10^k слагаемых на каждый исход
+        assembly.compute = std::pow(10.0, double(plan.cut_gates.size())) * std::ldexp(0.5, circuit.qubits);
+        ms += estimate_cost_ms(assembly);
+    }
+    return ms;
+}
+
+// Функция для добавления задач в очередь
+void add_quantum_task(int id, int priority, bool is_critical, int duration, int qubits,
+                      std::shared_ptr<const Circuit> circuit = nullptr,
+                      Precision precision = Precision::Double, int shots = 0,
+                      NoiseModel noise = {}, int trajectories = 0, Backend backend = Backend::Auto) {
+    QuantumTask task = {id, priority, is_critical, duration, qubits};
+    task.enqueued_at = std::chrono::steady_clock::now();
+    task.circuit = std::move(circuit);
+    task.precision = precision;
+    task.shots = task.circuit ? shots : 0;
+    if (task.circuit && noise.active() && backend != Backend::StateVector) {
+        // Схема с шумом: матрица плотности или траектории (Auto - что быстрее по модели стоимости)
+        task.noise = noise;
+        int count = trajectories > 0 ? trajectories : default_noise_trajectories;
+        std::shared_ptr<const Circuit> density;
+        if (backend == Backend::Auto) {
+            choose_noisy_backend(*task.circuit, noise, precision, count, density);
+        } else if (backend == Backend::DensityMatrix && task.circuit->qubits <= density_max_qubits) {
+            density = std::make_shared<Circuit>(make_density_circuit(*task.circuit, noise));
+        }
+        if (density) {
+            task.backend = Backend::DensityMatrix;
+            task.circuit = std::move(density);
+        } else {
+            task.backend = Backend::Trajectories;
+            task.trajectories = count;
+        }
+    }
+    if (task.circuit) {
+        // Для схемы длительность оценивается моделью стоимости, а не берется от клиента
+        task.cost = task.trajectories > 0 ? trajectory_cost_features(*task.circuit, noise, precision, task.trajectories)
+                                          : circuit_cost_features(*task.circuit, precision);
+        task.duration = estimate_duration_ms(task.cost);
+        if (task.trajectories > 0 || task.backend == Backend::DensityMatrix) {
+            // Разрезание шум не поддерживает
+        } else if (backend == Backend::MPS) {
+            task.backend = Backend::MPS;
+        } else if (backend == Backend::Distributed ||
+                   (backend == Backend::Auto && distributed_processes > 1 &&
+                    task.circuit->qubits >= distributed_min_qubits &&
+                    task.circuit->qubits - distributed_global_qubits(task.circuit->qubits, distributed_processes) <=
+                        processor_max_qubits &&
+                    task_memory_bytes(task) <= memory_budget.limit)) {
+            // Вектор делится между процессами: каждому достается не больше processor_max_qubits кубитов
+            task.backend = Backend::Distributed;
+        } else if (task.circuit->qubits > processor_max_qubits || task_memory_bytes(task) > memory_budget.limit) {
+            // Вектор не помещается: разрезание или точное MPS (если запутанность мала) - что дешевле.
+            // Резать нельзя - MPS с отбрасыванием сингулярных чисел
+            task.cut_plan = plan_cut(*task.circuit);
+            int bond_log2 = mps_bond_bound_log2(*task.circuit);
+            bool mps_exact = bond_log2 < 30 && (1 << bond_log2) <= mps_max_bond;
+            if (backend == Backend::Auto &&
+                (!task.cut_plan || (mps_exact && estimate_mps_duration_ms(*task.circuit) <
+                                                     estimate_cut_ms(*task.circuit, *task.cut_plan)))) {
+                task.cut_plan = nullptr;
+                task.backend = Backend::MPS;
+            }
+        } else if (cost_based_cutting && task.duration >= cut_min_duration_ms &&
+                   (task.shots == 0 || task.circuit->qubits <= cut_full_distribution_qubits)) {
+            // Шоты разрезанной схемы берутся из собранного распределения, а его собирают
+            // только до cut_full_distribution_qubits кубитов - иначе шоты были бы потеряны
+            auto plan = plan_cut(*task.circuit);
+            if (plan && estimate_cut_ms(*task.circuit, *plan) * cut_min_speedup < task.duration) task.cut_plan = plan;
+        }
+        if (task.backend == Backend::MPS) task.duration = estimate_mps_duration_ms(*task.circuit);
+    }
+    
+    std::lock_guard<std::mutex> queue_lock(queue_mutex);
+    task_queue.push(task);
+    
+    if (!verbose_log) return;
+    std::lock_guard<std::mutex> out_lock(output_mutex);
+    std::cout << "Task " << id << " added to queue. Priority: " << priority 
+              << (is_critical ? " (CRITICAL)" : "") 
+              << ", Duration: " << task.duration << "ms, Qubits: " << qubits << std::endl;
+}
+
+// Постановка в очередь схемы в OpenQASM: кубиты берутся из схемы, длительность - из модели стоимости
+bool submit_qasm_task(int id, int priority, bool is_critical, std::string_view source,
+                      Precision precision = Precision::Double, int shots = 0, std::string* error = nullptr) {
+    auto circuit = std::make_shared<Circuit>();
+    if (!parse_qasm(source, *circuit, error)) return false;
+    int qubits = circuit->qubits;
+    add_quantum_task(id, priority, is_critical, 0, qubits, std::move(circuit), precision, shots);
+    return true;
+}
+
+// Функция обработки задач из очереди
+void process_quantum_tasks(int processor_id) {
+    if (warmup.enabled && warmup.pin_threads) {
+        pin_processor_thread(processor_id);
+    }
+    while (true) {
+        std::unique_lock<std::mutex> queue_lock(queue_mutex);
+        QuantumTask task;
+        if (!take_admitted_task(queue_lock, task, memory_cv, [] { return false; })) {
+            break;
+        }
+        queue_lock.unlock();
+
+        // Проверяем, не нужно ли разделить задачу (если процессор перегружен).
+        // Схема делится только разрезанием, если она больше processor_max_qubits;
+        // задача с шумом всегда делится на пакеты траекторий
+        bool noisy = task.trajectories > 0 && !task.trajectory_job;
+        bool too_large = task.circuit ? task.cut_plan && !task.cut_job
+                                      : task.required_qubits > 5 && !task.is_split; // Условная проверка на перегрузку
+        if (too_large || noisy) {
+            std::lock_guard<std::mutex> out_lock(output_mutex);
+            if (too_large) {
+                std::cout << "Processor " << processor_id << ": Task " << task.id
+                          << " is too large, splitting..." << std::endl;
+            }
+            
+            std::vector<QuantumTask> parts = split_task(task);
+            if (noisy) {
+                std::cout << "Processor " << processor_id << ": Task " << task.id << " split into " << parts.size()
+                          << " batches of noisy trajectories" << std::endl;
+            } else if (task.cut_plan) {
+                std::cout << "Processor " << processor_id << ": Task " << task.id << " cut at qubit "
+                          << task.cut_plan->split << " (" << task.cut_plan->cut_gates.size() << " cuts) into "
+                          << parts.size() << " fragment runs" << std::endl;
+            }
+            queue_lock.lock();
+            for (const QuantumTask& part : parts) {
+                task_queue.push(part);
+            }
+            queue_lock.unlock();
+            release_task_memory(task);
+            
+            continue;
+        }
+
+        process_quantum_task(task, processor_id);
+        release_task_memory(task);
+    }
+}
+
+// Функция для имитации сбоя процессора
+void simulate_processor_failure(int processor_id) {
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+    failed_processor.store(processor_id);
+    
+    std::lock_guard<std::mutex> out_lock(output_mutex);
+    std::cout << "!!! Processor " << processor_id << " FAILED !!!" << std::endl;
+}
+
+// ===================== Сервис размещения задач между репликами планировщика =====================
+// Лидер хранит глобальное представление о загрузке реплик (отдельных процессов на localhost)
+// и распределяет задачи по принципу "power of two choices": из двух случайных реплик
+// выбирается менее загруженная. Реплики сообщают длину очереди только при заметном изменении,
+// а лидер между отчетами сам учитывает уже отправленные задачи.
+
+// Сообщение протокола между лидером и репликами (передается целиком через сокет)
+struct PlacementMessage {
+    enum Type : int { SubmitTask = 1, LoadReport = 2, Shutdown = 3 };
+    int type;
+    int replica_id;
+    int queue_length;   // Загрузка реплики: задачи в очереди + выполняемые
+    int received_total; // Сколько задач реплика получила к моменту отчета
+    int completed_total;// Сколько задач реплика завершила
+    uint64_t memory_in_use; // Память векторов выполняемых задач (байт)
+    uint64_t memory_limit;  // Бюджет памяти реплики (байт)
+    // Поля задачи (только для SubmitTask)
+    int task_id;
+    int priority;
+    bool is_critical;
+    int duration;
+    int required_qubits;
+};
+
+const int placement_report_delta = 2; // Порог изменения загрузки для отправки отчета
+
+// Состояние локального планировщика внутри процесса-реплики
+std::condition_variable replica_cv;
+bool replica_shutdown = false;
+std::atomic<int> replica_load(0);
+std::atomic<int> replica_received(0);
+std::atomic<int> replica_completed(0);
+std::mutex replica_send_mutex;
+int replica_last_report = 0;
+
+// Отправка отчета о загрузке лидеру (только если загрузка заметно изменилась)
+void replica_report(int fd, int replica_id, bool force) {
+    std::lock_guard<std::mutex> lock(replica_send_mutex);
+    int load = replica_load.load();
+    bool changed = std::abs(load - replica_last_report) >= placement_report_delta
+                   || (load == 0 && replica_last_report != 0);
+    if (!force && !changed) return;
+
+    PlacementMessage msg{};
+    msg.type = PlacementMessage::LoadReport;
+    msg.replica_id = replica_id;
+    msg.queue_length = load;
+    msg.received_total = replica_received.load();
+    msg.completed_total = replica_completed.load();
+    {
+        std::lock_guard<std::mutex> queue_lock(queue_mutex);
+        msg.memory_in_use = memory_budget.in_use;
+        msg.memory_limit = memory_budget.limit;
+    }
+    send_all(fd, &msg, sizeof(msg));
+    replica_last_report = load;
+}
+
+// Обработчик задач реплики: в отличие от process_quantum_tasks ждет новые задачи от лидера
+void replica_processor(int fd, int replica_id, int processor_id) {
+    while (true) {
+        std::unique_lock<std::mutex> queue_lock(queue_mutex);
+        QuantumTask task;
+        if (!take_admitted_task(queue_lock, task, replica_cv, [] { return !replica_shutdown; })) {
+            break;
+        }
+        queue_lock.unlock();
+
+        process_quantum_task(task, processor_id);
+        release_task_memory(task);
+        replica_cv.notify_all(); // Отложенные задачи ждут на replica_cv
+
+        replica_load--;
+        replica_completed++;
+        replica_report(fd, replica_id, false);
+    }
+}
+
+// Главная функция процесса-реплики
+int run_scheduler_replica(int fd, int replica_id) {
+    std::vector<std::thread> processors;
+    for (int i = 0; i < 4; ++i) {
+        processors.emplace_back(replica_processor, fd, replica_id, replica_id * 10 + i);
+    }
+
+    PlacementMessage msg;
+    while (recv_all(fd, &msg, sizeof(msg)) && msg.type == PlacementMessage::SubmitTask) {
+        QuantumTask task = {msg.task_id, msg.priority, msg.is_critical, msg.duration, msg.required_qubits};
+        {
+            std::lock_guard<std::mutex> queue_lock(queue_mutex);
+            task_queue.push(task);
+        }
+        replica_received++;
+        replica_load++;
+        replica_cv.notify_one();
+        replica_report(fd, replica_id, false);
+    }
+
+    {
+        std::lock_guard<std::mutex> queue_lock(queue_mutex);
+        replica_shutdown = true;
+    }
+    replica_cv.notify_all();
+    for (auto& t : processors) {
+        t.join();
+    }
+
+    // Финальный отчет перед завершением
+    replica_report(fd, replica_id, true);
+    close(fd);
+    return 0;
+}
+
+// Представление лидера о реплике
+struct ReplicaView {
+    int fd;
+    pid_t pid;
+    int reported_load = 0;     // Последняя сообщенная загрузка
+    int reported_received = 0; // Сколько задач реплика подтвердила в последнем отчете
+    int assigned = 0;          // Сколько задач лидер отправил реплике
+    int completed = 0;
+    int reports = 0;
+    uint64_t reported_memory = 0;          // Память выполняемых задач по последнему отчету
+    uint64_t memory_limit = UINT64_MAX;    // Бюджет памяти реплики (известен после первого отчета)
+    uint64_t memory_since_report = 0;      // Память задач, отправленных после отчета
+
+    // Оценка загрузки: отчет плюс задачи, отправленные после него
+    int estimated_load() const {
+        return reported_load + (assigned - reported_received);
+    }
+
+    // Поместится ли задача в память реплики (по той же оценке)
+    bool memory_fits(uint64_t bytes) const {
+        uint64_t in_use = reported_memory + memory_since_report;
+        return bytes <= memory_limit && in_use + bytes <= memory_limit;
+    }
+};
+
+// Прием отчетов о загрузке от всех реплик
+void placement_report_listener(std::vector<ReplicaView>& replicas, std::mutex& view_mutex) {
+    std::vector<pollfd> fds;
+    for (const auto& r : replicas) {
+        fds.push_back({r.fd, POLLIN, 0});
+    }
+    size_t open_fds = fds.size();
+    while (open_fds > 0) {
+        if (poll(fds.data(), fds.size(), -1) < 0) break;
+        for (size_t i = 0; i < fds.size(); ++i) {
+            if (fds[i].fd < 0 || !(fds[i].revents & (POLLIN | POLLHUP))) continue;
+            PlacementMessage msg;
+            if (!recv_all(fds[i].fd, &msg, sizeof(msg))) {
+                fds[i].fd = -1; // Реплика завершилась
+                --open_fds;
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(view_mutex);
+            ReplicaView& view = replicas[i];
+            view.reported_load = msg.queue_length;
+            view.reported_received = msg.received_total;
+            view.completed = msg.completed_total;
+            view.reported_memory = msg.memory_in_use;
+            view.memory_limit = msg.memory_limit;
+            view.memory_since_report = 0;
+            view.reports++;
+        }
+    }
+}
+
+// Выбор реплики: две случайные, берется менее загруженная из тех, где хватает памяти.
+// Если память есть только у других реплик, задача перенаправляется к наименее загруженной из них.
+int choose_replica(const std::vector<ReplicaView>& replicas, std::mt19937& gen, uint64_t memory_bytes,
+                   bool& rerouted) {
+    rerouted = false;
+    if (replicas.size() == 1) return 0;
+    std::uniform_int_distribution<> dist(0, static_cast<int>(replicas.size()) - 1);
+    int first = dist(gen);
+    int second = dist(gen);
+    while (second == first) {
+        second = dist(gen);
+    }
+    bool first_fits = replicas[first].memory_fits(memory_bytes);
+    bool second_fits = replicas[second].memory_fits(memory_bytes);
+    if (first_fits != second_fits) return first_fits ? first : second;
+    if (!first_fits) {
+        int best = -1;
+        for (int i = 0; i < static_cast<int>(replicas.size()); ++i) {
+            if (!replicas[i].memory_fits(memory_bytes)) continue;
+            if (best < 0 || replicas[i].estimated_load() < replicas[best].estimated_load()) best = i;
+        }
+        if (best >= 0) {
+            rerouted = true;
+            return best;
+        }
+        // Памяти нет нигде - задача подождет в очереди реплики
+    }
+    return replicas[second].estimated_load() < replicas[first].estimated_load() ? second : first;
+}
+
+// Запуск лидера и реплик планировщика в отдельных процессах
+int run_placement_service(int replica_count, int task_count, int max_qubits) {
+    std::vector<ReplicaView> replicas;
+    // Реплики создаются до запуска любых потоков лидера
+    for (int id = 0; id < replica_count; ++id) {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+            std::cerr << "socketpair failed" << std::endl;
+            return 1;
+        }
+        std::cout.flush();
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(sv[0]);
+            for (const auto& r : replicas) {
+                close(r.fd);
+            }
+            std::exit(run_scheduler_replica(sv[1], id));
+        }
+        close(sv[1]);
+        ReplicaView view;
+        view.fd = sv[0];
+        view.pid = pid;
+        replicas.push_back(view);
+    }
+
+    std::mutex view_mutex;
+    std::thread listener(placement_report_listener, std::ref(replicas), std::ref(view_mutex));
+
+    std::mt19937 gen(std::random_device{}());
+    std::uniform_int_distribution<> priority_dist(1, 5);
+    std::uniform_int_distribution<> duration_dist(10, 200);
+    std::uniform_int_distribution<> qubits_dist(2, max_qubits);
+    std::bernoulli_distribution critical_dist(0.2);
+    std::vector<double> dispatch_us;
+    int rerouted_total = 0;
+
+    for (int id = 1; id <= task_count; ++id) {
+        PlacementMessage msg{};
+        msg.type = PlacementMessage::SubmitTask;
+        msg.task_id = id;
+        msg.priority = priority_dist(gen);
+        msg.is_critical = critical_dist(gen);
+        msg.duration = duration_dist(gen);
+        msg.required_qubits = qubits_dist(gen);
+
+        auto start = std::chrono::steady_clock::now();
+        int target;
+        {
+            std::lock_guard<std::mutex> lock(view_mutex);
+            uint64_t memory_bytes = uint64_t(sizeof(std::complex<double>)) << msg.required_qubits;
+            bool rerouted = false;
+            target = choose_replica(replicas, gen, memory_bytes, rerouted);
+            replicas[target].assigned++;
+            replicas[target].memory_since_report += memory_bytes;
+            rerouted_total += rerouted;
+        }
+        msg.replica_id = target;
+        send_all(replicas[target].fd, &msg, sizeof(msg));
+        auto end = std::chrono::steady_clock::now();
+        dispatch_us.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+
+        // Задачи поступают с небольшим интервалом
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    for (const auto& r : replicas) {
+        PlacementMessage msg{};
+        msg.type = PlacementMessage::Shutdown;
+        send_all(r.fd, &msg, sizeof(msg));
+    }
+    for (const auto& r : replicas) {
+        waitpid(r.pid, nullptr, 0);
+    }
+    listener.join();
+
+    std::sort(dispatch_us.begin(), dispatch_us.end());
+    double total_us = 0;
+    for (double us : dispatch_us) total_us += us;
+    int total_reports = 0;
+
+    std::cout << "=== Placement summary ===" << std::endl;
+    for (size_t i = 0; i < replicas.size(); ++i) {
+        const ReplicaView& r = replicas[i];
+        total_reports += r.reports;
+        std::cout << "Replica " << i << ": assigned " << r.assigned
+                  << ", completed " << r.completed
+                  << ", load reports " << r.reports << std::endl;
+        close(r.fd);
+    }
+    if (!dispatch_us.empty()) {
+        std::cout << "Dispatch latency: avg " << total_us / dispatch_us.size()
+                  << " us, p99 " << dispatch_us[dispatch_us.size() * 99 / 100] << " us" << std::endl;
+    }
+    std::cout << "Messages: " << task_count << " tasks, " << total_reports
+              << " load reports" << std::endl;
+    std::cout << "Rerouted for memory: " << rerouted_total << std::endl;
+    return 0;
+}
+
+// Один прогон замера запуска: warm - с прогревом или без
+void run_startup_trial(bool warm, int task_count) {
+    program_start = std::chrono::steady_clock::now();
+    verbose_log = false;
+    warmup.enabled = warm;
+    huge_page_mode = warm ? HugePageMode::Transparent : HugePageMode::Off;
+    warm_up_scheduler();
+
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<> priority_dist(1, 5);
+    std::uniform_int_distribution<> duration_dist(0, 2);
+    std::uniform_int_distribution<> qubits_dist(1, 5);
+    for (int id = 1; id <= task_count; ++id) {
+        add_quantum_task(id, priority_dist(gen), id % 5 == 0, duration_dist(gen), qubits_dist(gen));
+    }
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 10; ++i) {
+        threads.push_back(std::thread(process_quantum_tasks, i % 4));
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    dispatch_latency.print(warm ? "Warm start" : "Cold start");
+}
+
+// Сравнение времени до первой задачи и задержек без прогрева и с ним (в отдельных процессах)
+int run_startup_benchmark(int task_count) {
+    for (bool warm : {false, true}) {
+        std::cout.flush();
+        pid_t pid = fork();
+        if (pid == 0) {
+            run_startup_trial(warm, task_count);
+            std::cout.flush();
+            std::_Exit(0);
+        }
+        waitpid(pid, nullptr, 0);
+    }
+    return 0;
+}
+
+// Выполнение случайных схем через планировщик
+int run_simulation_demo(int task_count, int min_qubits, int max_qubits, int depth, Precision precision) {
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<> qubits_dist(min_qubits, max_qubits);
+    std::uniform_int_distribution<> priority_dist(1, 5);
+    for (int id = 1; id <= task_count; ++id) {
+        int qubits = qubits_dist(gen);
+        auto circuit = std::make_shared<Circuit>(make_random_circuit(qubits, depth, static_cast<uint32_t>(id)));
+        add_quantum_task(id, priority_dist(gen), id % 4 == 0, 0, qubits, circuit, precision);
+    }
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.push_back(std::thread(process_quantum_tasks, i));
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    return 0;
+}
+
+// Задачи разного размера при ограниченном бюджете памяти: пик, откладывания и загрузка памяти
+int run_memory_admission_demo(size_t budget_mb, int task_count, int min_qubits, int max_qubits) {
+    verbose_log = false;
+    cost_based_cutting = false; // Нужны именно полные векторы состояния
+    memory_budget.limit = budget_mb << 20;
+    std::mt19937 gen(11);
+    std::uniform_int_distribution<> qubits_dist(min_qubits, max_qubits);
+    std::uniform_int_distribution<> priority_dist(1, 5);
+    for (int id = 1; id <= task_count; ++id) {
+        int qubits = qubits_dist(gen);
+        auto circuit = std::make_shared<Circuit>(make_random_circuit(qubits, 4, static_cast<uint32_t>(id)));
+        add_quantum_task(id, priority_dist(gen), id % 4 == 0, 0, qubits, circuit, Precision::Double, 0, {}, 0,
+                         Backend::StateVector);
+    }
+
+    // Средняя занятость бюджета за время работы
+    std::atomic<bool> done(false);
+    double usage_sum = 0;
+    int samples = 0;
+    std::thread sampler([&] {
+        while (!done) {
+            {
+                std::lock_guard<std::mutex> queue_lock(queue_mutex);
+                usage_sum += double(memory_budget.in_use) / double(memory_budget.limit);
+            }
+            ++samples;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.push_back(std::thread(process_quantum_tasks, i));
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    done = true;
+    sampler.join();
+
+    std::cout << "Memory budget " << budget_mb << " MB: peak " << (memory_budget.peak >> 20) << " MB, average use "
+              << (samples > 0 ? usage_sum / samples * 100 : 0) << "%, delayed " << memory_budget.delayed
+              << ", rejected " << memory_budget.rejected << ", makespan " << seconds << " s" << std::endl;
+    dispatch_latency.print("Memory admission");
+    return 0;
+}
+
+// Разрезание схемы, не помещающейся на процессор, со сверкой с прямым моделированием
+int run_cutting_demo(int qubits, int depth, int max_qubits) {
+    verbose_log = false;
+    processor_max_qubits = max_qubits;
+    auto circuit = std::make_shared<Circuit>(make_random_circuit(qubits, depth, 5));
+    add_quantum_task(1, 1, true, 0, qubits, circuit, Precision::Double, 0, {}, 0, Backend::StateVector);
+    size_t job_bytes;
+    {
+        std::lock_guard<std::mutex> queue_lock(queue_mutex);
+        if (!task_queue.top().cut_plan) {
+            std::cout << "Circuit cannot be cut into two fragments of at most " << max_qubits
+                      << " qubits with " << cutting_max_cuts << " cuts" << std::endl;
+            return 1;
+        }
+        job_bytes = cut_job_memory_bytes(*circuit, *task_queue.top().cut_plan, 0);
+    }
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.push_back(std::thread(process_quantum_tasks, i));
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    // Распределения фрагментов занимают бюджет до сборки и освобождаются вместе с заданием
+    std::cout << "Memory budget: peak " << (memory_budget.peak >> 10) << " KB, of it fragment distributions "
+              << (job_bytes >> 10) << " KB; in use after completion " << memory_budget.in_use << " bytes" << std::endl;
+    if (memory_budget.in_use != 0) return 1;
+    if (cut_results.empty() || qubits > cut_full_distribution_qubits) return 0;
+
+    // Сверка с вектором состояния всей схемы
+    const CutResult& result = cut_results.front().second;
+    auto start = std::chrono::steady_clock::now();
+    StateVector<double> state(qubits);
+    execute_circuit(state, *circuit);
+    double direct_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double max_error = 0;
+    for (size_t i = 0; i < state.size; ++i) {
+        max_error = std::max(max_error, std::abs(std::norm(state.amplitudes[i]) - result.distribution[i]));
+    }
+    std::cout << "Direct simulation: " << direct_seconds * 1000 << "ms, P(0) " << std::norm(state.amplitudes[0])
+              << ", max |p_cut - p_direct| " << max_error << std::endl;
+    return 0;
+}
+
+// Проверка выбора разрезания по стоимости: две слабо связанные половины выгодно резать,
+// но схему больше cut_full_distribution_qubits с шотами резать нельзя (распределение для
+// шотов не собирается). Задачи только ставятся в очередь и не выполняются
+int run_cost_cut_check() {
+    verbose_log = false;
+    auto make_halves = [](int qubits) {
+        // Случайные схемы на половинах и один CNOT между ними посередине
+        int half = qubits / 2;
+        Circuit low = make_random_circuit(half, 40, 3);
+        Circuit high = make_random_circuit(qubits - half, 40, 4);
+        auto circuit = std::make_shared<Circuit>();
+        circuit->qubits = qubits;
+        for (size_t g = 0; g < low.gates.size(); ++g) {
+            if (g == low.gates.size() / 2) circuit->add(GateType::CNOT, half - 1, half);
+            circuit->gates.push_back(low.gates[g]);
+            Gate shifted = high.gates[g];
+            for (int j = 0; j < shifted.arity; ++j) shifted.qubits[j] = static_cast<uint16_t>(shifted.qubits[j] + half);
+            circuit->gates.push_back(shifted);
+        }
+        return circuit;
+    };
+    struct Case { int qubits, shots; bool cut; };
+    const Case cases[] = {{24, 0, true}, {24, 1000, false}, {20, 1000, true}};
+    int failures = 0;
+    for (const Case& c : cases) {
+        auto circuit = make_halves(c.qubits);
+        add_quantum_task(1, 1, false, 0, c.qubits, circuit, Precision::Double, c.shots);
+        QuantumTask task;
+        {
+            std::lock_guard<std::mutex> queue_lock(queue_mutex);
+            task = task_queue.top();
+            task_queue.pop();
+        }
+        bool ok = (task.cut_plan != nullptr) == c.cut;
+        failures += ok ? 0 : 1;
+        std::cout << c.qubits << " qubits, " << c.shots << " shots, estimate " << task.duration << "ms: "
+                  << (task.cut_plan ? "cut" : "not cut") << (ok ? "" : " (WRONG)") << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+// Выборка шотов: построение и скорость обоих выборщиков, затем задача с шотами через
+// очередь (шоты делятся между процессорами) и сверка гистограммы с точным распределением
+int run_shots_demo(int qubits, int shots, SamplingMethod method) {
+    verbose_log = false;
+    auto circuit = std::make_shared<Circuit>(make_random_circuit(qubits, 20, 7));
+    std::vector<double> exact;
+    simulate_circuit(*circuit, Precision::Double, &exact);
+
+    // Полное расстояние по вариации между гистограммой и точным распределением
+    auto distance = [&](const ShotHistogram& histogram, uint64_t total) {
+        double sum = 0;
+        for (const auto& [outcome, count] : histogram) sum += std::abs(double(count) / double(total) - exact[outcome]);
+        for (size_t i = 0; i < exact.size(); ++i) {
+            if (!histogram.count(i)) sum += exact[i];
+        }
+        return sum / 2;
+    };
+
+    std::cout << "Sampling " << qubits << "-qubit distribution, single core:" << std::endl;
+    for (SamplingMethod m : {SamplingMethod::Alias, SamplingMethod::Cumulative}) {
+        sampling_method = m;
+        auto start = std::chrono::steady_clock::now();
+        auto sampler = make_sampler(exact, shots);
+        double build = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::mt19937_64 gen(117);
+        ShotHistogram histogram;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < shots; ++i) histogram[sampler->sample(gen)]++;
+        double sample = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "  " << (m == SamplingMethod::Alias ? "alias table      " : "cumulative search")
+                  << ": build " << build * 1000 << "ms, " << shots / sample / 1e6 << "M shots/s, TV distance "
+                  << distance(histogram, shots) << std::endl;
+    }
+
+    sampling_method = method;
+    add_quantum_task(1, 1, true, 0, qubits, circuit, Precision::Double, shots);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.push_back(std::thread(process_quantum_tasks, i));
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    if (shot_results.empty()) return 1;
+    const ShotHistogram& merged = shot_results.front().second;
+    uint64_t total = 0;
+    for (const auto& entry : merged) total += entry.second;
+    std::cout << "Merged histogram: " << total << " shots, TV distance " << distance(merged, total) << std::endl;
+    // Выборщик занимает бюджет, пока не завершится последняя подзадача выборки
+    std::cout << "Memory budget: peak " << (memory_budget.peak >> 10) << " KB, in use after completion "
+              << memory_budget.in_use << " bytes" << std::endl;
+    return total == uint64_t(shots) && memory_budget.in_use == 0 ? 0 : 1;
+}
+
+// Схемы из файлов OpenQASM через планировщик
+int run_qasm_files(const std::vector<std::string>& files, int shots) {
+    int id = 0;
+    for (const std::string& file : files) {
+        std::ifstream in(file, std::ios::binary);
+        if (!in) {
+            std::cout << file << ": cannot open" << std::endl;
+            return 1;
+        }
+        std::string source((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::string error;
+        if (!submit_qasm_task(++id, 1, false, source, Precision::Double, shots, &error)) {
+            std::cout << file << ": " << error << std::endl;
+            return 1;
+        }
+    }
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.push_back(std::thread(process_quantum_tasks, i));
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    return 0;
+}
+
+// Скорость разбора: случайные схемы записываются в OpenQASM и разбираются заново;
+// первая схема сверяется с исходной по вектору состояния
+int run_qasm_benchmark(int count, int qubits, int depth) {
+    std::vector<std::string> sources;
+    size_t bytes = 0;
+    for (int i = 0; i < count; ++i) {
+        sources.push_back(circuit_to_qasm(make_random_circuit(qubits, depth, static_cast<uint32_t>(i + 1))));
+        bytes += sources.back().size();
+    }
+    Circuit parsed;
+    size_t gates = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const std::string& source : sources) {
+        std::string error;
+        if (!parse_qasm(source, parsed, &error)) {
+            std::cout << "Parse failed: " << error << std::endl;
+            return 1;
+        }
+        gates += parsed.gates.size();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Parsed " << count << " circuits (" << qubits << " qubits, " << gates / count << " gates, "
+              << bytes / count << " bytes each): " << count / seconds << " circuits/s, "
+              << double(bytes) / seconds / 1e6 << " MB/s" << std::endl;
+
+    if (qubits > 20) return 0;
+    parse_qasm(sources.front(), parsed);
+    StateVector<double> a(qubits), b(qubits);
+    run_circuit(a, make_random_circuit(qubits, depth, 1));
+    run_circuit(b, parsed);
+    double max_error = 0;
+    for (size_t i = 0; i < a.size; ++i) max_error = std::max(max_error, std::abs(a.amplitudes[i] - b.amplitudes[i]));
+    std::cout << "Round trip max amplitude error " << max_error << ", estimated duration "
+              << estimate_duration_ms(circuit_cost_features(parsed, Precision::Double)) << "ms" << std::endl;
+    return 0;
+}
+
+// Калибровка модели стоимости: схемы разного размера, оценка до запуска и факт;
+// ошибка оценки по первой и второй половине запусков
+int run_cost_model_demo(int count, int min_qubits, int max_qubits) {
+    std::mt19937 gen(19);
+    std::uniform_int_distribution<> qubits_dist(min_qubits, max_qubits);
+    std::uniform_int_distribution<> depth_dist(2, 30);
+    double error_sum[2] = {0, 0};
+    std::cout << "  #  qubits  gates  kind    estimate(ms)  measured(ms)" << std::endl;
+    for (int i = 0; i < count; ++i) {
+        int qubits = qubits_dist(gen);
+        bool qft = i % 3 == 2;
+        Precision precision = i % 5 == 4 ? Precision::Float : Precision::Double;
+        Circuit circuit = qft ? make_qft_circuit(qubits) : make_random_circuit(qubits, depth_dist(gen), static_cast<uint32_t>(i));
+        CostFeatures cost = circuit_cost_features(circuit, precision);
+        double estimate = estimate_cost_ms(cost);
+        SimulationResult result = simulate_circuit(circuit, precision);
+        record_cost(cost, result.seconds);
+        double measured = result.seconds * 1000;
+        error_sum[2 * i >= count] += std::abs(estimate - measured) / measured;
+        std::printf("%3d  %6d  %5zu  %-6s  %12.2f  %12.2f\n", i + 1, qubits, circuit.gates.size(),
+                    qft ? "qft" : precision == Precision::Float ? "float" : "random", estimate, measured);
+    }
+    int first = (count + 1) / 2;
+    std::cout << "Mean relative error: first half " << error_sum[0] / first * 100 << "%, second half "
+              << error_sum[1] / std::max(count - first, 1) * 100 << "%" << std::endl;
+    std::cout << "Calibrated: " << 1.0 / cost_model.coef[0] / 1000 << " M weighted amplitudes/s, "
+              << 1.0 / cost_model.coef[1] / 1e6 << " GB/s per thread, " << cost_model.coef[2] * 1000
+              << " us per gate (defaults " << default_amplitudes_per_ms(simd_level) / 1000 << ", "
+              << default_bytes_per_ms / 1e6 << ", " << default_ms_per_gate * 1000 << ")" << std::endl;
+    return 0;
+}
+
+// Шумные траектории через планировщик: один пакет против деления на пакеты
+// (на многоядерном узле пакеты идут на разные процессоры) и отличие от идеальной схемы
+int run_noise_demo(int qubits, int trajectories, NoiseModel noise) {
+    verbose_log = false;
+    auto circuit = std::make_shared<Circuit>(make_random_circuit(qubits, 10, 13));
+    std::vector<double> ideal;
+    simulate_circuit(*circuit, Precision::Double, &ideal);
+
+    int batches[2] = {1, max_trajectory_batches};
+    for (int run = 0; run < 2; ++run) {
+        max_trajectory_batches = batches[run];
+        trajectory_results.clear();
+        add_quantum_task(run + 1, 1, false, 0, qubits, circuit, Precision::Double, 0, noise, trajectories,
+                         Backend::Trajectories);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i) {
+            threads.push_back(std::thread(process_quantum_tasks, i));
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        if (trajectory_results.empty()) return 1;
+        const TrajectoryResult& result = trajectory_results.front().second;
+        std::cout << "  " << batches[run] << " batch(es): " << trajectories / result.seconds << " trajectories/s";
+        if (!result.distribution.empty()) {
+            double distance = 0;
+            for (size_t i = 0; i < ideal.size(); ++i) distance += std::abs(result.distribution[i] - ideal[i]);
+            std::cout << ", TV distance from noiseless " << distance / 2;
+        }
+        std::cout << ", P(0) noiseless " << ideal[0] << std::endl;
+    }
+    return 0;
+}
+
+// Выбор исполнителя для шумных схем: оценки модели стоимости против фактического
+// времени матрицы плотности и траекторий на одном процессоре
+int run_backend_choice_demo(int max_qubits, NoiseModel noise, int trajectories) {
+    std::cout << "qubits  density est/ms  measured  trajectories est/ms  measured  auto" << std::endl;
+    int right = 0, total = 0;
+    for (int n = 2; n <= max_qubits; n += 2) {
+        Circuit circuit = make_random_circuit(n, 10, 21);
+        std::shared_ptr<const Circuit> density;
+        Backend choice = choose_noisy_backend(circuit, noise, Precision::Double, trajectories, density);
+        Circuit doubled = density ? *density : make_density_circuit(circuit, noise);
+        double density_estimate = estimate_cost_ms(circuit_cost_features(doubled, Precision::Double));
+        double trajectories_estimate = estimate_cost_ms(trajectory_cost_features(circuit, noise, Precision::Double, trajectories));
+
+        double density_ms = simulate_density(doubled, Precision::Double).seconds * 1000;
+        auto start = std::chrono::steady_clock::now();
+        std::mt19937_64 gen(n);
+        StateVector<double> state(n);
+        for (int t = 0; t < trajectories; ++t) run_trajectory(state, circuit, noise, gen);
+        double trajectories_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        bool density_faster = density_ms < trajectories_ms;
+        right += density_faster == (choice == Backend::DensityMatrix);
+        ++total;
+        std::printf("%6d  %14.2f  %8.2f  %19.2f  %8.2f  %s\n", n, density_estimate, density_ms, trajectories_estimate,
+                    trajectories_ms, choice == Backend::DensityMatrix ? "density" : "trajectories");
+    }
+    std::cout << "Auto picked the faster backend in " << right << " of " << total << " cases" << std::endl;
+    return 0;
+}
+
+// MPS: сверка с вектором состояния на малом числе кубитов (в том числе QFT с дальними
+// вентилями), затем большая неглубокая схема через очередь с автоматическим выбором исполнителя
+int run_mps_demo(int qubits, int depth, int max_bond) {
+    verbose_log = false;
+    mps_max_bond = max_bond;
+    const int small = 12;
+    // QFT после случайного слоя: дальние управляемые повороты на запутанном состоянии
+    Circuit qft = make_random_circuit(small, 2, 23);
+    Circuit tail = make_qft_circuit(small);
+    qft.gates.insert(qft.gates.end(), tail.gates.begin(), tail.gates.end());
+    std::pair<const char*, Circuit> checks[] = {{"random", make_random_circuit(small, depth, 17)}, {"qft", qft}};
+    for (auto& [name, circuit] : checks) {
+        StateVector<double> state(small);
+        execute_circuit(state, circuit);
+        auto start = std::chrono::steady_clock::now();
+        MpsState mps(small);
+        for (const Gate& gate : circuit.gates) mps_apply_gate(mps, gate, circuit);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double max_error = 0;
+        for (size_t i = 0; i < state.size; ++i) {
+            max_error = std::max(max_error, std::abs(mps_amplitude(mps, i) - state.amplitudes[i]));
+        }
+        // Шоты против точного распределения
+        const int shots = 100000;
+        BitstringHistogram counts = mps_sample(mps, shots, 1);
+        double distance = 0;
+        for (size_t i = 0; i < state.size; ++i) {
+            std::string bits(small, '0');
+            for (int q = 0; q < small; ++q) bits[small - 1 - q] = char('0' + ((i >> q) & 1));
+            auto it = counts.find(bits);
+            distance += std::abs((it == counts.end() ? 0.0 : double(it->second) / shots) - std::norm(state.amplitudes[i]));
+        }
+        std::cout << name << " " << small << " qubits: MPS " << seconds * 1000 << "ms, bond " << mps.max_bond
+                  << " (bound " << mps_expected_bond(circuit) << "), fidelity " << mps.fidelity
+                  << ", max |amplitude error| " << max_error << ", TV distance of " << shots << " shots "
+                  << distance / 2 << std::endl;
+    }
+
+    auto circuit = std::make_shared<Circuit>(make_random_circuit(qubits, depth, 19));
+    add_quantum_task(1, 1, false, 0, qubits, circuit, Precision::Double, 1000);
+    {
+        std::lock_guard<std::mutex> queue_lock(queue_mutex);
+        const QuantumTask& task = task_queue.top();
+        std::cout << qubits << " qubits, depth " << depth << ": backend "
+                  << (task.backend == Backend::MPS ? "MPS" : task.cut_plan ? "cut" : "state vector")
+                  << ", bond bound 2^" << mps_bond_bound_log2(*circuit) << ", memory " << (task_memory_bytes(task) >> 10)
+                  << " KB, estimate " << task.duration << "ms" << std::endl;
+    }
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.push_back(std::thread(process_quantum_tasks, i));
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    if (mps_results.empty()) return 1;
+    const MpsResult& result = mps_results.front().second;
+    std::cout << "MPS run: " << result.seconds * 1000 << "ms, bond " << result.max_bond << ", norm " << result.norm
+              << ", P(0) " << result.probability_zero << ", fidelity " << result.fidelity << std::endl;
+    return 0;
+}
+
+// Распределенный вектор: масштабирование от 1 до max_processes процессов со сверкой с
+// моделированием одним процессом, затем задача с шотами через очередь
+int run_distributed_benchmark(int qubits, int depth, int max_processes) {
+    verbose_log = false;
+    auto circuit = std::make_shared<Circuit>(make_random_circuit(qubits, depth, 29));
+    SimulationResult direct = simulate_circuit(*circuit, Precision::Double);
+    std::cout << qubits << " qubits, depth " << depth << ", one process without splitting: "
+              << direct.seconds * 1000 << "ms, P(0) " << direct.probability_zero << std::endl;
+    // Маргинальные вероятности кубитов: P(0) не заметит перепутанной раскладки старших кубитов
+    std::vector<double> probabilities;
+    simulate_circuit(*circuit, Precision::Double, &probabilities);
+    std::vector<double> direct_marginal(qubits, 0.0);
+    for (size_t i = 0; i < probabilities.size(); ++i) {
+        for (int q = 0; q < qubits; ++q) {
+            if ((i >> q) & 1) direct_marginal[q] += probabilities[i];
+        }
+    }
+    probabilities = {};
+    double base = 0;
+    bool mismatch = false;
+    for (int processes = 1; processes <= max_processes; processes *= 2) {
+        DistributedStats stats;
+        SimulationResult result = simulate_distributed(*circuit, processes, &stats);
+        if (stats.processes != processes) {
+            std::cout << "  " << processes << " processes: fewer than " << distributed_min_local_qubits
+                      << " local qubits, skipped" << std::endl;
+            break;
+        }
+        if (processes == 1) base = result.seconds;
+        double marginal_error = 0;
+        for (int q = 0; q < qubits; ++q) {
+            marginal_error = std::max(marginal_error, std::abs(stats.marginal_one[q] - direct_marginal[q]));
+        }
+        if (marginal_error > 1e-9) mismatch = true;
+        std::cout << "  " << processes << " processes: " << result.seconds * 1000 << "ms (speedup "
+                  << base / result.seconds << "), compute " << stats.compute_seconds * 1000 << "ms, exchange "
+                  << stats.exchange_seconds * 1000 << "ms, " << stats.exchanges << " exchanges, "
+                  << (stats.bytes_sent >> 20) << " MB sent, " << stats.overlapped_gates
+                  << " gates overlapped, |P(0) - direct| " << std::abs(result.probability_zero - direct.probability_zero)
+                  << ", max |marginal - direct| " << marginal_error << ", norm " << result.norm << std::endl;
+    }
+
+    distributed_processes = max_processes;
+    add_quantum_task(1, 1, false, 0, qubits, circuit, Precision::Double, 1000, {}, 0, Backend::Distributed);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.push_back(std::thread(process_quantum_tasks, i));
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    return shot_results.empty() || mismatch ? 1 : 0;
+}
+
+// Контрольные точки: скорость записи и чтения плотного и разреженного вектора, затем
+// вытеснение длинной низкоприоритетной задачи критической на одном процессоре
+int run_preemption_demo(int qubits, int depth) {
+    verbose_log = false;
+    Circuit dense = make_random_circuit(qubits, 4, 31);
+    Circuit sparse; // GHZ: две ненулевые амплитуды
+    sparse.qubits = qubits;
+    sparse.add(GateType::H, 0);
+    for (int q = 1; q < qubits; ++q) sparse.add(GateType::CNOT, q - 1, q);
+    std::pair<const char*, const Circuit*> states[] = {{"dense", &dense}, {"GHZ", &sparse}};
+    for (auto [name, circuit] : states) {
+        for (bool compression : {false, true}) {
+            checkpoint_compression = compression;
+            StateVector<double> state(qubits);
+            execute_circuit(state, *circuit);
+            auto checkpoint = write_checkpoint(state, checkpoint_dir + "/qtask_demo.ckpt", circuit->gates.size());
+            if (!checkpoint) {
+                std::cout << "Cannot write checkpoint to " << checkpoint_dir << std::endl;
+                return 1;
+            }
+            StateVector<double> restored(qubits);
+            auto start = std::chrono::steady_clock::now();
+            bool ok = read_checkpoint(*checkpoint, restored);
+            double read_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            ok = ok && std::memcmp(state.amplitudes, restored.amplitudes, state.size * sizeof(state.amplitudes[0])) == 0;
+            double mb = double(checkpoint->raw_bytes) / (1 << 20);
+            std::cout << name << " " << qubits << " qubits" << (compression ? ", compressed" : "") << ": write "
+                      << mb / checkpoint->write_seconds << " MB/s, read " << mb / read_seconds << " MB/s, stored "
+                      << (checkpoint->stored_bytes >> 10) << " of " << (checkpoint->raw_bytes >> 10) << " KB, "
+                      << (ok ? "exact" : "MISMATCH") << std::endl;
+            if (!ok) return 1;
+        }
+    }
+    checkpoint_compression = true;
+
+    // Один процессор: длинная задача приоритета 5, через 100 мс - критическая приоритета 1
+    auto low = std::make_shared<Circuit>(make_random_circuit(qubits, depth, 37));
+    auto urgent = std::make_shared<Circuit>(make_random_circuit(std::max(qubits - 4, 2), 4, 41));
+    SimulationResult direct = simulate_circuit(*low, Precision::Double);
+    bool mismatch = false;
+    for (bool preempt : {false, true}) {
+        preemption_enabled = preempt;
+        dispatch_latency.samples_us.clear();
+        preemptible_results.clear();
+        add_quantum_task(1, 5, false, 0, low->qubits, low, Precision::Double, 0, {}, 0, Backend::StateVector);
+        std::thread worker(process_quantum_tasks, 0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        add_quantum_task(2, 1, true, 0, urgent->qubits, urgent, Precision::Double, 0, {}, 0, Backend::StateVector);
+        worker.join();
+        std::cout << (preempt ? "With" : "Without") << " preemption: critical task waited "
+                  << dispatch_latency.samples_us.at(1) / 1000 << "ms (long task estimate "
+                  << estimate_duration_ms(circuit_cost_features(*low, Precision::Double)) << "ms)" << std::endl;
+        if (!preempt) continue;
+        // Результат длинной задачи после возобновления из контрольной точки против прямого моделирования
+        auto it = std::find_if(preemptible_results.begin(), preemptible_results.end(),
+                               [](const auto& entry) { return entry.first == 1; });
+        if (it == preemptible_results.end()) {
+            std::cout << "  long task P(0) not recorded" << std::endl;
+            mismatch = true;
+            continue;
+        }
+        double difference = std::abs(it->second.probability_zero - direct.probability_zero);
+        std::cout << "  long task P(0) " << it->second.probability_zero << ", uninterrupted P(0) "
+                  << direct.probability_zero << ", difference " << difference << std::endl;
+        if (difference > 1e-9) mismatch = true;
+    }
+    return mismatch ? 1 : 0;
+}
+
+// Частая смена задач: много коротких схем близкого размера через очередь и 4 процессора,
+// без пула векторов и с ним. Отдельно - цикл выделения и обнуления вектора состояния
+int run_pool_churn_benchmark(int task_count, int min_qubits, int max_qubits) {
+    verbose_log = false;
+    cost_based_cutting = false;
+    std::vector<std::shared_ptr<Circuit>> circuits;
+    std::mt19937 gen(17);
+    std::uniform_int_distribution<> qubits_dist(min_qubits, max_qubits);
+    for (int id = 0; id < task_count; ++id) {
+        circuits.push_back(std::make_shared<Circuit>(make_random_circuit(qubits_dist(gen), 1, static_cast<uint32_t>(id))));
+    }
+    auto minor_faults = [] {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_minflt;
+    };
+
+    for (bool pooled : {false, true}) {
+        amplitude_pool_enabled = pooled;
+        amplitude_pool.clear();
+        amplitude_pool.hits = amplitude_pool.misses = amplitude_pool.evicted = 0;
+        for (int id = 0; id < task_count; ++id) {
+            add_quantum_task(id + 1, 1 + id % 5, false, 0, circuits[id]->qubits, circuits[id], Precision::Double, 0, {},
+                             0, Backend::StateVector);
+        }
+        long faults = minor_faults();
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i) {
+            threads.push_back(std::thread(process_quantum_tasks, i));
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        faults = minor_faults() - faults;
+        std::cout << (pooled ? "Pooled:   " : "Unpooled: ") << task_count << " tasks of " << min_qubits << "-"
+                  << max_qubits << " qubits in " << seconds << " s (" << task_count / seconds << " tasks/s), "
+                  << faults << " minor page faults";
+        if (pooled) {
+            std::cout << ", pool hits " << amplitude_pool.hits << ", misses " << amplitude_pool.misses
+                      << ", evicted " << amplitude_pool.evicted << ", cached " << (amplitude_pool.cached_bytes >> 20)
+                      << " MB";
+        }
+        std::cout << std::endl;
+    }
+
+    // Только выделение вектора в |0...0> и освобождение
+    std::cout << "Allocate + reset + free, us per state vector:" << std::endl;
+    for (int n = min_qubits; n <= max_qubits; ++n) {
+        std::cout << "  q=" << n << ":";
+        for (bool pooled : {false, true}) {
+            amplitude_pool_enabled = pooled;
+            int reps = static_cast<int>(std::max<size_t>(4, (size_t(1) << 26) >> n));
+            auto start = std::chrono::steady_clock::now();
+            for (int r = 0; r < reps; ++r) {
+                StateVector<double> state(n);
+                state.amplitudes[state.size - 1] = 1; // Вектор использован: пул должен обнулить его снова
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout << (pooled ? " pooled " : " unpooled ") << seconds / reps * 1e6;
+        }
+        std::cout << std::endl;
+    }
+    amplitude_pool.clear();
+    return 0;
+}
+
+// Замер векторных ядер: амплитуд в секунду на одно ядро для каждого набора инструкций
+int run_gate_benchmark(int min_qubits, int max_qubits) {
+    // Вектор состояния должен занимать не больше половины физической памяти
+    double memory = double(sysconf(_SC_PHYS_PAGES)) * double(sysconf(_SC_PAGESIZE));
+    int memory_qubits = static_cast<int>(std::log2(memory / 2 / sizeof(std::complex<double>)));
+    if (max_qubits > memory_qubits) {
+        std::cout << "Limiting to " << memory_qubits << " qubits by available memory" << std::endl;
+        max_qubits = memory_qubits;
+    }
+
+    const SimdLevel detected = simd_level;
+    std::vector<SimdLevel> levels = {SimdLevel::Scalar};
+    if (detected != SimdLevel::Scalar) levels.push_back(SimdLevel::AVX2);
+    if (detected == SimdLevel::AVX512) levels.push_back(SimdLevel::AVX512);
+    simulation_threads = 1;
+
+    Circuit gates;
+    gates.qubits = max_qubits;
+    std::vector<std::complex<double>> unitary4(16);
+    for (int r = 0; r < 4; ++r) {
+        for (int c = 0; c < 4; ++c) unitary4[r * 4 + c] = std::polar(0.5, (r * c) * M_PI / 2); // матрица ДПФ 4x4
+    }
+    const char* names[] = {"H", "X", "CNOT", "RZ", "U2x2", "U4x4"};
+
+    std::cout << "Detected: " << simd_level_name(detected) << ", amplitudes/s per core (millions)" << std::endl;
+    for (int n = min_qubits; n <= max_qubits; n += 2) {
+        int target = n / 2;
+        gates.gates.clear();
+        gates.matrices.clear();
+        gates.qubits = n;
+        gates.add(GateType::H, target);
+        gates.add(GateType::X, target);
+        gates.add(GateType::CNOT, target, target + 1);
+        gates.add(GateType::RZ, target, -1, 0.3);
+        gates.add(GateType::RX, target, -1, 0.7);
+        gates.add_matrix({target, target + 1}, unitary4.data());
+
+        StateVector<double> state(n);
+        int reps = static_cast<int>(std::max<size_t>(2, (size_t(1) << 26) >> n));
+        for (size_t g = 0; g < gates.gates.size(); ++g) {
+            std::cout << "  q=" << n << " " << names[g] << ":";
+            for (SimdLevel level : levels) {
+                simd_level = level;
+                apply_gate(state, gates.gates[g], gates);
+                auto start = std::chrono::steady_clock::now();
+                for (int r = 0; r < reps; ++r) apply_gate(state, gates.gates[g], gates);
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                std::cout << " " << simd_level_name(level) << " "
+                          << double(state.size) * reps / seconds / 1e6;
+            }
+            std::cout << std::endl;
+        }
+    }
+    simd_level = detected;
+    return 0;
+}
+
+// Замер слияния вентилей: время выполнения случайной схемы и КПФ при разных k
+int run_fusion_benchmark(int qubits, int depth) {
+    std::pair<const char*, Circuit> circuits[] = {
+        {"random", make_random_circuit(qubits, depth, 1)},
+        {"qft", make_qft_circuit(qubits)},
+    };
+    std::cout << "Gate fusion, " << qubits << " qubits, " << simd_level_name(simd_level)
+              << ", threads " << simulation_threads << std::endl;
+    for (auto& [name, circuit] : circuits) {
+        double baseline = 0;
+        for (int k = 1; k <= 5; ++k) {
+            auto start = std::chrono::steady_clock::now();
+            Circuit fused = k > 1 ? fuse_circuit(circuit, k) : circuit;
+            double fuse_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            StateVector<double> state(qubits);
+            start = std::chrono::steady_clock::now();
+            run_circuit(state, fused);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (k == 1) baseline = seconds;
+            std::cout << "  " << name << " k=" << k << ": " << fused.gates.size() << " passes, "
+                      << seconds * 1000 << " ms (fusion " << fuse_seconds * 1000 << " ms), speedup "
+                      << baseline / seconds << "x" << std::endl;
+        }
+    }
+    return 0;
+}
+
+// Замер блочного выполнения: проходы по памяти и время с блоками и без
+int run_blocking_benchmark(int min_qubits, int max_qubits, int depth) {
+    double memory = double(sysconf(_SC_PHYS_PAGES)) * double(sysconf(_SC_PAGESIZE));
+    int memory_qubits = static_cast<int>(std::log2(memory / 2 / sizeof(std::complex<double>)));
+    if (max_qubits > memory_qubits) {
+        std::cout << "Limiting to " << memory_qubits << " qubits by available memory" << std::endl;
+        max_qubits = memory_qubits;
+    }
+    std::cout << "Cache blocking, " << cache_block_qubits << " local qubits, fusion k="
+              << fusion_max_qubits << ", threads " << simulation_threads << std::endl;
+    for (int n = min_qubits; n <= max_qubits; n += 2) {
+        std::pair<const char*, Circuit> circuits[] = {
+            {"random", make_random_circuit(n, depth, 1)},
+            {"qft", make_qft_circuit(n)},
+        };
+        for (auto& [name, circuit] : circuits) {
+            Circuit fused = fusion_max_qubits > 1 ? fuse_circuit(circuit, fusion_max_qubits) : circuit;
+            StateVector<double> state(n);
+            auto start = std::chrono::steady_clock::now();
+            run_circuit(state, fused);
+            double plain = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            start = std::chrono::steady_clock::now();
+            BlockedPlan plan = plan_blocked(fused, cache_block_qubits);
+            run_blocked(state, plan);
+            double blocked = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            size_t sweeps = 0; // Проходы по всему вектору: глобальные вентили, серии по блокам, перестановки
+            for (const BlockedRun& run : plan.runs) sweeps += run.kind == RunKind::Global ? run.end - run.begin : 1;
+            std::cout << "  q=" << n << " " << name << ": plain " << fused.gates.size() << " sweeps, "
+                      << plain * 1000 << " ms; blocked " << sweeps << " sweeps (" << plan.swaps
+                      << " swaps), " << blocked * 1000 << " ms, speedup " << plain / blocked << "x" << std::endl;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    // Инициализация генератора случайных чисел
+    std::srand(std::time(nullptr));
+
+    std::string mode = argc > 1 ? argv[1] : "";
+    if (mode == "placement") {
+        // Режим: ./task_1 placement [реплик] [задач] [макс. кубитов]
+        int replicas = argc > 2 ? std::atoi(argv[2]) : 4;
+        int tasks = argc > 3 ? std::atoi(argv[3]) : 64;
+        int max_qubits = argc > 4 ? std::atoi(argv[4]) : 5;
+        return run_placement_service(std::max(replicas, 1), tasks, std::clamp(max_qubits, 2, 40));
+    }
+    if (mode == "startup-bench") {
+        // Режим: ./task_1 startup-bench [задач]
+        int tasks = argc > 2 ? std::atoi(argv[2]) : 2000;
+        return run_startup_benchmark(std::max(tasks, 1));
+    }
+    if (mode == "simulate") {
+        // Режим: ./task_1 simulate [задач] [мин. кубитов] [макс. кубитов] [глубина] [double|float]
+        int tasks = argc > 2 ? std::atoi(argv[2]) : 8;
+        int min_qubits = argc > 3 ? std::atoi(argv[3]) : 10;
+        int max_qubits = argc > 4 ? std::atoi(argv[4]) : 20;
+        int depth = argc > 5 ? std::atoi(argv[5]) : 20;
+        Precision precision = argc > 6 && std::string(argv[6]) == "float" ? Precision::Float : Precision::Double;
+        return run_simulation_demo(std::max(tasks, 1), std::max(min_qubits, 1),
+                                   std::max(max_qubits, min_qubits), depth, precision);
+    }
+    if (mode == "memory-admission") {
+        // Режим: ./task_1 memory-admission [бюджет, МБ] [задач] [мин. кубитов] [макс. кубитов]
+        int budget_mb = argc > 2 ? std::atoi(argv[2]) : 512;
+        int tasks = argc > 3 ? std::atoi(argv[3]) : 16;
+        int min_qubits = argc > 4 ? std::atoi(argv[4]) : 16;
+        int max_qubits = argc > 5 ? std::atoi(argv[5]) : 24;
+        return run_memory_admission_demo(static_cast<size_t>(std::max(budget_mb, 1)), std::max(tasks, 1),
+                                         std::max(min_qubits, 1), std::clamp(max_qubits, min_qubits, 40));
+    }
+    if (mode == "cut") {
+        // Режим: ./task_1 cut [кубитов] [глубина] [кубитов на процессор]
+        int qubits = argc > 2 ? std::atoi(argv[2]) : 16;
+        int depth = argc > 3 ? std::atoi(argv[3]) : 6;
+        int max_qubits = argc > 4 ? std::atoi(argv[4]) : qubits / 2 + 1;
+        return run_cutting_demo(std::clamp(qubits, 2, 40), std::max(depth, 1), std::max(max_qubits, 1));
+    }
+    if (mode == "check-cost-cut") {
+        // Режим: ./task_1 check-cost-cut - выбор разрезания по стоимости для задач с шотами
+        return run_cost_cut_check();
+    }
+    if (mode == "shots") {
+        // Режим: ./task_1 shots [кубитов] [шотов] [alias|cdf|auto]
+        int qubits = argc > 2 ? std::atoi(argv[2]) : 20;
+        int shots = argc > 3 ? std::atoi(argv[3]) : 1000000;
+        std::string method = argc > 4 ? argv[4] : "auto";
+        SamplingMethod sampling = method == "alias" ? SamplingMethod::Alias
+                                : method == "cdf" ? SamplingMethod::Cumulative : SamplingMethod::Auto;
+        return run_shots_demo(std::clamp(qubits, 1, 30), std::max(shots, 1), sampling);
+    }
+    if (mode == "qasm") {
+        // Режим: ./task_1 qasm <шотов> <файл.qasm>...
+        int shots = argc > 2 ? std::atoi(argv[2]) : 0;
+        std::vector<std::string> files(argv + std::min(argc, 3), argv + argc);
+        if (files.empty()) {
+            std::cout << "Usage: task_1 qasm <shots> <file.qasm>..." << std::endl;
+            return 1;
+        }
+        return run_qasm_files(files, std::max(shots, 0));
+    }
+    if (mode == "bench-qasm") {
+        // Режим: ./task_1 bench-qasm [схем] [кубитов] [глубина]
+        int count = argc > 2 ? std::atoi(argv[2]) : 2000;
+        int qubits = argc > 3 ? std::atoi(argv[3]) : 20;
+        int depth = argc > 4 ? std::atoi(argv[4]) : 20;
+        return run_qasm_benchmark(std::max(count, 1), std::clamp(qubits, 2, qasm_max_qubits), std::max(depth, 1));
+    }
+    if (mode == "cost-model") {
+        // Режим: ./task_1 cost-model [схем] [мин. кубитов] [макс. кубитов]
+        int count = argc > 2 ? std::atoi(argv[2]) : 40;
+        int min_qubits = argc > 3 ? std::atoi(argv[3]) : 8;
+        int max_qubits = argc > 4 ? std::atoi(argv[4]) : 22;
+        return run_cost_model_demo(std::max(count, 2), std::max(min_qubits, 2), std::clamp(max_qubits, min_qubits, 30));
+    }
+    if (mode == "noise") {
+        // Режим: ./task_1 noise [кубитов] [траекторий] [p деполяризации] [gamma затухания]
+        int qubits = argc > 2 ? std::atoi(argv[2]) : 10;
+        int trajectories = argc > 3 ? std::atoi(argv[3]) : 2000;
+        NoiseModel noise;
+        noise.depolarizing = argc > 4 ? std::atof(argv[4]) : 0.01;
+        noise.amplitude_damping = argc > 5 ? std::atof(argv[5]) : 0.01;
+        if (!noise.active()) noise.depolarizing = 0.01;
+        return run_noise_demo(std::clamp(qubits, 1, 28), std::max(trajectories, 1), noise);
+    }
+    if (mode == "noise-backends") {
+        // Режим: ./task_1 noise-backends [макс. кубитов] [p деполяризации] [gamma затухания] [траекторий]
+        int max_qubits = argc > 2 ? std::atoi(argv[2]) : 12;
+        NoiseModel noise;
+        noise.depolarizing = argc > 3 ? std::atof(argv[3]) : 0.01;
+        noise.amplitude_damping = argc > 4 ? std::atof(argv[4]) : 0.01;
+        int trajectories = argc > 5 ? std::atoi(argv[5]) : 200;
+        return run_backend_choice_demo(std::clamp(max_qubits, 2, density_max_qubits), noise, std::max(trajectories, 1));
+    }
+    if (mode == "mps") {
+        // Режим: ./task_1 mps [кубитов] [глубина] [макс. размерность связи]
+        int qubits = argc > 2 ? std::atoi(argv[2]) : 64;
+        int depth = argc > 3 ? std::atoi(argv[3]) : 8;
+        int max_bond = argc > 4 ? std::atoi(argv[4]) : 64;
+        return run_mps_demo(std::clamp(qubits, 2, 1000), std::max(depth, 1), std::clamp(max_bond, 1, 1024));
+    }
+    if (mode == "distributed") {
+        // Режим: ./task_1 distributed [кубитов] [глубина] [макс. процессов]
+        int qubits = argc > 2 ? std::atoi(argv[2]) : 22;
+        int depth = argc > 3 ? std::atoi(argv[3]) : 10;
+        int processes = argc > 4 ? std::atoi(argv[4]) : 8;
+        return run_distributed_benchmark(std::clamp(qubits, distributed_min_local_qubits, 34), std::max(depth, 1),
+                                         std::clamp(processes, 1, 64));
+    }
+    if (mode == "preempt") {
+        // Режим: ./task_1 preempt [кубитов] [глубина длинной задачи]
+        int qubits = argc > 2 ? std::atoi(argv[2]) : 20;
+        int depth = argc > 3 ? std::atoi(argv[3]) : 60;
+        return run_preemption_demo(std::clamp(qubits, 6, 30), std::max(depth, 1));
+    }
+    if (mode == "pool-churn") {
+        // Режим: ./task_1 pool-churn [задач] [мин. кубитов] [макс. кубитов]
+        int task_count = argc > 2 ? std::atoi(argv[2]) : 400;
+        int min_qubits = argc > 3 ? std::atoi(argv[3]) : 16;
+        int max_qubits = argc > 4 ? std::atoi(argv[4]) : 20;
+        min_qubits = std::clamp(min_qubits, 4, 28);
+        return run_pool_churn_benchmark(std::max(task_count, 1), min_qubits, std::clamp(max_qubits, min_qubits, 28));
+    }
+    if (mode == "bench-gates") {
+        // Режим: ./task_1 bench-gates [мин. кубитов] [макс. кубитов]
+        int min_qubits = argc > 2 ? std::atoi(argv[2]) : 10;
+        int max_qubits = argc > 3 ? std::atoi(argv[3]) : 30;
+        return run_gate_benchmark(std::max(min_qubits, 4), std::max(max_qubits, min_qubits));
+    }
+    if (mode == "bench-fusion") {
+        // Режим: ./task_1 bench-fusion [кубитов] [глубина случайной схемы]
+        int qubits = argc > 2 ? std::atoi(argv[2]) : 22;
+        int depth = argc > 3 ? std::atoi(argv[3]) : 20;
+        return run_fusion_benchmark(std::clamp(qubits, 6, 32), std::max(depth, 1));
+    }
+    if (mode == "bench-blocking") {
+        // Режим: ./task_1 bench-blocking [мин. кубитов] [макс. кубитов] [глубина случайной схемы] [k слияния]
+        int min_qubits = argc > 2 ? std::atoi(argv[2]) : 24;
+        int max_qubits = argc > 3 ? std::atoi(argv[3]) : 30;
+        int depth = argc > 4 ? std::atoi(argv[4]) : 20;
+        if (argc > 5) fusion_max_qubits = std::atoi(argv[5]);
+        return run_blocking_benchmark(std::max(min_qubits, 6), std::max(max_qubits, min_qubits), std::max(depth, 1));
+    }
+    if (mode == "warm") {
+        // Обычная работа, но с прогревом перед добавлением задач
+        warmup.enabled = true;
+        huge_page_mode = HugePageMode::Transparent;
+        warm_up_scheduler();
+    }
 
     // Добавляем задачи в очередь
     // ID, приоритет, критическая, длительность (мс), кубиты
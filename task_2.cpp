@@ -7,14 +7,189 @@
 #include <atomic>
 #include <chrono>
 #include <random>
+#include <algorithm>
+#include <string>
+#include <deque>
+#include <map>
+#include <fstream>
+#include <filesystem>
+#include <iterator>
+#include <memory>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <cmath>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#include <cstring>
+
+// ===================== Память на huge pages =====================
+// Крупные массивы (хранилище очереди) и участки пула полезной нагрузки выделяются
+// блоками, кратными 2 МБ. В режиме Explicit сначала пробуется MAP_HUGETLB
+// (зарезервированные huge pages), при неудаче - обычное выровненное отображение
+// с madvise(MADV_HUGEPAGE), как в режиме Transparent.
+
+enum class HugePageMode { Off, Transparent, Explicit };
+
+HugePageMode huge_page_mode = HugePageMode::Off;
+const size_t huge_page_size = 2 * 1024 * 1024;
+std::atomic<size_t> hugetlb_bytes(0); // Сколько получено через MAP_HUGETLB
+
+size_t round_to_huge_page(size_t bytes) {
+    return (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+}
+
+void* huge_page_alloc(size_t bytes) {
+    size_t rounded = round_to_huge_page(bytes);
+    if (huge_page_mode == HugePageMode::Explicit) {
+        void* ptr = mmap(nullptr, rounded, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED) {
+            hugetlb_bytes += rounded;
+            return ptr;
+        }
+    }
+    // Берем с запасом и отрезаем края, чтобы участок начинался на границе 2 МБ
+    void* raw = mmap(nullptr, rounded + huge_page_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) throw std::bad_alloc();
+    uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+    uintptr_t aligned = (start + huge_page_size - 1) / huge_page_size * huge_page_size;
+    if (aligned > start) {
+        munmap(raw, aligned - start);
+    }
+    size_t tail = huge_page_size - (aligned - start);
+    if (tail > 0) {
+        munmap(reinterpret_cast<void*>(aligned + rounded), tail);
+    }
+    if (huge_page_mode != HugePageMode::Off) {
+        madvise(reinterpret_cast<void*>(aligned), rounded, MADV_HUGEPAGE);
+    }
+    return reinterpret_cast<void*>(aligned);
+}
+
+void huge_page_free(void* ptr, size_t bytes) {
+    munmap(ptr, round_to_huge_page(bytes));
+}
+
+// Пул блоков полезной нагрузки: классы размеров 64-1024 байт нарезаются из участков
+// по 2 МБ; освобожденные блоки хранятся в списках свободных своего класса.
+// Это арена: участки не возвращаются системе до завершения процесса, и блок, однажды
+// отданный классу, остается в нем. Поэтому размер арены - пик одновременно живых
+// нагрузок (плюс warmup.payload_reserve), а не текущая нагрузка.
+struct PayloadPool {
+    static const size_t class_count = 5;
+    static const size_t min_block = 64;
+    static const size_t max_block = min_block << (class_count - 1);
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    std::mutex mutex;
+    FreeBlock* free_lists[class_count] = {};
+    char* cursor = nullptr;
+    char* chunk_end = nullptr;
+    std::vector<char*> spare_chunks; // Заранее подготовленные участки
+
+    static size_t class_of(size_t bytes) {
+        size_t index = 0;
+        while ((min_block << index) < bytes) ++index;
+        return index;
+    }
+
+    void* allocate(size_t bytes) {
+        size_t index = class_of(bytes);
+        size_t block = min_block << index;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (FreeBlock* head = free_lists[index]) {
+            free_lists[index] = head->next;
+            return head;
+        }
+        if (cursor == nullptr || cursor + block > chunk_end) {
+            if (spare_chunks.empty()) {
+                cursor = static_cast<char*>(huge_page_alloc(huge_page_size));
+            } else {
+                cursor = spare_chunks.back();
+                spare_chunks.pop_back();
+            }
+            chunk_end = cursor + huge_page_size;
+        }
+        void* ptr = cursor;
+        cursor += block;
+        return ptr;
+    }
+
+    void deallocate(void* ptr, size_t bytes) {
+        size_t index = class_of(bytes);
+        std::lock_guard<std::mutex> lock(mutex);
+        FreeBlock* block = static_cast<FreeBlock*>(ptr);
+        block->next = free_lists[index];
+        free_lists[index] = block;
+    }
+
+    // Подготовка участков заранее с касанием всех страниц
+    void reserve(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t done = 0; done < bytes; done += huge_page_size) {
+            char* chunk = static_cast<char*>(huge_page_alloc(huge_page_size));
+            std::memset(chunk, 0, huge_page_size);
+            spare_chunks.push_back(chunk);
+        }
+    }
+};
+
+PayloadPool payload_pool;
+
+// Аллокатор строк полезной нагрузки: небольшие блоки - из пула, крупные - из кучи
+template <typename T>
+struct PayloadAllocator {
+    using value_type = T;
+
+    PayloadAllocator() = default;
+    template <typename U>
+    PayloadAllocator(const PayloadAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        size_t bytes = n * sizeof(T);
+        if (bytes > PayloadPool::max_block) {
+            return static_cast<T*>(::operator new(bytes));
+        }
+        return static_cast<T*>(payload_pool.allocate(bytes));
+    }
+
+    void deallocate(T* ptr, size_t n) {
+        size_t bytes = n * sizeof(T);
+        if (bytes > PayloadPool::max_block) {
+            ::operator delete(ptr);
+        } else {
+            payload_pool.deallocate(ptr, bytes);
+        }
+    }
+
+    template <typename U>
+    bool operator==(const PayloadAllocator<U>&) const { return true; }
+};
+
+using Payload = std::basic_string<char, std::char_traits<char>, PayloadAllocator<char>>;
 
 // Структура данных от станции мониторинга
 struct MonitoringData {
     int station_id;     // ID станции (1-10)
     int priority;       // Приоритет данных (1 - высший)
     bool is_critical;   // Критически важные данные
-    std::string payload;// Полезная нагрузка (данные)
+    Payload payload;    // Полезная нагрузка (данные)
     size_t size;        // Размер данных в байтах
+    uint64_t seq = 0;   // Номер в журнале принятых сообщений (для репликации)
+    int batch_count = 1;// Сколько сообщений станций сведено в это сообщение
+    std::chrono::steady_clock::time_point accepted_at{}; // Момент приема в очередь
 };
 
 // Компаратор для очереди с приоритетами
@@ -33,21 +208,137 @@ struct ComparePriority {
     }
 };
 
+// ===================== Прогрев при запуске =====================
+// Без прогрева очередь растет постепенно, страницы памяти выделяются при первом
+// обращении, а обработчиков создается столько, сколько нужно в начале. Прогрев
+// резервирует и заранее касается хранилища очереди, создает обработчики на
+// максимальную емкость сервера и закрепляет их за ядрами. Крупные блоки хранилища
+// размещаются согласно huge_page_mode.
+
+struct WarmupConfig {
+    bool enabled = false;
+    size_t queue_capacity = 1 << 16; // Резерв сообщений в очереди
+    bool pin_threads = true;         // Закрепить обработчики за ядрами
+    int handlers = 10;               // Обработчиков и ресурсов сервера сразу (от 5 до максимума 10)
+    size_t payload_reserve = 8 * huge_page_size; // Заранее подготовленная память пула нагрузки
+};
+
+WarmupConfig warmup;
+
+// Аллокатор хранилища очереди: крупные блоки размещаются на huge pages (если включено)
+template <typename T>
+struct QueueAllocator {
+    using value_type = T;
+
+    QueueAllocator() = default;
+    template <typename U>
+    QueueAllocator(const QueueAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        size_t bytes = n * sizeof(T);
+        if (bytes < huge_page_size) {
+            return static_cast<T*>(::operator new(bytes));
+        }
+        return static_cast<T*>(huge_page_alloc(bytes));
+    }
+
+    void deallocate(T* ptr, size_t n) {
+        size_t bytes = n * sizeof(T);
+        if (bytes < huge_page_size) {
+            ::operator delete(ptr);
+        } else {
+            huge_page_free(ptr, bytes);
+        }
+    }
+
+    template <typename U>
+    bool operator==(const QueueAllocator<U>&) const { return true; }
+};
+
+using DataStorage = std::vector<MonitoringData, QueueAllocator<MonitoringData>>;
+
+// Очередь сервера с доступом к хранилищу (нужен для вытеснения по приоритету)
+struct DataQueue : std::priority_queue<MonitoringData, DataStorage, ComparePriority> {
+    using std::priority_queue<MonitoringData, DataStorage, ComparePriority>::priority_queue;
+
+    DataStorage& storage() { return c; }
+};
+
 // Глобальные переменные
-std::priority_queue<MonitoringData, std::vector<MonitoringData>, ComparePriority> data_queue;
+DataQueue data_queue;
 std::mutex queue_mutex;
 std::mutex cout_mutex;
-std::counting_semaphore<5> server_capacity(5); // Начальная емкость сервера - 5 обработчиков
+std::counting_semaphore<10> server_capacity(5); // Начальная емкость сервера - 5 обработчиков (до 10)
 std::atomic<size_t> current_load(0);           // Текущая загрузка сервера в %
 std::atomic<bool> emergency_mode(false);       // Режим аварии
 std::atomic<int> active_handlers(5);           // Количество активных обработчиков
+bool verbose_log = true;                       // Подробный вывод станций и сервера
+std::atomic<long> server_operations(0);        // Сообщений, обработанных сервером
+std::atomic<long> server_station_messages(0);  // Сообщений станций в них (с учетом сводок)
+std::chrono::steady_clock::time_point program_start = std::chrono::steady_clock::now();
+
+// Задержки от приема данных до начала их обработки сервером
+struct LatencyRecorder {
+    std::mutex mutex;
+    std::vector<double> samples_us;
+    double first_dispatch_us = 0; // От запуска программы до первой обработки
+
+    void record(std::chrono::steady_clock::time_point accepted_at) {
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(mutex);
+        if (samples_us.empty()) {
+            first_dispatch_us = std::chrono::duration<double, std::micro>(now - program_start).count();
+        }
+        samples_us.push_back(std::chrono::duration<double, std::micro>(now - accepted_at).count());
+    }
+
+    void print(const char* label) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (samples_us.empty()) return;
+        std::vector<double> sorted = samples_us;
+        std::sort(sorted.begin(), sorted.end());
+        double total = 0;
+        for (double us : sorted) total += us;
+        std::cout << label << ": первая обработка через " << first_dispatch_us << " мкс, задержка ср. "
+                  << total / sorted.size() << " мкс, p99 " << sorted[sorted.size() * 99 / 100]
+                  << " мкс, макс. " << sorted.back() << " мкс (" << sorted.size() << " сообщений)" << std::endl;
+    }
+};
+
+LatencyRecorder dispatch_latency;
+
+// Закрепление текущего потока за ядром
+void pin_current_thread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % std::max(1u, std::thread::hardware_concurrency()), &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+// Прогрев: резерв емкости очереди с предварительным касанием страниц
+void warm_up_server() {
+    if (!warmup.enabled) return;
+    DataStorage storage;
+    storage.reserve(warmup.queue_capacity);
+    // resize записывает каждый элемент, и ядро выделяет страницы сразу; clear сохраняет емкость
+    storage.resize(warmup.queue_capacity);
+    storage.clear();
+    payload_pool.reserve(warmup.payload_reserve);
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    while (!data_queue.empty()) {
+        storage.push_back(data_queue.top());
+        data_queue.pop();
+    }
+    data_queue = DataQueue(ComparePriority(), std::move(storage));
+}
 
 // Функция для обработки данных на сервере
 void process_data(const MonitoringData& data) {
     // Захватываем ресурс сервера
     server_capacity.acquire();
+    dispatch_latency.record(data.accepted_at);
     
-    {
+    if (verbose_log) {
         std::lock_guard<std::mutex> lock(cout_mutex);
         std::cout << "[Сервер] Обработка данных от станции " << data.station_id 
                   << " (приоритет " << data.priority 
@@ -60,101 +351,1082 @@ void process_data(const MonitoringData& data) {
     
     // Освобождаем ресурс
     server_capacity.release();
+    server_operations++;
+    server_station_messages += data.batch_count;
     
-    {
+    if (verbose_log) {
         std::lock_guard<std::mutex> lock(cout_mutex);
         std::cout << "[Сервер] Данные от станции " << data.station_id << " обработаны" << std::endl;
     }
 }
 
+// ===================== Вытеснение очереди на диск =====================
+// Когда память очереди выше верхней отметки, некритические сообщения с низким
+// приоритетом не отбрасываются, а дописываются в сегментированный журнал на диске
+// (последовательная запись большими блоками). Когда память опускается ниже нижней
+// отметки, отдельный поток возвращает их в очередь. Следующий сегмент читается
+// целиком заранее, поэтому обработчики никогда не ждут диска. Прочитанные заранее
+// сообщения занимают память наравне с очередью и учитываются в ограничении. Буфер записи
+// и сегмент при включении журнала урезаются до 1/20 ограничения памяти (сегмент
+// дописывается буфером целиком и может дойти до 1/10), чтобы упреждающее чтение не
+// вытесняло саму очередь.
+
+struct SpillConfig {
+    bool enabled = false;
+    std::string directory = "spill";
+    size_t segment_bytes = 4 * 1024 * 1024;       // Размер сегмента журнала
+    size_t write_buffer_max = 8 * 1024 * 1024;    // Максимум данных, ожидающих записи
+    int min_priority = 3;                         // На диск - приоритет не выше этого (число не меньше)
+};
+
+SpillConfig spill;
+std::mutex spill_mutex;
+std::condition_variable spill_cv;
+std::string spill_write_buffer;                 // Сериализованные сообщения для записи
+std::deque<int> spill_closed_segments;          // Закрытые сегменты, от старых к новым
+int spill_current_segment = 0;
+size_t spill_current_bytes = 0;                 // Записано в текущий сегмент
+std::atomic<long> spill_on_disk(0);             // Сообщений в журнале (включая буфер записи)
+std::atomic<long> spilled_total(0);
+std::atomic<long> refilled_total(0);
+std::atomic<size_t> spill_prefetched_bytes(0);  // Память прочитанных заранее и еще не возвращенных
+bool spill_stop = false;                        // Штатное завершение: удалить журнал
+
+template <typename T>
+void append_raw(std::string& buffer, const T& value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+bool read_raw(const char*& ptr, const char* end, T& value) {
+    if (end - ptr < static_cast<std::ptrdiff_t>(sizeof(value))) return false;
+    std::memcpy(&value, ptr, sizeof(value));
+    ptr += sizeof(value);
+    return true;
+}
+
+// Формат сообщения в журнале и при репликации. Момент приема хранится в тиках
+// steady_clock: часы общие для процесса и резерва, созданного fork
+void append_message(std::string& buffer, const MonitoringData& data) {
+    append_raw(buffer, data.seq);
+    append_raw(buffer, data.station_id);
+    append_raw(buffer, data.priority);
+    append_raw(buffer, data.is_critical);
+    append_raw(buffer, static_cast<int64_t>(data.accepted_at.time_since_epoch().count()));
+    append_raw(buffer, static_cast<uint64_t>(data.size));
+    append_raw(buffer, static_cast<uint32_t>(data.payload.size()));
+    buffer.append(data.payload.data(), data.payload.size());
+}
+
+bool read_message(const char*& ptr, const char* end, MonitoringData& data) {
+    int64_t accepted_ticks;
+    uint64_t size;
+    uint32_t payload_len;
+    if (!read_raw(ptr, end, data.seq) || !read_raw(ptr, end, data.station_id) ||
+        !read_raw(ptr, end, data.priority) || !read_raw(ptr, end, data.is_critical) ||
+        !read_raw(ptr, end, accepted_ticks) || !read_raw(ptr, end, size) || !read_raw(ptr, end, payload_len) ||
+        end - ptr < static_cast<std::ptrdiff_t>(payload_len)) {
+        return false;
+    }
+    data.accepted_at = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(accepted_ticks));
+    data.size = size;
+    data.payload.assign(ptr, payload_len);
+    ptr += payload_len;
+    return true;
+}
+
+std::string spill_segment_path(int segment) {
+    return spill.directory + "/segment_" + std::to_string(segment) + ".log";
+}
+
+// Отправка сообщения в журнал; false - буфер записи переполнен
+bool spill_data(const MonitoringData& data) {
+    {
+        std::lock_guard<std::mutex> lock(spill_mutex);
+        if (spill_write_buffer.size() >= spill.write_buffer_max) return false;
+        append_message(spill_write_buffer, data);
+    }
+    spill_on_disk++;
+    spilled_total++;
+    spill_cv.notify_one();
+    return true;
+}
+
+// ===================== Учет памяти очереди =====================
+// queue_memory_bytes - точный объем памяти, занятой сообщениями в очереди:
+// сама структура плюс блок полезной нагрузки (с учетом округления до класса пула).
+// При заданном ограничении queue_memory_cap новое сообщение, которое не помещается,
+// вытесняет из очереди наименее важные некритические сообщения (до нижней отметки
+// 90% ограничения, чтобы вытеснение не происходило на каждом сообщении). Критические
+// сообщения вытесняются только ради другого, более важного критического сообщения.
+// Если места все равно нет, новое сообщение отклоняется.
+
+size_t queue_memory_cap = 0;                   // Ограничение в байтах (0 - без ограничения)
+std::atomic<size_t> queue_memory_bytes(0);     // Датчик: память сообщений в очереди
+std::atomic<size_t> queue_memory_peak(0);      // Максимум датчика
+std::atomic<long> shed_messages(0);            // Вытеснено из очереди
+std::atomic<long> rejected_messages(0);        // Отклонено при приеме
+// Последнее сообщение, которому не хватило места: не более важные и не меньшие
+// отклоняются сразу, без пересортировки очереди, пока из нее ничего не извлечено
+bool shed_floor_valid = false;
+MonitoringData shed_floor;
+size_t shed_floor_bytes = 0;
+
+// Память, занятая одним сообщением в очереди. Считается по длине нагрузки, а не по
+// capacity(): в очередь попадает копия строки, и у копии емкость равна длине
+size_t message_footprint(const MonitoringData& data) {
+    static const size_t inline_capacity = Payload().capacity();
+    size_t bytes = sizeof(MonitoringData);
+    if (data.payload.size() > inline_capacity) {
+        size_t heap = data.payload.size() + 1;
+        bytes += heap <= PayloadPool::max_block ? PayloadPool::min_block << PayloadPool::class_of(heap) : heap;
+    }
+    return bytes;
+}
+
+// Освобождение места под сообщение размера bytes (вызывается под queue_mutex).
+// Возвращает false, если сообщение нужно отклонить; номера вытесненных - в shed_seqs
+bool make_room_locked(const MonitoringData& incoming, size_t bytes, std::vector<uint64_t>& shed_seqs) {
+    size_t used = queue_memory_bytes.load() + spill_prefetched_bytes.load();
+    if (used + bytes <= queue_memory_cap) return true;
+
+    ComparePriority less;
+    if (shed_floor_valid && bytes >= shed_floor_bytes && !less(shed_floor, incoming)) {
+        return false;
+    }
+    DataStorage& items = data_queue.storage();
+    // Самые важные - в начале, кандидаты на вытеснение - в конце
+    std::sort(items.begin(), items.end(),
+              [&less](const MonitoringData& a, const MonitoringData& b) { return less(b, a); });
+
+    size_t low_mark = queue_memory_cap / 10 * 9;
+    size_t need = used + bytes - std::min(low_mark, used + bytes);
+    size_t must_free = used + bytes - queue_memory_cap;
+    std::vector<bool> shed(items.size(), false);
+    size_t freed = 0;
+    for (int pass = 0; pass < 2 && freed < need; ++pass) {
+        // Второй проход (по критическим) - только ради критического сообщения
+        if (pass == 1 && !incoming.is_critical) break;
+        for (size_t i = items.size(); i-- > 0 && freed < need;) {
+            if (shed[i] || (pass == 0 && items[i].is_critical)) continue;
+            if (!less(items[i], incoming)) break; // Остальные не менее важны, чем новое
+            shed[i] = true;
+            freed += message_footprint(items[i]);
+        }
+    }
+
+    if (freed < must_free) {
+        std::make_heap(items.begin(), items.end(), less);
+        shed_floor_valid = true;
+        shed_floor.priority = incoming.priority;
+        shed_floor.is_critical = incoming.is_critical;
+        shed_floor.size = incoming.size;
+        shed_floor_bytes = bytes;
+        return false;
+    }
+    shed_floor_valid = false;
+    size_t kept = 0;
+    size_t dropped_before = shed_seqs.size();
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (shed[i]) {
+            // Некритические при включенном журнале не теряются, а уходят на диск
+            if (!(spill.enabled && !items[i].is_critical && spill_data(items[i]))) {
+                shed_seqs.push_back(items[i].seq);
+            }
+            continue;
+        }
+        if (kept != i) items[kept] = std::move(items[i]);
+        ++kept;
+    }
+    items.erase(items.begin() + kept, items.end());
+    std::make_heap(items.begin(), items.end(), less);
+    queue_memory_bytes -= freed;
+    shed_messages += static_cast<long>(shed_seqs.size() - dropped_before);
+    return true;
+}
+
+// Постановка сообщения в очередь с учетом ограничения памяти
+bool enqueue_data(const MonitoringData& data, std::vector<uint64_t>& shed_seqs) {
+    size_t bytes = message_footprint(data);
+    // Выше верхней отметки низкоприоритетные данные уходят на диск
+    if (spill.enabled && queue_memory_cap > 0 && !data.is_critical && data.priority >= spill.min_priority
+        && queue_memory_bytes + spill_prefetched_bytes + bytes > queue_memory_cap / 10 * 9 && spill_data(data)) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    if (queue_memory_cap > 0 && !make_room_locked(data, bytes, shed_seqs)) {
+        rejected_messages++;
+        return false;
+    }
+    data_queue.push(data);
+    size_t used = queue_memory_bytes += bytes;
+    if (used > queue_memory_peak) queue_memory_peak = used;
+    return true;
+}
+
+// Вывод датчика памяти очереди
+void print_memory_gauge(const char* prefix) {
+    std::cout << prefix << " Память очереди: " << queue_memory_bytes / 1024 << " КБ (пик "
+              << queue_memory_peak / 1024 << " КБ";
+    if (queue_memory_cap > 0) {
+        std::cout << ", лимит " << queue_memory_cap / 1024 << " КБ";
+    }
+    std::cout << "), вытеснено " << shed_messages << ", отклонено " << rejected_messages << std::endl;
+    if (spill.enabled) {
+        std::cout << prefix << " Журнал на диске: записано " << spilled_total << ", возвращено "
+                  << refilled_total << ", ожидает " << spill_on_disk << ", прочитано заранее "
+                  << spill_prefetched_bytes / 1024 << " КБ" << std::endl;
+    }
+}
+
+// Извлечение самого важного сообщения из очереди
+bool take_data(MonitoringData& data) {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    if (data_queue.empty()) return false;
+    data = data_queue.top();
+    data_queue.pop();
+    size_t used = queue_memory_bytes -= message_footprint(data);
+    shed_floor_valid = false;
+    if (spill.enabled && used < queue_memory_cap / 2 && spill_on_disk > 0) {
+        spill_cv.notify_one();
+    }
+    return true;
+}
+
+// Поток журнала на диске: запись буфера, упреждающее чтение сегмента и возврат в очередь
+void spill_worker() {
+    std::error_code ec;
+    std::filesystem::create_directories(spill.directory, ec);
+    std::ofstream out(spill_segment_path(spill_current_segment), std::ios::binary | std::ios::trunc);
+    std::deque<MonitoringData> prefetched; // Прочитанный заранее сегмент
+    std::string write_chunk;
+
+    while (true) {
+        bool refill_wanted = queue_memory_bytes < queue_memory_cap / 2;
+        {
+            std::unique_lock<std::mutex> lock(spill_mutex);
+            spill_cv.wait_for(lock, std::chrono::milliseconds(50));
+            if (spill_stop) break;
+            write_chunk.swap(spill_write_buffer);
+        }
+
+        // Последовательная запись накопленного в текущий сегмент
+        if (!write_chunk.empty()) {
+            out.write(write_chunk.data(), static_cast<std::streamsize>(write_chunk.size()));
+            spill_current_bytes += write_chunk.size();
+            write_chunk.clear();
+        }
+        // Закрываем сегмент, если он заполнен или его данные уже нужны для возврата
+        bool need_data = refill_wanted && prefetched.empty() && spill_closed_segments.empty();
+        if (spill_current_bytes >= spill.segment_bytes || (need_data && spill_current_bytes > 0)) {
+            out.close();
+            spill_closed_segments.push_back(spill_current_segment++);
+            spill_current_bytes = 0;
+            out.open(spill_segment_path(spill_current_segment), std::ios::binary | std::ios::trunc);
+        }
+
+        // Упреждающее чтение самого старого сегмента целиком
+        if (prefetched.empty() && !spill_closed_segments.empty()) {
+            std::string path = spill_segment_path(spill_closed_segments.front());
+            spill_closed_segments.pop_front();
+            std::ifstream in(path, std::ios::binary);
+            std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            const char* ptr = content.data();
+            const char* end = ptr + content.size();
+            MonitoringData data;
+            size_t bytes = 0;
+            while (read_message(ptr, end, data)) {
+                bytes += message_footprint(data);
+                prefetched.push_back(std::move(data));
+            }
+            spill_prefetched_bytes += bytes;
+            std::filesystem::remove(path, ec);
+        }
+
+        // Возврат в очередь, пока память не поднимется до 70% ограничения
+        if (!prefetched.empty() && queue_memory_bytes < queue_memory_cap / 2) {
+            size_t target = queue_memory_cap / 10 * 7;
+            long moved = 0;
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                while (!prefetched.empty() && queue_memory_bytes < target) {
+                    size_t bytes = message_footprint(prefetched.front());
+                    queue_memory_bytes += bytes;
+                    spill_prefetched_bytes -= bytes;
+                    data_queue.push(std::move(prefetched.front()));
+                    prefetched.pop_front();
+                    ++moved;
+                }
+                if (queue_memory_bytes > queue_memory_peak) queue_memory_peak = queue_memory_bytes.load();
+            }
+            spill_on_disk -= moved;
+            refilled_total += moved;
+        }
+    }
+
+    // Штатное завершение: сообщения журнала больше не нужны, удаляем сегменты и каталог
+    // (каталог - только если в нем не осталось чужих файлов)
+    out.close();
+    for (int segment = 0; segment <= spill_current_segment; ++segment) {
+        std::filesystem::remove(spill_segment_path(segment), ec);
+    }
+    std::filesystem::remove(spill.directory, ec);
+}
+
+// Остановка потока журнала с удалением его файлов
+void spill_shutdown(std::thread& worker) {
+    {
+        std::lock_guard<std::mutex> lock(spill_mutex);
+        spill_stop = true;
+    }
+    spill_cv.notify_all();
+    worker.join();
+}
+
+// ===================== Репликация журнала принятых сообщений =====================
+// Основной процесс пересылает принятые сообщения и отметки об их обработке резервному
+// процессу пачками, не дожидаясь подтверждения предыдущей пачки (конвейер).
+// В синхронном режиме станция считает данные принятыми только после подтверждения
+// резерва; в асинхронном - сразу. При падении основного резерв переносит
+// необработанные сообщения в свою очередь и запускает обработчики.
+
+enum class ReplicationMode { None, Async, Sync };
+
+ReplicationMode replication_mode = ReplicationMode::None;
+int replication_fd = -1;                        // Сокет к резервному процессу
+const size_t replication_batch_max = 256;       // Максимум сообщений в одной пачке
+std::mutex replication_mutex;
+std::condition_variable replication_cv;         // Новые данные для отправки
+std::condition_variable replication_ack_cv;     // Пришло подтверждение от резерва
+
+// Состояние репликации одного запуска (под replication_mutex); перед запуском создается заново
+struct ReplicationState {
+    std::deque<MonitoringData> pending; // Принятые, но еще не отправленные
+    std::vector<uint64_t> processed;    // Обработанные, но еще не отправленные
+    uint64_t next_seq = 1;
+    uint64_t sent_seq = 0;              // Последнее отправленное резерву сообщение
+    uint64_t acked = 0;                 // Последний подтвержденный номер
+    bool stop = false;
+};
+
+ReplicationState replication;
+
+bool send_all(int fd, const void* data, size_t len) {
+    const char* ptr = static_cast<const char*>(data);
+    while (len > 0) {
+        ssize_t n = ::send(fd, ptr, len, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        ptr += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool recv_all(int fd, void* data, size_t len) {
+    char* ptr = static_cast<char*>(data);
+    while (len > 0) {
+        ssize_t n = ::recv(fd, ptr, len, 0);
+        if (n <= 0) return false;
+        ptr += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Отметка об обработке сообщения, чтобы резерв не повторял его после переключения
+void replication_mark_processed(uint64_t seq) {
+    if (replication_mode == ReplicationMode::None || seq == 0) return;
+    {
+        std::lock_guard<std::mutex> lock(replication_mutex);
+        replication.processed.push_back(seq);
+    }
+    replication_cv.notify_one();
+}
+
+// Прием данных в очередь сервера с учетом репликации
+void accept_data(MonitoringData& data) {
+    data.accepted_at = std::chrono::steady_clock::now();
+    uint64_t seq = 0;
+    if (replication_mode != ReplicationMode::None) {
+        std::lock_guard<std::mutex> lock(replication_mutex);
+        seq = replication.next_seq++;
+        data.seq = seq;
+        replication.pending.push_back(data);
+    }
+    if (seq != 0) {
+        replication_cv.notify_one();
+    }
+
+    // Вытесненные и отклоненные сообщения резерв тоже должен забыть
+    std::vector<uint64_t> shed_seqs;
+    if (!enqueue_data(data, shed_seqs)) {
+        shed_seqs.push_back(seq);
+    }
+    for (uint64_t shed_seq : shed_seqs) {
+        replication_mark_processed(shed_seq);
+    }
+
+    // Синхронный режим: ждем подтверждения от резерва
+    if (replication_mode == ReplicationMode::Sync) {
+        std::unique_lock<std::mutex> lock(replication_mutex);
+        replication_ack_cv.wait(lock, [seq] { return replication.acked >= seq || replication.stop; });
+    }
+}
+
+// Поток отправки пачек резервному процессу
+void replication_sender() {
+    std::string buffer;
+    while (true) {
+        std::vector<MonitoringData> batch;
+        std::vector<uint64_t> processed;
+        {
+            std::unique_lock<std::mutex> lock(replication_mutex);
+            replication_cv.wait(lock, [] {
+                return !replication.pending.empty() || !replication.processed.empty() || replication.stop;
+            });
+            if (replication.pending.empty() && replication.processed.empty()) break;
+            size_t count = std::min(replication.pending.size(), replication_batch_max);
+            batch.assign(std::make_move_iterator(replication.pending.begin()),
+                         std::make_move_iterator(replication.pending.begin() + count));
+            replication.pending.erase(replication.pending.begin(), replication.pending.begin() + count);
+            if (!batch.empty()) replication.sent_seq = batch.back().seq;
+            // Обработчик может отметить сообщение раньше, чем оно уйдет резерву. Такая отметка
+            // ждет следующей пачки, иначе резерв удалит еще не полученное сообщение
+            auto unsent = std::partition(replication.processed.begin(), replication.processed.end(),
+                                         [](uint64_t seq) { return seq <= replication.sent_seq; });
+            processed.assign(replication.processed.begin(), unsent);
+            replication.processed.erase(replication.processed.begin(), unsent);
+        }
+
+        // Формат пачки: длина остатка в байтах, число сообщений, число отметок, сообщения, отметки.
+        // Длина позволяет резерву прочитать пачку одним recv_all
+        buffer.clear();
+        append_raw(buffer, uint32_t(0));
+        append_raw(buffer, static_cast<uint32_t>(batch.size()));
+        append_raw(buffer, static_cast<uint32_t>(processed.size()));
+        for (const auto& data : batch) {
+            append_message(buffer, data);
+        }
+        for (uint64_t seq : processed) {
+            append_raw(buffer, seq);
+        }
+        uint32_t body_bytes = static_cast<uint32_t>(buffer.size() - sizeof(uint32_t));
+        std::memcpy(buffer.data(), &body_bytes, sizeof(body_bytes));
+        if (!send_all(replication_fd, buffer.data(), buffer.size())) break;
+    }
+}
+
+// Поток приема подтверждений от резерва
+void replication_ack_reader() {
+    uint64_t acked;
+    while (recv_all(replication_fd, &acked, sizeof(acked))) {
+        {
+            std::lock_guard<std::mutex> lock(replication_mutex);
+            replication.acked = acked;
+        }
+        replication_ack_cv.notify_all();
+    }
+    // Резерв недоступен: не блокируем станции навсегда
+    {
+        std::lock_guard<std::mutex> lock(replication_mutex);
+        replication.stop = true;
+    }
+    replication_ack_cv.notify_all();
+    replication_cv.notify_all();
+}
+
+// Остановка репликации: досылаем накопленное и закрываем сокет на запись
+void replication_shutdown(std::thread& sender, std::thread& ack_reader) {
+    {
+        std::lock_guard<std::mutex> lock(replication_mutex);
+        replication.stop = true;
+    }
+    replication_cv.notify_all();
+    sender.join();
+    shutdown(replication_fd, SHUT_WR);
+    ack_reader.join();
+    close(replication_fd);
+}
+
+// ===================== Промежуточный уровень агрегации =====================
+// Каждый агрегатор обслуживает aggregator_fan_in станций: накапливает их данные,
+// оставляет только последнее показание каждой станции для одного класса приоритета
+// и раз в интервал отправляет на сервер по одной сводке на класс приоритета.
+// Критические данные идут на сервер напрямую, минуя агрегатор.
+
+struct Aggregator {
+    std::mutex mutex;
+    std::vector<MonitoringData> buffer;
+};
+
+int aggregator_fan_in = 0;                        // Станций на агрегатор (0 - агрегация выключена)
+const int aggregator_flush_ms = 200;              // Интервал отправки сводок
+std::vector<std::unique_ptr<Aggregator>> aggregators;
+std::atomic<long> aggregator_received(0);         // Принято от станций
+std::atomic<long> aggregator_duplicates(0);       // Отброшено как устаревшие показания
+std::atomic<long> aggregator_forwarded(0);        // Отправлено сводок на сервер
+
+// Отправка данных станции: через агрегатор или напрямую на сервер
+void submit_data(MonitoringData& data) {
+    if (aggregator_fan_in <= 0 || data.is_critical) {
+        accept_data(data);
+        return;
+    }
+    Aggregator& aggregator = *aggregators[(data.station_id - 1) / aggregator_fan_in];
+    std::lock_guard<std::mutex> lock(aggregator.mutex);
+    aggregator.buffer.push_back(std::move(data));
+    aggregator_received++;
+}
+
+// Дедупликация и свертка накопленных данных в сводки по классам приоритета
+std::vector<MonitoringData> summarize_batch(std::vector<MonitoringData>& batch) {
+    // Последнее показание станции в классе приоритета заменяет предыдущие
+    std::map<std::pair<int, int>, MonitoringData*> latest;
+    for (auto& data : batch) {
+        auto key = std::make_pair(data.priority, data.station_id);
+        auto it = latest.find(key);
+        if (it != latest.end()) {
+            aggregator_duplicates++;
+            it->second = &data;
+        } else {
+            latest.emplace(key, &data);
+        }
+    }
+
+    std::vector<MonitoringData> summaries;
+    for (const auto& entry : latest) {
+        const MonitoringData& data = *entry.second;
+        if (summaries.empty() || summaries.back().priority != data.priority) {
+            MonitoringData summary;
+            summary.station_id = data.station_id; // Первая станция сводки
+            summary.priority = data.priority;
+            summary.is_critical = false;
+            summary.size = 0;
+            summary.batch_count = 0;
+            summaries.push_back(std::move(summary));
+        }
+        MonitoringData& summary = summaries.back();
+        summary.size += data.size;
+        summary.batch_count++;
+    }
+    for (auto& summary : summaries) {
+        summary.payload = "Сводка: " + std::to_string(summary.batch_count) + " станций, приоритет "
+                          + std::to_string(summary.priority);
+    }
+    return summaries;
+}
+
+// Поток агрегатора
+void aggregator_worker(int aggregator_id) {
+    Aggregator& aggregator = *aggregators[aggregator_id];
+    std::vector<MonitoringData> batch;
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(aggregator_flush_ms));
+        {
+            std::lock_guard<std::mutex> lock(aggregator.mutex);
+            batch.swap(aggregator.buffer);
+        }
+        if (batch.empty()) continue;
+
+        for (auto& summary : summarize_batch(batch)) {
+            accept_data(summary);
+            aggregator_forwarded++;
+        }
+        batch.clear();
+    }
+}
+
+// Причина отказа в приеме данных станции
+enum class DropReason { None, Overload, Emergency, Memory };
+
+// Проверка приема по заголовку данных, до формирования полезной нагрузки
+DropReason check_admission(int priority, bool is_critical) {
+    // Проверяем перегрузку сервера
+    if (current_load > 80 && !is_critical && priority > 3) {
+        return DropReason::Overload;
+    }
+    // В режиме аварии отбрасываем низкоприоритетные данные
+    if (emergency_mode && priority > 2 && !is_critical) {
+        return DropReason::Emergency;
+    }
+    // Память очереди почти исчерпана - принимаем только критические данные
+    if (queue_memory_cap > 0 && !spill.enabled && !is_critical && queue_memory_bytes > queue_memory_cap / 10 * 9) {
+        return DropReason::Memory;
+    }
+    return DropReason::None;
+}
+
+// Формирование полезной нагрузки (только для принятых данных)
+Payload make_payload(int station_id) {
+    Payload payload = "Данные мониторинга от станции ";
+    payload += std::to_string(station_id);
+    return payload;
+}
+
+// ===================== Быстрый генератор для станций =====================
+// Вместо std::mt19937 (2.5 КБ состояния) и распределений на каждое поле станция
+// использует xoshiro256** (32 байта) и генерирует заголовки данных пачками:
+// сначала подряд вырабатываются 64-битные числа, затем отдельный цикл без ветвлений
+// переводит их в приоритет, критичность и размер (векторизуется компилятором).
+
+struct Xoshiro256 {
+    uint64_t s[4];
+
+    explicit Xoshiro256(uint64_t seed) {
+        // Инициализация состояния через splitmix64
+        for (auto& word : s) {
+            seed += 0x9e3779b97f4a7c15ULL;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            word = z ^ (z >> 31);
+        }
+    }
+
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    uint64_t next() {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+};
+
+// Число из [0, range) по 32 случайным битам (умножение со сдвигом вместо деления)
+inline uint32_t bounded_random(uint32_t bits, uint32_t range) {
+    return static_cast<uint32_t>((static_cast<uint64_t>(bits) * range) >> 32);
+}
+
+const size_t station_sample_batch = 64;
+const uint32_t critical_threshold = static_cast<uint32_t>(0.2 * 65536); // 20% критических данных
+
+// Пачка заголовков данных станции
+struct StationSamples {
+    uint8_t priority[station_sample_batch];
+    uint8_t critical[station_sample_batch];
+    uint16_t size[station_sample_batch];
+    uint16_t interval[station_sample_batch]; // Пауза до следующей отправки, мс
+    size_t next = station_sample_batch;
+};
+
+// Все поля заголовка берутся из одного 64-битного числа: у каждого поля свои 16 бит,
+// поэтому поля независимы (16 бит хватает для диапазонов до 1000 значений)
+inline void decode_station_header(uint64_t raw, uint8_t& priority, uint8_t& critical,
+                                  uint16_t& size, uint16_t& interval) {
+    uint32_t priority_bits = static_cast<uint32_t>(raw & 0xffff) << 16;
+    uint32_t critical_bits = static_cast<uint32_t>((raw >> 16) & 0xffff);
+    uint32_t size_bits = static_cast<uint32_t>((raw >> 32) & 0xffff) << 16;
+    uint32_t interval_bits = static_cast<uint32_t>(raw >> 48) << 16;
+    priority = static_cast<uint8_t>(1 + bounded_random(priority_bits, 5));   // 1-5
+    critical = critical_bits < critical_threshold;
+    size = static_cast<uint16_t>(100 + bounded_random(size_bits, 901));     // 100-1000
+    interval = static_cast<uint16_t>(400 + bounded_random(interval_bits, 901));
+}
+
+// Генерация пачки заголовков
+void sample_station_batch(Xoshiro256& gen, StationSamples& samples) {
+    uint64_t raw[station_sample_batch];
+    for (auto& value : raw) {
+        value = gen.next();
+    }
+    for (size_t i = 0; i < station_sample_batch; ++i) {
+        decode_station_header(raw[i], samples.priority[i], samples.critical[i],
+                              samples.size[i], samples.interval[i]);
+    }
+    samples.next = 0;
+}
+
+// Замер стоимости генерации заголовков: mt19937 с распределениями против xoshiro пачками
+int run_rng_benchmark(long messages) {
+    std::mt19937 mt(42);
+    std::uniform_int_distribution<> size_dist(100, 1000);
+    std::uniform_int_distribution<> priority_dist(1, 5);
+    std::bernoulli_distribution critical_dist(0.2);
+    uint64_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < messages; ++i) {
+        sink += priority_dist(mt) + critical_dist(mt) + size_dist(mt) + size_dist(mt);
+    }
+    double mt_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    Xoshiro256 gen(42);
+    StationSamples samples;
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < messages; ++i) {
+        if (samples.next == station_sample_batch) {
+            sample_station_batch(gen, samples);
+        }
+        size_t k = samples.next++;
+        sink += samples.priority[k] + samples.critical[k] + samples.size[k] + samples.interval[k];
+    }
+    double fast_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "[Тест] mt19937 + распределения: " << mt_ns / messages << " нс на заголовок, "
+              << sizeof(std::mt19937) << " байт состояния" << std::endl;
+    std::cout << "[Тест] xoshiro256** пачками:   " << fast_ns / messages << " нс на заголовок, "
+              << sizeof(Xoshiro256) << " байт состояния (контроль " << sink % 10 << ")" << std::endl;
+    return 0;
+}
+
 // Функция мониторинговой станции
 void monitoring_station(int station_id) {
     std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> size_dist(100, 1000); // Размер данных 100-1000 байт
-    std::uniform_int_distribution<> priority_dist(1, 5);  // Приоритет 1-5
-    std::bernoulli_distribution critical_dist(0.2);       // 20% критических данных
+    Xoshiro256 gen((static_cast<uint64_t>(rd()) << 32) ^ static_cast<uint64_t>(station_id));
+    StationSamples samples;
     
     while (true) {
-        // Генерируем данные
-        MonitoringData data;
-        data.station_id = station_id;
-        data.priority = priority_dist(gen);
-        data.is_critical = critical_dist(gen);
-        data.size = size_dist(gen);
-        data.payload = "Данные мониторинга от станции " + std::to_string(station_id);
+        // Берем очередной заголовок данных из пачки
+        if (samples.next == station_sample_batch) {
+            sample_station_batch(gen, samples);
+        }
+        size_t k = samples.next++;
+        int priority = samples.priority[k];
+        bool is_critical = samples.critical[k];
+        size_t size = samples.size[k];
         
-        // Проверяем перегрузку сервера
-        if (current_load > 80 && !data.is_critical && data.priority > 3) {
-            std::lock_guard<std::mutex> lock(cout_mutex);
-            std::cout << "[Станция " << station_id << "] Данные отброшены (перегрузка сервера)" << std::endl;
+        DropReason reason = check_admission(priority, is_critical);
+        if (reason == DropReason::Overload) {
+            if (verbose_log) {
+                std::lock_guard<std::mutex> lock(cout_mutex);
+                std::cout << "[Станция " << station_id << "] Данные отброшены (перегрузка сервера)" << std::endl;
+            }
             std::this_thread::sleep_for(std::chrono::milliseconds(500));
             continue;
         }
-        
-        // В режиме аварии отбрасываем низкоприоритетные данные
-        if (emergency_mode && data.priority > 2 && !data.is_critical) {
-            std::lock_guard<std::mutex> lock(cout_mutex);
-            std::cout << "[Станция " << station_id << "] Данные отброшены (режим аварии)" << std::endl;
+        if (reason == DropReason::Emergency) {
+            if (verbose_log) {
+                std::lock_guard<std::mutex> lock(cout_mutex);
+                std::cout << "[Станция " << station_id << "] Данные отброшены (режим аварии)" << std::endl;
+            }
             std::this_thread::sleep_for(std::chrono::milliseconds(200));
             continue;
         }
-        
-        // Добавляем данные в очередь
-        {
-            std::lock_guard<std::mutex> lock(queue_mutex);
-            data_queue.push(data);
+        if (reason == DropReason::Memory) {
+            if (verbose_log) {
+                std::lock_guard<std::mutex> lock(cout_mutex);
+                std::cout << "[Станция " << station_id << "] Данные отброшены (память очереди)" << std::endl;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            continue;
         }
         
-        {
+        // Данные будут приняты - только теперь формируем их полностью
+        MonitoringData data;
+        data.station_id = station_id;
+        data.priority = priority;
+        data.is_critical = is_critical;
+        data.size = size;
+        data.payload = make_payload(station_id);
+        
+        if (verbose_log) {
             std::lock_guard<std::mutex> lock(cout_mutex);
             std::cout << "[Станция " << station_id << "] Отправлены данные (приоритет " 
                       << data.priority << (data.is_critical ? ", КРИТИЧЕСКИЕ" : "") 
                       << "), размер: " << data.size << " байт" << std::endl;
         }
+
+        // Добавляем данные в очередь (напрямую или через агрегатор)
+        submit_data(data);
         
         // Имитация временного интервала между отправками
-        std::this_thread::sleep_for(std::chrono::milliseconds(300 + size_dist(gen)));
+        std::this_thread::sleep_for(std::chrono::milliseconds(samples.interval[k]));
+    }
+}
+
+// ===================== Событийная модель станций =====================
+// Вместо потока на станцию каждая станция - небольшой автомат (генератор и номер),
+// а события "пора отправить данные" хранятся в колесе таймеров с шагом 1 мс.
+// Несколько потоков-исполнителей обслуживают непересекающиеся диапазоны станций,
+// каждый со своим колесом, поэтому общих блокировок на пути событий нет.
+// Интервалы между отправками экспоненциальные (пуассоновский поток).
+
+struct EventStation {
+    Xoshiro256 gen;
+    int station_id;
+};
+
+// Хешированное колесо таймеров: слот = время % число слотов, остаток - в оборотах
+struct TimerWheel {
+    struct Entry {
+        uint32_t station; // Индекс станции у исполнителя
+        uint32_t rounds;  // Сколько полных оборотов колеса еще ждать
+    };
+
+    std::vector<std::vector<Entry>> slots;
+    uint64_t current = 0; // Номер следующего необработанного тика (во время advance - обрабатываемого)
+
+    explicit TimerWheel(size_t slot_count) : slots(slot_count) {}
+
+    // Событие на тике current + delay_ticks. Вне advance тик current еще не обработан: слот
+    // впервые встретится через delay_ticks % N тиков (при кратной задержке - на тике current),
+    // поэтому до срабатывания остается delay_ticks / N оборотов
+    void schedule(uint32_t station, uint64_t delay_ticks) {
+        delay_ticks = std::max<uint64_t>(delay_ticks, 1);
+        slots[(current + delay_ticks) % slots.size()].push_back({station, static_cast<uint32_t>(delay_ticks / slots.size())});
+    }
+
+    // Обработка тика current: fire(station) возвращает задержку до следующего события,
+    // отсчитываемую от этого тика
+    template <typename Fire>
+    size_t advance(Fire&& fire, std::vector<Entry>& scratch) {
+        const size_t slot = current % slots.size();
+        scratch.clear();
+        scratch.swap(slots[slot]);
+        size_t fired = 0;
+        for (Entry entry : scratch) {
+            if (entry.rounds > 0) {
+                entry.rounds--;
+                slots[slot].push_back(entry);
+                continue;
+            }
+            // Слот текущего тика уже пройден: слот due встретится через (delay - 1) % N + 1 тиков
+            uint64_t delay = std::max<uint64_t>(fire(entry.station), 1);
+            slots[(current + delay) % slots.size()].push_back({entry.station, static_cast<uint32_t>((delay - 1) / slots.size())});
+            ++fired;
+        }
+        ++current;
+        return fired;
     }
+};
+
+const double event_station_mean_interval_ms = 850.0; // Средний интервал, как у потоковой станции
+std::atomic<long> event_station_events(0);
+std::atomic<long> event_station_sent(0);
+std::atomic<long> event_station_max_lag_ms(0);
+
+// Экспоненциальная задержка в мс по 53 случайным битам
+uint64_t exponential_delay_ms(uint64_t raw, double mean_ms) {
+    double u = (raw >> 11) * 0x1.0p-53;
+    return static_cast<uint64_t>(-mean_ms * std::log1p(-u)) + 1;
+}
+
+// Один шаг автомата станции; возвращает задержку до следующего шага в мс
+uint64_t event_station_step(EventStation& station) {
+    uint64_t raw = station.gen.next();
+    uint8_t priority, critical;
+    uint16_t size, interval;
+    decode_station_header(raw, priority, critical, size, interval);
+
+    DropReason reason = check_admission(priority, critical);
+    if (reason == DropReason::Overload) return 500;
+    if (reason == DropReason::Emergency || reason == DropReason::Memory) return 200;
+
+    MonitoringData data;
+    data.station_id = station.station_id;
+    data.priority = priority;
+    data.is_critical = critical;
+    data.size = size;
+    data.payload = make_payload(station.station_id);
+    submit_data(data);
+    event_station_sent++;
+    return exponential_delay_ms(station.gen.next(), event_station_mean_interval_ms);
+}
+
+// Поток-исполнитель для станций [first_id, first_id + count)
+void event_station_executor(int first_id, int count, const std::atomic<bool>& running) {
+    std::vector<EventStation> stations;
+    stations.reserve(count);
+    TimerWheel wheel(1024);
+    std::random_device rd;
+    for (int i = 0; i < count; ++i) {
+        uint64_t seed = (static_cast<uint64_t>(rd()) << 32) ^ static_cast<uint64_t>(first_id + i);
+        stations.push_back({Xoshiro256(seed), first_id + i});
+        // Случайная начальная фаза, чтобы станции не отправляли данные одновременно
+        wheel.schedule(i, exponential_delay_ms(stations.back().gen.next(), event_station_mean_interval_ms));
+    }
+
+    std::vector<TimerWheel::Entry> scratch;
+    auto fire = [&stations](uint32_t index) { return event_station_step(stations[index]); };
+    auto start = std::chrono::steady_clock::now();
+    while (running) {
+        uint64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        long events = 0;
+        while (wheel.current <= now_ms) {
+            long lag = static_cast<long>(now_ms - wheel.current);
+            if (lag > event_station_max_lag_ms) event_station_max_lag_ms = lag;
+            events += static_cast<long>(wheel.advance(fire, scratch));
+        }
+        event_station_events += events;
+        std::this_thread::sleep_until(start + std::chrono::milliseconds(wheel.current));
+    }
+}
+
+// Проверка колеса таймеров: событие с задержкой d срабатывает ровно на d-м тике,
+// в том числе на границах оборотов (d = N - 1, N, N + 1, 2N), - и когда оно запланировано
+// снаружи, и когда исполнитель планирует следующее событие станции из fire
+int run_timer_wheel_check() {
+    const size_t slot_count = 1024;
+    const uint64_t delays[] = {1, 2, slot_count - 1, slot_count, slot_count + 1, 2 * slot_count,
+                               2 * slot_count + 1, 5 * slot_count + 7};
+    int failures = 0;
+    for (uint64_t start : {uint64_t(0), uint64_t(300)}) {
+        TimerWheel wheel(slot_count);
+        std::vector<TimerWheel::Entry> scratch;
+        for (uint64_t t = 0; t < start; ++t) wheel.advance([](uint32_t) { return uint64_t(0); }, scratch);
+        std::vector<uint64_t> fired_at(std::size(delays), 0);
+        for (size_t i = 0; i < std::size(delays); ++i) wheel.schedule(static_cast<uint32_t>(i), delays[i]);
+        for (uint64_t step = 0; step <= 6 * slot_count; ++step) {
+            // Повторно не планируем: огромная задержка уводит событие за пределы проверки
+            wheel.advance([&](uint32_t station) {
+                fired_at[station] = wheel.current - start; // Тик, обрабатываемый сейчас
+                return uint64_t(1) << 40;
+            }, scratch);
+        }
+        for (size_t i = 0; i < std::size(delays); ++i) {
+            bool ok = fired_at[i] == delays[i];
+            if (!ok) ++failures;
+            std::cout << "[Тест] Колесо " << slot_count << " слотов, старт с тика " << start << ": задержка "
+                      << delays[i] << " - сработало на тике " << fired_at[i] << (ok ? "" : " (ОШИБКА)") << std::endl;
+        }
+    }
+
+    // Перепланирование из fire: станция i каждый раз возвращает delays[i], интервал между
+    // соседними срабатываниями должен быть ровно delays[i]
+    TimerWheel wheel(slot_count);
+    std::vector<TimerWheel::Entry> scratch;
+    std::vector<uint64_t> last_fired(std::size(delays), 0), fired_count(std::size(delays), 0);
+    std::vector<int> wrong(std::size(delays), 0);
+    for (size_t i = 0; i < std::size(delays); ++i) wheel.schedule(static_cast<uint32_t>(i), delays[i]);
+    for (uint64_t step = 0; step <= 20 * slot_count; ++step) {
+        wheel.advance([&](uint32_t station) {
+            if (fired_count[station]++ > 0 && wheel.current - last_fired[station] != delays[station]) {
+                wrong[station]++;
+            }
+            last_fired[station] = wheel.current;
+            return delays[station];
+        }, scratch);
+    }
+    for (size_t i = 0; i < std::size(delays); ++i) {
+        bool ok = wrong[i] == 0 && fired_count[i] > 1;
+        if (!ok) ++failures;
+        std::cout << "[Тест] Перепланирование из fire, задержка " << delays[i] << ": " << fired_count[i]
+                  << " срабатываний, неверных интервалов " << wrong[i] << (ok ? "" : " (ОШИБКА)") << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+// Замер процессорного времени генерации при перегрузке:
+// полная сборка данных до проверки приема против ленивой сборки после нее
+int run_payload_benchmark(int messages) {
+    current_load = 90;
+    emergency_mode = true;
+
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<> size_dist(100, 1000);
+    std::uniform_int_distribution<> priority_dist(1, 5);
+    std::bernoulli_distribution critical_dist(0.2);
+    size_t sink = 0;
+    long admitted = 0;
+
+    std::clock_t start = std::clock();
+    for (int i = 0; i < messages; ++i) {
+        MonitoringData data;
+        data.station_id = 1 + i % 10;
+        data.priority = priority_dist(gen);
+        data.is_critical = critical_dist(gen);
+        data.size = size_dist(gen);
+        data.payload = make_payload(data.station_id);
+        if (check_admission(data.priority, data.is_critical) == DropReason::None) {
+            sink += data.payload.size();
+        }
+    }
+    double eager_ms = 1000.0 * (std::clock() - start) / CLOCKS_PER_SEC;
+
+    gen.seed(42);
+    start = std::clock();
+    for (int i = 0; i < messages; ++i) {
+        int priority = priority_dist(gen);
+        bool is_critical = critical_dist(gen);
+        size_t size = size_dist(gen);
+        if (check_admission(priority, is_critical) != DropReason::None) continue;
+        MonitoringData data;
+        data.station_id = 1 + i % 10;
+        data.priority = priority;
+        data.is_critical = is_critical;
+        data.size = size;
+        data.payload = make_payload(data.station_id);
+        sink += data.payload.size();
+        admitted++;
+    }
+    double lazy_ms = 1000.0 * (std::clock() - start) / CLOCKS_PER_SEC;
+
+    current_load = 0;
+    emergency_mode = false;
+
+    std::cout << "[Тест] Сообщений: " << messages << ", принято: " << admitted
+              << " (" << 100 * admitted / std::max(messages, 1) << "%)" << std::endl;
+    std::cout << "[Тест] Сборка до проверки: " << eager_ms << " мс CPU, после проверки: "
+              << lazy_ms << " мс CPU" << std::endl;
+    if (eager_ms > 0) {
+        std::cout << "[Тест] Сэкономлено " << static_cast<int>(100.0 * (eager_ms - lazy_ms) / eager_ms)
+                  << "% процессорного времени" << " (контроль " << sink % 10 << ")" << std::endl;
+    }
+    return 0;
 }
 
 // Функция обработчика данных
 void data_handler() {
     while (true) {
         MonitoringData data;
-        bool data_available = false;
         
         // Безопасное извлечение данных из очереди
-        {
-            std::lock_guard<std::mutex> lock(queue_mutex);
-            if (!data_queue.empty()) {
-                data = data_queue.top();
-                data_queue.pop();
-                data_available = true;
-            }
-        }
-        
-        if (data_available) {
+        if (take_data(data)) {
             process_data(data);
+            replication_mark_processed(data.seq);
         } else {
             std::this_thread::sleep_for(std::chrono::milliseconds(100));
         }
     }
 }
 
+// Создание обработчиков: без прогрева - начальные 5, с прогревом - сразу на максимальную емкость.
+// Прогретым обработчикам сразу выдается столько же ресурсов сервера, иначе половина из них
+// ждала бы, пока монитор нарастит емкость; при низкой загрузке монитор снизит ее как обычно
+void spawn_handlers(std::vector<std::thread>& handlers) {
+    int count = warmup.enabled ? std::clamp(warmup.handlers, 5, 10) : 5;
+    if (count > active_handlers) {
+        server_capacity.release(count - active_handlers);
+        active_handlers = count;
+    }
+    for (int i = 0; i < count; ++i) {
+        if (warmup.enabled && warmup.pin_threads) {
+            handlers.emplace_back([i] {
+                pin_current_thread(i);
+                data_handler();
+            });
+        } else {
+            handlers.emplace_back(data_handler);
+        }
+    }
+}
+
 // Функция мониторинга загрузки сервера
 void load_monitor() {
-    while (true) {
-        // Рассчитываем текущую загрузку
-        size_t load = (5 - server_capacity.try_acquire()) * 20; // Процентная загрузка
-        
-        // Пытаемся получить больше семфоров для точного расчета
-        for (int i = 0; i < 4; i++) {
-            if (server_capacity.try_acquire()) {
-                server_capacity.release();
-                break;
-            }
+    for (int tick = 1; ; ++tick) {
+        // Датчик памяти очереди - раз в 5 секунд, если задано ограничение
+        if (queue_memory_cap > 0 && tick % 10 == 0) {
+            std::lock_guard<std::mutex> lock(cout_mutex);
+            print_memory_gauge("[Монитор]");
+        }
+
+        // Рассчитываем текущую загрузку: забираем свободные ресурсы и сразу возвращаем
+        int handlers = active_handlers;
+        int free_slots = 0;
+        while (free_slots < handlers && server_capacity.try_acquire()) {
+            ++free_slots;
         }
+        server_capacity.release(free_slots);
+        size_t load = static_cast<size_t>((handlers - free_slots) * 100 / handlers); // Процентная загрузка
         
         current_load = load;
         
@@ -200,18 +1472,500 @@ void load_monitor() {
     }
 }
 
-int main() {
+// ===================== Резервный процесс и переключение =====================
+
+// Чтение одной пачки от основного процесса в журнал резерва: пачка читается целиком
+// и разбирается тем же read_message, что и журнал на диске
+bool standby_receive_batch(int fd, std::string& buffer, std::map<uint64_t, MonitoringData>& log, uint64_t& last_seq) {
+    uint32_t body_bytes;
+    if (!recv_all(fd, &body_bytes, sizeof(body_bytes))) return false;
+    buffer.resize(body_bytes);
+    if (!recv_all(fd, buffer.data(), body_bytes)) return false;
+    const char* ptr = buffer.data();
+    const char* end = ptr + buffer.size();
+    uint32_t count, processed_count;
+    if (!read_raw(ptr, end, count) || !read_raw(ptr, end, processed_count)) return false;
+    for (uint32_t i = 0; i < count; ++i) {
+        MonitoringData data;
+        if (!read_message(ptr, end, data)) return false;
+        last_seq = std::max(last_seq, data.seq);
+        log.emplace(data.seq, std::move(data));
+    }
+    for (uint32_t i = 0; i < processed_count; ++i) {
+        uint64_t seq;
+        if (!read_raw(ptr, end, seq)) return false;
+        log.erase(seq);
+    }
+    return true;
+}
+
+// Резерв: ведет копию журнала, при потере основного становится сервером
+int run_standby(int fd, bool promote_on_failure, int serve_seconds) {
+    std::map<uint64_t, MonitoringData> log; // Принятые и еще не обработанные сообщения
+    uint64_t last_seq = 0;
+    std::string buffer;
+    while (standby_receive_batch(fd, buffer, log, last_seq)) {
+        send_all(fd, &last_seq, sizeof(last_seq));
+    }
+    close(fd);
+    if (!promote_on_failure) return 0;
+
+    // Основной процесс пропал - переключаемся
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        for (auto& entry : log) {
+            queue_memory_bytes += message_footprint(entry.second);
+            data_queue.push(std::move(entry.second));
+        }
+    }
+    std::vector<std::thread> handlers;
+    for (int i = 0; i < 5; ++i) {
+        handlers.emplace_back(data_handler);
+    }
+    auto promoted = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cout << "[Резерв] Основной сервер недоступен. Переключение за "
+                  << std::chrono::duration_cast<std::chrono::microseconds>(promoted - start).count()
+                  << " мкс, восстановлено " << log.size() << " необработанных сообщений" << std::endl;
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(serve_seconds));
+    for (auto& handler : handlers) {
+        handler.detach();
+    }
+    return 0;
+}
+
+// Создание резервного процесса, связанного с текущим через сокет
+pid_t spawn_standby(bool promote_on_failure, int serve_seconds) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return -1;
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(sv[0]);
+        std::_Exit(run_standby(sv[1], promote_on_failure, serve_seconds));
+    }
+    close(sv[1]);
+    replication_fd = sv[0];
+    return pid;
+}
+
+// Демонстрация отказа: основной работает несколько секунд и "падает"
+int run_failover_demo(ReplicationMode mode, int run_seconds) {
+    pid_t standby = spawn_standby(true, 5);
+    if (standby < 0) return 1;
+    pid_t primary = fork();
+    if (primary == 0) {
+        // Основной процесс работает как обычно, реплицируя принятые данные
+        replication_mode = mode;
+        std::thread sender(replication_sender);
+        std::thread ack_reader(replication_ack_reader);
+
+        std::vector<std::thread> stations;
+        for (int i = 1; i <= 10; ++i) {
+            stations.emplace_back(monitoring_station, i);
+        }
+        std::vector<std::thread> handlers;
+        for (int i = 0; i < 2; ++i) {
+            handlers.emplace_back(data_handler);
+        }
+
+        std::this_thread::sleep_for(std::chrono::seconds(run_seconds));
+        {
+            std::lock_guard<std::mutex> lock(cout_mutex);
+            std::cout << "[Сервер] !!! Аварийное завершение основного процесса !!!" << std::endl;
+        }
+        // Имитация падения: процесс завершается без какой-либо очистки
+        std::_Exit(1);
+    }
+
+    // Соединение должно принадлежать только основному процессу
+    close(replication_fd);
+    waitpid(primary, nullptr, 0);
+    waitpid(standby, nullptr, 0);
+    return 0;
+}
+
+// Замер пропускной способности приема без репликации, с асинхронной и синхронной
+double measure_replication_throughput(ReplicationMode mode, int producers, int messages_per_producer) {
+    replication_mode = mode;
+    {
+        std::lock_guard<std::mutex> lock(replication_mutex);
+        replication = ReplicationState();
+    }
+
+    pid_t standby = -1;
+    std::thread sender, ack_reader;
+    if (mode != ReplicationMode::None) {
+        standby = spawn_standby(false, 0);
+        sender = std::thread(replication_sender);
+        ack_reader = std::thread(replication_ack_reader);
+    }
+
+    std::atomic<bool> producing(true);
+    std::thread consumer([&producing] {
+        while (true) {
+            // Флаг читается до попытки: иначе последнее сообщение могло бы прийти между
+            // пустой попыткой и проверкой флага и остаться необработанным
+            bool more = producing;
+            MonitoringData data;
+            if (take_data(data)) {
+                replication_mark_processed(data.seq);
+            } else if (!more) {
+                break;
+            }
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([p, messages_per_producer] {
+            for (int i = 0; i < messages_per_producer; ++i) {
+                MonitoringData data;
+                data.station_id = p + 1;
+                data.priority = 1 + i % 5;
+                data.is_critical = i % 5 == 0;
+                data.size = 100 + i % 900;
+                data.payload = make_payload(p + 1);
+                accept_data(data);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    producing = false;
+    consumer.join();
+
+    if (mode != ReplicationMode::None) {
+        replication_shutdown(sender, ack_reader);
+        waitpid(standby, nullptr, 0);
+    }
+    double seconds = std::chrono::duration<double>(end - start).count();
+    return producers * messages_per_producer / seconds;
+}
+
+int run_replication_benchmark(int producers, int messages_per_producer) {
+    const char* names[] = {"без репликации", "асинхронная", "синхронная"};
+    ReplicationMode modes[] = {ReplicationMode::None, ReplicationMode::Async, ReplicationMode::Sync};
+    double baseline = 0;
+    for (int i = 0; i < 3; ++i) {
+        double rate = measure_replication_throughput(modes[i], producers, messages_per_producer);
+        if (i == 0) baseline = rate;
+        std::cout << "[Тест] Репликация: " << names[i] << " - " << static_cast<long>(rate)
+                  << " сообщений/с (" << static_cast<int>(100.0 * rate / baseline) << "% от базовой)" << std::endl;
+    }
+    return 0;
+}
+
+// Запуск агрегаторов для station_count станций
+void start_aggregators(int station_count, int fan_in, std::vector<std::thread>& workers) {
+    aggregator_fan_in = fan_in;
+    if (fan_in <= 0) return;
+    int aggregator_count = (station_count + fan_in - 1) / fan_in;
+    for (int i = 0; i < aggregator_count; ++i) {
+        aggregators.push_back(std::make_unique<Aggregator>());
+    }
+    for (int i = 0; i < aggregator_count; ++i) {
+        workers.emplace_back(aggregator_worker, i);
+    }
+}
+
+// Отчет о стоимости приема на сервере
+void print_ingest_stats(int station_count, int fan_in) {
+    std::lock_guard<std::mutex> lock(cout_mutex);
+    long operations = server_operations.load();
+    long station_messages = server_station_messages.load();
+    std::cout << "[Тест] Станций: " << station_count << ", агрегаторов: " << aggregators.size()
+              << " (fan-in " << fan_in << ")" << std::endl;
+    std::cout << "[Тест] Агрегаторы: принято " << aggregator_received << ", дубликатов "
+              << aggregator_duplicates << ", отправлено сводок " << aggregator_forwarded << std::endl;
+    std::cout << "[Тест] Сервер: операций " << operations << ", сообщений станций "
+              << station_messages;
+    if (operations > 0) {
+        std::cout << " (" << static_cast<double>(station_messages) / operations << " на операцию)";
+    }
+    std::cout << std::endl;
+    print_memory_gauge("[Тест]");
+}
+
+// Работа системы с уровнем агрегации и отчет о стоимости приема на сервере
+int run_aggregation_demo(int station_count, int fan_in, int seconds) {
+    verbose_log = false;
+    std::vector<std::thread> workers;
+    start_aggregators(station_count, fan_in, workers);
+    for (int i = 1; i <= station_count; ++i) {
+        workers.emplace_back(monitoring_station, i);
+    }
+    for (int i = 0; i < 5; ++i) {
+        workers.emplace_back(data_handler);
+    }
+    workers.emplace_back(load_monitor);
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    print_ingest_stats(station_count, fan_in);
+    for (auto& t : workers) {
+        t.detach();
+    }
+    return 0;
+}
+
+// Событийная модель: station_count станций на нескольких исполнителях
+int run_event_stations(int station_count, int executors, int fan_in, int seconds, int drain_seconds = 0) {
+    verbose_log = false;
+    std::vector<std::thread> workers;
+    start_aggregators(station_count, fan_in, workers);
+    for (int i = 0; i < 5; ++i) {
+        workers.emplace_back(data_handler);
+    }
+    workers.emplace_back(load_monitor);
+
+    std::atomic<bool> running(true);
+    std::vector<std::thread> executor_threads;
+    int per_executor = (station_count + executors - 1) / executors;
+    for (int first = 1; first <= station_count; first += per_executor) {
+        int count = std::min(per_executor, station_count - first + 1);
+        executor_threads.emplace_back(event_station_executor, first, count, std::cref(running));
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    running = false;
+    for (auto& t : executor_threads) {
+        t.join();
+    }
+    // Станции остановлены - даем серверу разобрать накопленное
+    std::this_thread::sleep_for(std::chrono::seconds(drain_seconds));
+
+    print_ingest_stats(station_count, fan_in);
+    {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cout << "[Тест] Исполнителей: " << executor_threads.size() << ", событий: " << event_station_events
+                  << " (" << event_station_events / std::max(seconds, 1) << "/с), отправлено: "
+                  << event_station_sent << std::endl;
+        std::cout << "[Тест] Память станций: " << sizeof(EventStation) * station_count / 1024
+                  << " КБ, максимальное опоздание таймера: " << event_station_max_lag_ms << " мс" << std::endl;
+    }
+    for (auto& t : workers) {
+        t.detach();
+    }
+    return 0;
+}
+
+// Один прогон замера запуска: система работает window_seconds секунд
+void run_startup_trial(bool warm, int window_seconds) {
+    program_start = std::chrono::steady_clock::now();
+    verbose_log = false;
+    warmup.enabled = warm;
+    huge_page_mode = warm ? HugePageMode::Transparent : HugePageMode::Off;
+    warm_up_server();
+
+    std::vector<std::thread> threads;
+    spawn_handlers(threads);
+    for (int i = 1; i <= 10; ++i) {
+        threads.emplace_back(monitoring_station, i);
+    }
+    threads.emplace_back(load_monitor);
+
+    std::this_thread::sleep_for(std::chrono::seconds(window_seconds));
+    dispatch_latency.print(warm ? "[Тест] С прогревом" : "[Тест] Без прогрева");
+    std::cout.flush();
+    std::_Exit(0);
+}
+
+// Сравнение времени до первой обработки и задержек первых секунд работы
+int run_startup_benchmark(int window_seconds) {
+    for (bool warm : {false, true}) {
+        std::cout.flush();
+        pid_t pid = fork();
+        if (pid == 0) {
+            run_startup_trial(warm, window_seconds);
+        }
+        waitpid(pid, nullptr, 0);
+    }
+    return 0;
+}
+
+// Счетчик промахов TLB данных для текущего процесса (-1, если недоступен)
+int open_dtlb_counter() {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                  | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+// Один прогон: заполнение и опустошение большой очереди с нагрузкой из пула
+void run_huge_page_trial(HugePageMode mode, size_t messages) {
+    huge_page_mode = mode;
+    DataQueue queue;
+    {
+        DataStorage storage;
+        storage.reserve(messages);
+        queue = DataQueue(ComparePriority(), std::move(storage));
+    }
+    Xoshiro256 gen(42);
+    int counter = open_dtlb_counter();
+    if (counter >= 0) {
+        ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+        ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < messages; ++i) {
+        uint8_t priority, critical;
+        uint16_t size, interval;
+        decode_station_header(gen.next(), priority, critical, size, interval);
+        MonitoringData data;
+        data.station_id = static_cast<int>(i % 1000) + 1;
+        data.priority = priority;
+        data.is_critical = critical;
+        data.size = size;
+        data.payload = make_payload(data.station_id);
+        queue.push(std::move(data));
+    }
+    size_t sink = 0;
+    while (!queue.empty()) {
+        sink += queue.top().payload.size();
+        queue.pop();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const char* names[] = {"обычные страницы", "THP (madvise)", "MAP_HUGETLB"};
+    std::cout << "[Тест] " << names[static_cast<int>(mode)] << ": "
+              << static_cast<long>(2 * messages / seconds) << " операций очереди/с";
+    if (counter >= 0) {
+        ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+        long long misses = 0;
+        if (read(counter, &misses, sizeof(misses)) == sizeof(misses)) {
+            std::cout << ", промахов dTLB: " << misses;
+        }
+        close(counter);
+    } else {
+        std::cout << ", счетчик dTLB недоступен";
+    }
+    if (mode == HugePageMode::Explicit && hugetlb_bytes == 0) {
+        std::cout << " (MAP_HUGETLB недоступен, использован THP)";
+    }
+    std::cout << " (контроль " << sink % 10 << ")" << std::endl;
+}
+
+// Сравнение обычных страниц, THP и MAP_HUGETLB (каждый режим в отдельном процессе)
+int run_huge_page_benchmark(size_t messages) {
+    for (HugePageMode mode : {HugePageMode::Off, HugePageMode::Transparent, HugePageMode::Explicit}) {
+        std::cout.flush();
+        pid_t pid = fork();
+        if (pid == 0) {
+            run_huge_page_trial(mode, messages);
+            std::cout.flush();
+            std::_Exit(0);
+        }
+        waitpid(pid, nullptr, 0);
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    std::string mode = argc > 1 ? argv[1] : "";
+    if (mode == "failover") {
+        // Режим: ./task_2 failover [sync|async] [секунд до сбоя]
+        bool sync = argc > 2 && std::string(argv[2]) == "sync";
+        int seconds = argc > 3 ? std::atoi(argv[3]) : 5;
+        return run_failover_demo(sync ? ReplicationMode::Sync : ReplicationMode::Async, seconds);
+    }
+    if (mode == "replication-bench") {
+        // Режим: ./task_2 replication-bench [производителей] [сообщений на производителя]
+        int producers = argc > 2 ? std::atoi(argv[2]) : 4;
+        int messages = argc > 3 ? std::atoi(argv[3]) : 50000;
+        return run_replication_benchmark(std::max(producers, 1), messages);
+    }
+    if (mode == "check-timer-wheel") {
+        // Режим: ./task_2 check-timer-wheel - сроки срабатывания на границах оборотов колеса
+        return run_timer_wheel_check();
+    }
+    if (mode == "bench-payload") {
+        // Режим: ./task_2 bench-payload [сообщений]
+        int messages = argc > 2 ? std::atoi(argv[2]) : 2000000;
+        return run_payload_benchmark(messages);
+    }
+    if (mode == "bench-rng") {
+        // Режим: ./task_2 bench-rng [заголовков]
+        long messages = argc > 2 ? std::atol(argv[2]) : 10000000;
+        return run_rng_benchmark(std::max(messages, 1L));
+    }
+    if (mode == "event-stations") {
+        // Режим: ./task_2 event-stations [станций] [исполнителей] [станций на агрегатор] [секунд]
+        int station_count = argc > 2 ? std::atoi(argv[2]) : 1000000;
+        int executors = argc > 3 ? std::atoi(argv[3]) : 4;
+        int fan_in = argc > 4 ? std::atoi(argv[4]) : 10000;
+        int seconds = argc > 5 ? std::atoi(argv[5]) : 10;
+        return run_event_stations(std::max(station_count, 1), std::max(executors, 1),
+                                  std::max(fan_in, 0), seconds);
+    }
+    if (mode == "memory-spike") {
+        // Режим: ./task_2 memory-spike [лимит КБ] [станций] [секунд] - всплеск нагрузки при ограничении памяти
+        queue_memory_cap = static_cast<size_t>(argc > 2 ? std::atol(argv[2]) : 4096) * 1024;
+        int station_count = argc > 3 ? std::atoi(argv[3]) : 100000;
+        int seconds = argc > 4 ? std::atoi(argv[4]) : 10;
+        return run_event_stations(std::max(station_count, 1), 4, 0, seconds);
+    }
+    if (mode == "spill") {
+        // Режим: ./task_2 spill [лимит КБ] [станций] [секунд всплеска] [секунд разбора] [каталог]
+        queue_memory_cap = static_cast<size_t>(argc > 2 ? std::atol(argv[2]) : 256) * 1024;
+        int station_count = argc > 3 ? std::atoi(argv[3]) : 1000;
+        int seconds = argc > 4 ? std::atoi(argv[4]) : 5;
+        int drain_seconds = argc > 5 ? std::atoi(argv[5]) : 20;
+        spill.enabled = true;
+        spill.segment_bytes = std::min(spill.segment_bytes, queue_memory_cap / 20);
+        spill.write_buffer_max = std::min(spill.write_buffer_max, queue_memory_cap / 20);
+        if (argc > 6) spill.directory = argv[6];
+        std::thread spill_thread(spill_worker);
+        int result = run_event_stations(std::max(station_count, 1), 4, 0, seconds, std::max(drain_seconds, 0));
+        spill_shutdown(spill_thread);
+        dispatch_latency.print("[Тест] От приема до обработки (с возвратом с диска)");
+        return result;
+    }
+    if (mode == "aggregate") {
+        // Режим: ./task_2 aggregate [станций] [станций на агрегатор, 0 - без агрегации] [секунд]
+        int station_count = argc > 2 ? std::atoi(argv[2]) : 1000;
+        int fan_in = argc > 3 ? std::atoi(argv[3]) : 50;
+        int seconds = argc > 4 ? std::atoi(argv[4]) : 10;
+        return run_aggregation_demo(std::max(station_count, 1), std::max(fan_in, 0), seconds);
+    }
+    if (mode == "startup-bench") {
+        // Режим: ./task_2 startup-bench [секунд наблюдения, по умолчанию первая минута]
+        int seconds = argc > 2 ? std::atoi(argv[2]) : 60;
+        return run_startup_benchmark(std::max(seconds, 1));
+    }
+    if (mode == "bench-hugepages") {
+        // Режим: ./task_2 bench-hugepages [сообщений]
+        long messages = argc > 2 ? std::atol(argv[2]) : 2000000;
+        return run_huge_page_benchmark(static_cast<size_t>(std::max(messages, 1L)));
+    }
+    if (mode == "warm") {
+        // Обычная работа, но с прогревом
+        warmup.enabled = true;
+        huge_page_mode = HugePageMode::Transparent;
+        warm_up_server();
+    }
+
     // Создаем станции мониторинга
     std::vector<std::thread> stations;
     for (int i = 1; i <= 10; ++i) {
         stations.emplace_back(monitoring_station, i);
     }
     
-    // Создаем обработчики данных (начальное количество - 5)
+    // Создаем обработчики данных (начальное количество - 5, при прогреве - максимум)
     std::vector<std::thread> handlers;
-    for (int i = 0; i < 5; ++i) {
-        handlers.emplace_back(data_handler);
-    }
+    spawn_handlers(handlers);
     
     // Запускаем монитор загрузки
     std::thread monitor(load_monitor);